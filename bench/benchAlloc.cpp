@@ -0,0 +1,119 @@
+// Memory benchmark of hot actions.
+// Counts heap allocations through the global operator new/delete and
+// prints, for every action, the allocations per call and the allocations
+// still alive per call afterwards (retained state or leaks), one JSON line
+// per action.
+#include "Box.h"
+#include "Card.h"
+#include "Clock.h"
+#include "EmailServer.h"
+#include "Server.h"
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <vector>
+using namespace std;
+
+namespace {
+size_t allocations = 0;
+size_t deallocations = 0;
+
+void *countedAlloc(size_t size) {
+  allocations++;
+  if (void *ptr = malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw bad_alloc();
+}
+
+void countedFree(void *ptr) {
+  if (ptr != nullptr) {
+    deallocations++;
+    free(ptr);
+  }
+}
+} // namespace
+
+void *operator new(size_t size) { return countedAlloc(size); }
+void *operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void *ptr) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr) noexcept { countedFree(ptr); }
+void operator delete(void *ptr, size_t) noexcept { countedFree(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { countedFree(ptr); }
+
+namespace {
+constexpr int CARDS_IN_BOX = 16;
+
+/**
+ * @brief run an action and print its allocation counts
+ * @param action: name of the action
+ * @param count: number of calls
+ * @param body: one call of the action
+ */
+void measure(const string &action, int count, const function<void()> &body) {
+  body(); // Warm up lazily allocated state
+  size_t allocBefore = allocations, freeBefore = deallocations;
+  for (int i = 0; i < count; i++) {
+    body();
+  }
+  size_t allocs = allocations - allocBefore;
+  size_t frees = deallocations - freeBefore;
+  cout << "{\"action\": \"" << action
+       << "\", \"allocsPerOp\": " << (double)allocs / count
+       << ", \"retainedPerOp\": " << ((double)allocs - frees) / count << "}"
+       << endl;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int count = argc > 1 ? atoi(argv[1]) : 2000;
+  if (count <= 0) {
+    cerr << "Usage: " << argv[0] << " [count]" << endl;
+    return -1;
+  }
+  defaultClock().set(string("2025-06-01T12:00:00+0800"));
+
+  EmailServer emailServer;
+  Server server("server@bench.com", "serverPasswd123", &emailServer);
+  server.addUser("owner", "ownerPasswd", "owner@bench.com", "owner");
+  server.addUser("finder", "finderPasswd", "finder@bench.com", "finder");
+  emailServer.addAddress("owner@bench.com", "emailPasswd");
+  emailServer.addAddress("finder@bench.com", "emailPasswd");
+  Box box(&server, Labeled_GPS(25.0478, 121.5319, "bench"));
+  for (int c = 0; c < CARDS_IN_BOX; c++) {
+    string id = "stored" + to_string(c);
+    server.addCard("owner", "ownerPasswd", id);
+    box.login("finder");
+    box.addCard(new Card(id, 100));
+  }
+  server.addCard("owner", "ownerPasswd", "cycled");
+  Card payment("payment", 1 << 30);
+
+  measure("Card::new/delete", count, [] { delete new Card("card", 100); });
+  measure("EmailServer::sendEmail", count, [&emailServer] {
+    Email email;
+    email.subject = "Your Card is Found";
+    email.sender = "finder@bench.com";
+    email.recipient = "owner@bench.com";
+    emailServer.sendEmail(email, "emailPasswd");
+  });
+  measure("Box::addCard+retrieveCard", count, [&] {
+    box.login("finder");
+    box.addCard(new Card("cycled", 100));
+    box.login("owner", "ownerPasswd");
+    int code = server.findInfo("cycled")->verificationCode;
+    delete box.retrieveCard("cycled", code, &payment);
+  });
+  Json::Value boxJson = adoptJSON(box.dump2JSON());
+  boxJson["GPS"] = boxJson["gps"];
+  measure("Box::JSON2Object", count, [&] {
+    Box loaded;
+    loaded.JSON2Object(&boxJson);
+  });
+  measure("Box::dump2JSON", count, [&box] { delete box.dump2JSON(); });
+  measure("Server::dump2JSON", count, [&server] { delete server.dump2JSON(); });
+  measure("EmailServer::dump2JSON", count / 10,
+          [&emailServer] { delete emailServer.dump2JSON(); });
+  return 0;
+}
@@ -0,0 +1,242 @@
+// Micro-benchmark suite of the core hot paths.
+// Times single-threaded calls of Server, EmailServer, Box, JvTime, Utils and
+// the log, and counts their heap allocations through the global operator
+// new, then prints one JSON line per benchmark with its ns/op and
+// allocations/op.
+#include "Box.h"
+#include "Card.h"
+#include "Clock.h"
+#include "Core/AsyncLogger.h"
+#include "Core/JvTime.h"
+#include "Core/ModArith.h"
+#include "Core/TotpEngine.h"
+#include "Core/utils.h"
+#include "EmailServer.h"
+#include "Server.h"
+#include "TimerWheel.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+size_t allocations = 0;
+
+void *countedAlloc(size_t size) {
+  allocations++;
+  if (void *ptr = malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw bad_alloc();
+}
+} // namespace
+
+void *operator new(size_t size) { return countedAlloc(size); }
+void *operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+namespace {
+constexpr int MAILBOX_SIZE = 100; // Emails listed by getEmails
+
+string filter;          // Only run benchmarks whose name contains it
+volatile long long sink; // Keeps results from being optimized away
+
+/**
+ * @brief time a benchmark and print its ns/op and allocations/op
+ * @param name: name of the benchmark
+ * @param count: number of calls
+ * @param body: one call, given the call index
+ */
+template <typename F> void measure(const string &name, size_t count, F body) {
+  if (name.find(filter) == string::npos) {
+    return;
+  }
+  body(0); // Warm up lazily allocated state
+  size_t allocBefore = allocations;
+  auto begin = chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    body(i);
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+  size_t allocs = allocations - allocBefore;
+  cout << "{\"benchmark\": \"" << name << "\", \"ops\": " << count
+       << ", \"nsPerOp\": " << elapsed.count() * 1e9 / count
+       << ", \"allocsPerOp\": " << (double)allocs / count << "}" << endl;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  long count = argc > 1 ? atol(argv[1]) : 100000;
+  if (count <= 0 || argc > 3) {
+    cerr << "Usage: " << argv[0] << " [count] [filter]" << endl;
+    return -1;
+  }
+  filter = argc > 2 ? argv[2] : "";
+  defaultClock().set(string("2025-06-01T12:00:00+0800"));
+
+  EmailServer emailServer;
+  Server server("server@bench.com", "serverPasswd123", &emailServer);
+  server.addUser("owner", "ownerPasswd", "owner@bench.com", "owner");
+  server.addUser("finder", "finderPasswd", "finder@bench.com", "finder");
+  emailServer.addAddress("owner@bench.com", "emailPasswd");
+  emailServer.addAddress("finder@bench.com", "emailPasswd");
+  emailServer.addAddress("reader@bench.com", "emailPasswd");
+  server.addCard("owner", "ownerPasswd", "found");
+  server.addCard("owner", "ownerPasswd", "cycled");
+  server.addCard("owner", "ownerPasswd", "boxed");
+  server.addCard("owner", "ownerPasswd", "guessed");
+  Labeled_GPS gps(25.0478, 121.5319, "bench");
+  Box box(&server, gps);
+  Card payment("payment", 1 << 30);
+
+  Email email;
+  email.subject = "Your Card is Found";
+  email.body = "Your card with ID found has been found at location: bench.";
+  email.sender = "finder@bench.com";
+  for (int i = 0; i < MAILBOX_SIZE; i++) {
+    email.recipient = "reader@bench.com";
+    emailServer.sendEmail(email, "emailPasswd");
+  }
+  email.recipient = "owner@bench.com";
+
+  measure("Server::checkUser", count, [&](size_t) {
+    sink = server.checkUser("owner", "ownerPasswd");
+  });
+  measure("Server::checkUser/wrongPassword", count, [&](size_t) {
+    sink = server.checkUser("owner", "wrongPasswd");
+  });
+  measure("Server::notifyCardFound", count, [&](size_t) {
+    sink = server.notifyCardFound("found", gps, "finder", 10);
+  });
+  measure("Server::notifyCardFound+notifyCardRetrieved", count, [&](size_t) {
+    server.notifyCardFound("cycled", gps, "finder", 10);
+    int code = server.findInfo("cycled")->verificationCode;
+    sink = server.notifyCardRetrieved("cycled", code);
+  });
+  measure("EmailServer::sendEmail", count, [&](size_t) {
+    sink = emailServer.sendEmail(email, "emailPasswd");
+  });
+  measure("EmailServer::getEmails", count, [&](size_t) {
+    sink = emailServer.getEmails("reader@bench.com", "emailPasswd").size();
+  });
+  measure("Box::addCard+retrieveCard", count, [&](size_t) {
+    box.login("finder");
+    box.addCard(new Card("boxed", 100));
+    box.login("owner", "ownerPasswd");
+    int code = server.findInfo("boxed")->verificationCode;
+    delete box.retrieveCard("boxed", code, &payment);
+  });
+  measure("Box::openSession+closeSession", count, [&](size_t) {
+    box.closeSession(box.openSession("finder"));
+  });
+  // Timers spread over a day, one second passing per timer scheduled
+  TimerWheel timers;
+  long long now = 0;
+  timers.advance(now);
+  measure("TimerWheel::schedule+advance", count, [&](size_t i) {
+    timers.schedule(now + 1 + (long long)(i * 7919 % 86400), [] {});
+    sink = timers.advance(++now);
+  });
+
+  // A brute force of the verification code, turned away once throttled
+  box.login("finder");
+  box.addCard(new Card("guessed", 100));
+  box.login("owner", "ownerPasswd");
+  int wrongCode = (server.findInfo("guessed")->verificationCode + 1) % 1000000;
+  measure("Box::retrieveCard/wrongCode", count, [&](size_t) {
+    sink = box.retrieveCard("guessed", wrongCode, &payment) != nullptr;
+  });
+  RateLimiter &limiter = server.getAttemptLimiter();
+  limiter.setLimit(RateLimiter::USERNAME, 0, 0);
+  limiter.setLimit(RateLimiter::CARD, 0, 0);
+  limiter.setLimit(RateLimiter::BOX, 0, 0);
+  measure("Box::retrieveCard/wrongCode/unthrottled", count, [&](size_t) {
+    sink = box.retrieveCard("guessed", wrongCode, &payment) != nullptr;
+  });
+
+  string timeString = "2025-06-01T12:34:56+0800";
+  JvTime time(timeString.c_str());
+  JvTime later = time;
+  later.setEpoch(time.getEpoch() + 86400);
+  char buffer[JvTime::TIME_STRING_SIZE];
+  measure("JvTime::Parse", count, [&](size_t) {
+    sink = time.Parse(timeString.c_str());
+  });
+  measure("JvTime::format", count, [&](size_t) {
+    sink = time.format(buffer, sizeof(buffer));
+  });
+  measure("JvTime::toString", count,
+          [&](size_t) { sink = time.toString().size(); });
+  measure("JvTime::operator-", count,
+          [&](size_t) { sink = (long long)(later - time); });
+
+  measure("Utils::generateVerificationCode", count, [&](size_t i) {
+    sink = Utils::generateVerificationCode(123456789 + i, 1748752496 + i);
+  });
+  // A 2FA-sized exponent, batches are timed per base
+  constexpr long long MOD = 998244353, EXP = 58291749;
+  constexpr size_t BATCH = 64;
+  long long bases[BATCH], powers[BATCH];
+  measure("Utils::pow", count, [&](size_t i) {
+    sink = Utils::pow(123456789 + i, EXP, MOD);
+  });
+  measure("ModArith::pow", count, [&](size_t i) {
+    sink = ModArith<MOD>::pow(123456789 + i, EXP);
+  });
+  measure("ModArith::powBatch", count, [&](size_t i) {
+    if (i % BATCH == 0) {
+      for (size_t j = 0; j < BATCH; j++) {
+        bases[j] = 123456789 + i + j;
+      }
+      ModArith<MOD>::powBatch(bases, BATCH, EXP, powers);
+      sink = powers[0];
+    }
+  });
+
+  // Codes of 64 users, one call per second as a live server would see
+  TotpEngine totp;
+  measure("TotpEngine::code", count, [&](size_t i) {
+    sink = totp.code(123456789 + i % 64, 1748752496 + i / 64);
+  });
+  measure("TotpEngine::verify/window=1", count, [&](size_t i) {
+    sink = totp.verify(123456789 + i % 64, 1748752496 + i / 64, 0, 1);
+  });
+  // A new user each time, none of them cached
+  measure("TotpEngine::verify/uncached", count, [&](size_t i) {
+    sink = totp.verify(i, 1748752496, 0, 1);
+  });
+  TotpEngine::Request requests[BATCH];
+  bool results[BATCH];
+  measure("TotpEngine::verifyBatch/uncached", count, [&](size_t i) {
+    if (i % BATCH == 0) {
+      for (size_t j = 0; j < BATCH; j++) {
+        requests[j] = {(long long)(i + j), 0};
+      }
+      totp.verifyBatch(requests, BATCH, 1748752496, 1, results);
+      sink = results[0];
+    }
+  });
+
+  // Lines of a usual log size, the buffer fills up, so this is the rate the
+  // writer thread keeps up with
+  string logFile = "/tmp/benchCore" + to_string(getpid()) + ".log";
+  string line = "Card found: 100000000042 at Taipei 101 by user17, "
+                "reward 10";
+  AsyncLogger &logger = AsyncLogger::global();
+  measure("myPrintLog", count, [&](size_t) { myPrintLog(line, logFile); });
+  logger.flush();
+  // A single line written through, the latency of waking the writer
+  measure("AsyncLogger::log+flush", count / 10 + 1, [&](size_t) {
+    logger.log(LOG_INFO, logFile, line);
+    logger.flush();
+  });
+  remove(logFile.c_str());
+  return 0;
+}
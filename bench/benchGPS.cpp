@@ -0,0 +1,72 @@
+// Benchmark of one-to-many GPS distances.
+// Compares GPS_DD::distance called point by point with the GPS_Batch
+// kernels, and prints one JSON line per method.
+#include "Core/GPS.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+
+namespace {
+/**
+ * @brief print the timing of one method as a JSON line
+ * @param maxError: largest difference from GPS_DD::distance in miles
+ */
+void report(const string &method, size_t points, int rounds, double seconds,
+            double maxError) {
+  cout << "{\"method\": \"" << method << "\", \"points\": " << points
+       << ", \"nsPerDistance\": " << seconds * 1e9 / ((double)points * rounds)
+       << ", \"maxErrorMiles\": " << maxError << "}" << endl;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t points = argc > 1 ? atol(argv[1]) : 50000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 200;
+  if (points == 0 || rounds <= 0) {
+    cerr << "Usage: " << argv[0] << " [points] [rounds]" << endl;
+    return -1;
+  }
+
+  mt19937 rng(1520);
+  uniform_real_distribution<double> lat(-90, 90), lon(-180, 180);
+  vector<GPS_DD> scalar;
+  GPS_Batch batch;
+  batch.reserve(points);
+  for (size_t i = 0; i < points; i++) {
+    scalar.emplace_back(lat(rng), lon(rng));
+    batch.push_back(scalar.back());
+  }
+  GPS_DD query(25.0478, 121.5319);
+
+  vector<double> expected(points), out;
+  auto begin = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < points; i++) {
+      expected[i] = query.distance(scalar[i]);
+    }
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+  report("GPS_DD::distance", points, rounds, elapsed.count(), 0);
+
+  for (bool haversine : {false, true}) {
+    begin = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      if (haversine) {
+        batch.haversine(query, out);
+      } else {
+        batch.distance(query, out);
+      }
+    }
+    elapsed = chrono::steady_clock::now() - begin;
+    double maxError = 0;
+    for (size_t i = 0; i < points; i++) {
+      maxError = fmax(maxError, fabs(out[i] - expected[i]));
+    }
+    report(haversine ? "GPS_Batch::haversine" : "GPS_Batch::distance", points,
+           rounds, elapsed.count(), maxError);
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+// Micro-benchmark of JvTime parsing and formatting.
+// Compares JvTime::Parse/format with the previous sscanf/strftime path,
+// checks that both give the same results, and prints one JSON line per
+// method.
+#include "Core/JvTime.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+
+namespace {
+/**
+ * @brief previous JvTime::Parse, format checks then sscanf
+ */
+int legacyParse(JvTime &time, const char *time_str) {
+  const char zero_str[] = "0000-00-00T00:00:00+0000";
+  if ((time_str == NULL) || (strlen(time_str) != strlen(zero_str))) {
+    return EE1520_ERROR_NULL_CPP_PTR;
+  }
+  for (size_t i = 0; i < strlen(zero_str); i++) {
+    bool digit = time_str[i] >= '0' && time_str[i] <= '9';
+    if (zero_str[i] == '0' ? !digit : time_str[i] != zero_str[i]) {
+      return EE1520_ERROR_TIME_STRING_FORMAT;
+    }
+  }
+  sscanf(time_str, "%4d-%2d-%2dT%2d:%2d:%2d+%4s", &time.year, &time.month,
+         &time.day, &time.hour, &time.minute, &time.second, time.tail4);
+  return EE1520_ERROR_NORMAL;
+}
+
+/**
+ * @brief previous JvTime::getTimeString, getStdTM then strftime
+ */
+string *legacyFormat(const JvTime &time) {
+  struct std::tm *tm_ptr = time.getStdTM();
+  char buffer[128];
+  bzero(buffer, 128);
+  std::strftime(buffer, 32, "%Y-%m-%dT%H:%M:%S+", tm_ptr);
+  free(tm_ptr);
+  return new string(buffer);
+}
+
+bool sameFields(const JvTime &a, const JvTime &b) {
+  return a.year == b.year && a.month == b.month && a.day == b.day &&
+         a.hour == b.hour && a.minute == b.minute && a.second == b.second &&
+         strcmp(a.tail4, b.tail4) == 0;
+}
+
+void report(const string &method, size_t count, double seconds) {
+  cout << "{\"method\": \"" << method
+       << "\", \"nsPerOp\": " << seconds * 1e9 / count << "}" << endl;
+}
+
+template <typename F> double timeIt(F body) {
+  auto begin = chrono::steady_clock::now();
+  body();
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+  return elapsed.count();
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  size_t count = argc > 1 ? atol(argv[1]) : 1000000;
+  if (count == 0) {
+    cerr << "Usage: " << argv[0] << " [count]" << endl;
+    return -1;
+  }
+
+  mt19937_64 rng(1520);
+  vector<string> inputs;
+  vector<JvTime> times(count);
+  for (size_t i = 0; i < count; i++) {
+    times[i].setEpoch(rng() % 4000000000LL);
+    inputs.push_back(times[i].toString() + "0800");
+  }
+
+  // Both paths must agree before timing them
+  for (size_t i = 0; i < count; i++) {
+    JvTime fast, legacy;
+    string *legacyStr = legacyFormat(times[i]);
+    const char *input = inputs[i].c_str();
+    if (fast.Parse(input) != legacyParse(legacy, input) ||
+        !sameFields(fast, legacy) || times[i].toString() != *legacyStr) {
+      cerr << "Mismatch on " << inputs[i] << endl;
+      return -1;
+    }
+    delete legacyStr;
+  }
+
+  JvTime parsed;
+  long long sink = 0;
+  report("legacyParse", count, timeIt([&] {
+           for (const string &input : inputs) {
+             legacyParse(parsed, input.c_str());
+             sink += parsed.second;
+           }
+         }));
+  report("JvTime::Parse", count, timeIt([&] {
+           for (const string &input : inputs) {
+             parsed.Parse(input.c_str());
+             sink += parsed.second;
+           }
+         }));
+  report("legacyFormat", count, timeIt([&] {
+           for (const JvTime &time : times) {
+             string *str = legacyFormat(time);
+             sink += str->size();
+             delete str;
+           }
+         }));
+  report("JvTime::format", count, timeIt([&] {
+           char buffer[JvTime::TIME_STRING_SIZE];
+           for (const JvTime &time : times) {
+             sink += time.format(buffer, sizeof(buffer));
+           }
+         }));
+  report("JvTime::toString", count, timeIt([&] {
+           for (const JvTime &time : times) {
+             sink += time.toString().size();
+           }
+         }));
+  return sink == 0; // Keep the loops from being optimized away
+}
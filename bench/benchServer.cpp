@@ -0,0 +1,112 @@
+// Stress benchmark for concurrent Server access.
+// Every thread drives its own Box against one shared Server: a finder drops
+// cards, the owner checks in and retrieves them, and the finder redeems the
+// reward. Prints one JSON line per thread count.
+#include "Box.h"
+#include "Card.h"
+#include "Clock.h"
+#include "EmailServer.h"
+#include "Server.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+namespace {
+constexpr int CARDS_PER_THREAD = 64;
+constexpr int READS_PER_CYCLE = 8; // checkUser calls per found/retrieve cycle
+
+string ownerName(int thread) { return "owner" + to_string(thread); }
+string finderName(int thread) { return "finder" + to_string(thread); }
+string cardName(int thread, int card) {
+  return "card" + to_string(thread) + "-" + to_string(card);
+}
+
+/**
+ * @brief run one found/retrieve/redeem workload on a fresh server
+ * @param threads: number of threads, each with its own Box
+ * @param cycles: number of found/retrieve cycles per thread
+ * @return number of Server calls done by all threads
+ */
+long long runWorkload(Server &server, int threads, int cycles) {
+  vector<thread> workers;
+  vector<long long> ops(threads, 0);
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back([&server, &ops, t, cycles] {
+      Box box(&server, Labeled_GPS(25.0478, 121.5319, "bench" + to_string(t)));
+      const string owner = ownerName(t), finder = finderName(t);
+      Card payment("payment" + to_string(t), 1 << 30);
+      Card reward("reward" + to_string(t), 0);
+      vector<Card *> cards;
+      for (int c = 0; c < CARDS_PER_THREAD; c++) {
+        cards.push_back(new Card(cardName(t, c), 100));
+      }
+      for (int i = 0; i < cycles; i++) {
+        Card *card = cards[i % CARDS_PER_THREAD];
+        box.login(finder); // getNickname
+        if (box.addCard(card) != nullptr) { // notifyCardFound
+          continue;
+        }
+        for (int r = 0; r < READS_PER_CYCLE; r++) {
+          server.checkUser(owner, "ownerPasswd");
+        }
+        box.login(owner, "ownerPasswd"); // getNickname + checkUser
+        int code = server.findInfo(card->getId())->verificationCode;
+        // checkUser + notifyCardRetrieved
+        box.retrieveCard(card->getId(), code, &payment);
+        box.login(finder, "finderPasswd"); // getNickname + checkUser
+        box.redeemReward(-1, &reward);     // redeemReward
+        ops[t] += READS_PER_CYCLE + 9;
+      }
+      for (Card *card : cards) {
+        delete card;
+      }
+    });
+  }
+  for (thread &worker : workers) {
+    worker.join();
+  }
+  long long total = 0;
+  for (long long n : ops) {
+    total += n;
+  }
+  return total;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int maxThreads = argc > 1 ? atoi(argv[1]) : thread::hardware_concurrency();
+  int cycles = argc > 2 ? atoi(argv[2]) : 20000;
+  if (maxThreads <= 0 || cycles <= 0) {
+    cerr << "Usage: " << argv[0] << " [maxThreads] [cyclesPerThread]" << endl;
+    return -1;
+  }
+  defaultClock().set(string("2025-06-01T12:00:00+0800"));
+
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    EmailServer emailServer;
+    Server server("server@bench.com", "serverPasswd123", &emailServer);
+    for (int t = 0; t < threads; t++) {
+      for (const string &name : {ownerName(t), finderName(t)}) {
+        string passwd = name.substr(0, name.size() - to_string(t).size());
+        server.addUser(name, passwd + "Passwd", name + "@bench.com", name);
+        emailServer.addAddress(name + "@bench.com", "emailPasswd");
+      }
+      for (int c = 0; c < CARDS_PER_THREAD; c++) {
+        server.addCard(ownerName(t), "ownerPasswd", cardName(t, c));
+      }
+    }
+
+    auto begin = chrono::steady_clock::now();
+    long long ops = runWorkload(server, threads, cycles);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    cout << "{\"threads\": " << threads << ", \"ops\": " << ops
+         << ", \"seconds\": " << elapsed.count()
+         << ", \"opsPerSec\": " << (long long)(ops / elapsed.count())
+         << ", \"ledgerAudit\": "
+         << (server.getRewardLedger().audit() ? "true" : "false") << "}"
+         << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,276 @@
+#include "ActionDispatcher.h"
+#include "Card.h"
+#include "Clock.h"
+#include "World.h"
+#include <iostream>
+using namespace std;
+
+namespace {
+void compileNothing(const Json::Value &, ActionBatch &, Action &) {}
+
+// Box actions run at the box nearest to the actor when it gives its location
+void compileLocation(const Json::Value &json, Action &action) {
+  if (json["latitude"].isNumeric() && json["longitude"].isNumeric()) {
+    action.located = true;
+    action.latitude = json["latitude"].asDouble();
+    action.longitude = json["longitude"].asDouble();
+  }
+}
+
+Box *boxOf(World &world, const Action &action) {
+  if (!action.located) {
+    return &world.box1;
+  }
+  return world.nearestBox(GPS_DD(action.latitude, action.longitude));
+}
+
+void compileBoxCardId(const Json::Value &json, ActionBatch &batch,
+                      Action &action) {
+  action.args[0] = batch.intern(json["cardId"].asString());
+  compileLocation(json, action);
+}
+
+void compileCardId(const Json::Value &json, ActionBatch &batch,
+                   Action &action) {
+  action.args[0] = batch.intern(json["cardId"].asString());
+}
+
+bool executeAddCard(World &, User &user, const ActionBatch &batch,
+                    const Action &action) {
+  user.addCardToServer(batch.str(action.args[0]));
+  return true;
+}
+
+bool executeRemoveCard(World &world, User &user, const ActionBatch &batch,
+                       const Action &action) {
+  const string &cardId = batch.str(action.args[0]);
+  // A card the user does not hold, e.g. left in a box, stays where it is
+  if (Card *card = user.removeCard(cardId)) {
+    world.cards[cardId] = card;
+  }
+  return true;
+}
+
+bool executeGetCard(World &world, User &user, const ActionBatch &batch,
+                    const Action &action) {
+  const string &cardId = batch.str(action.args[0]);
+  user.addCard(world.cards[cardId]);
+  world.cards.erase(cardId);
+  return true;
+}
+
+bool executeDropCard(World &world, User &user, const ActionBatch &batch,
+                     const Action &action) {
+  user.dropCard(boxOf(world, action), batch.str(action.args[0]));
+  return true;
+}
+
+void compileRetrieveCard(const Json::Value &json, ActionBatch &batch,
+                         Action &action) {
+  action.args[0] = batch.intern(json["cardId"].asString());
+  action.args[1] = batch.intern(json["paymentCardId"].asString());
+  compileLocation(json, action);
+}
+
+bool executeRetrieveCard(World &world, User &user, const ActionBatch &batch,
+                         const Action &action) {
+  user.retrieveCard(boxOf(world, action), batch.str(action.args[0]),
+                    batch.str(action.args[1]));
+  return true;
+}
+
+void compileReadMail(const Json::Value &json, ActionBatch &, Action &action) {
+  action.number = json["mailId"].asInt();
+}
+
+bool executeReadMail(World &, User &user, const ActionBatch &,
+                     const Action &action) {
+  user.readMail(action.number);
+  return true;
+}
+
+// number is the UserInfo::VerificationType, -1 if the name is unknown
+void compileSetVerificationType(const Json::Value &json, ActionBatch &batch,
+                                Action &action) {
+  string verificationType = json["verificationType"].asString();
+  action.args[0] = batch.intern(verificationType);
+  if (verificationType == "EMAIL") {
+    action.number = UserInfo::EMAIL;
+  } else if (verificationType == "APP") {
+    action.number = UserInfo::APP;
+  } else {
+    action.number = -1;
+  }
+}
+
+bool executeSetVerificationType(World &, User &user, const ActionBatch &batch,
+                                const Action &action) {
+  if (action.number == -1) {
+    cerr << "Unknown verification type: " << batch.str(action.args[0])
+         << endl;
+    return false;
+  }
+  user.setVerificationType((UserInfo::VerificationType)action.number);
+  return true;
+}
+
+void compileRedeemReward(const Json::Value &json, ActionBatch &batch,
+                         Action &action) {
+  action.args[0] = batch.intern(json["cardId"].asString());
+  action.number = json["amount"].asInt();
+  compileLocation(json, action);
+}
+
+bool executeRedeemReward(World &world, User &user, const ActionBatch &batch,
+                         const Action &action) {
+  user.redeemReward(boxOf(world, action), batch.str(action.args[0]),
+                    action.number);
+  return true;
+}
+
+bool executeRejectRetrieve(World &, User &user, const ActionBatch &batch,
+                           const Action &action) {
+  user.rejectRetrieve(batch.str(action.args[0]));
+  return true;
+}
+
+bool executeLeakVerificationCode(World &world, User &user, const ActionBatch &,
+                                 const Action &) {
+  world.leakVerificationCode = user.leakVerificationCode();
+  return true;
+}
+
+void compileStealCard(const Json::Value &json, ActionBatch &batch,
+                      Action &action) {
+  action.args[0] = batch.intern(json["cardId"].asString());
+  action.args[1] = batch.intern(json["username"].asString());
+  action.args[2] = batch.intern(json["password"].asString());
+  action.args[3] = batch.intern(json.get("paymentCardId", "").asString());
+  compileLocation(json, action);
+}
+
+bool executeStealCard(World &world, User &, const ActionBatch &batch,
+                      const Action &action) {
+  const string &cardId = batch.str(action.args[0]);
+  Card *card = world.hacker.stealCard(
+      boxOf(world, action), cardId, batch.str(action.args[1]),
+      batch.str(action.args[2]), world.leakVerificationCode,
+      batch.str(action.args[3]));
+  if (card) {
+    cout << "Hacker stole card: " << card->getId() << endl;
+  } else {
+    cerr << "Hacker failed to steal card: " << cardId << endl;
+  }
+  return true;
+}
+
+bool executeDropToFake(World &world, User &user, const ActionBatch &batch,
+                       const Action &action) {
+  user.dropCard(&world.fakeBox, batch.str(action.args[0]));
+  return true;
+}
+} // namespace
+
+ActionRegistry::ActionRegistry() {
+  // In ActionOpcode order
+  add({"addCard", compileCardId, executeAddCard});
+  add({"removeCard", compileCardId, executeRemoveCard});
+  add({"getCard", compileCardId, executeGetCard});
+  add({"dropCard", compileBoxCardId, executeDropCard});
+  add({"retrieveCard", compileRetrieveCard, executeRetrieveCard});
+  add({"readMail", compileReadMail, executeReadMail});
+  add({"setVerificationType", compileSetVerificationType,
+       executeSetVerificationType});
+  add({"redeemReward", compileRedeemReward, executeRedeemReward});
+  add({"rejectRetrieve", compileCardId, executeRejectRetrieve});
+  add({"leakVerificationCode", compileNothing, executeLeakVerificationCode});
+  add({"stealCard", compileStealCard, executeStealCard});
+  add({"dropToFake", compileCardId, executeDropToFake});
+}
+
+ActionRegistry &ActionRegistry::global() {
+  static ActionRegistry registry;
+  return registry;
+}
+
+uint16_t ActionRegistry::add(const ActionKind &kind) {
+  auto it = opcodes.find(kind.name);
+  if (it != opcodes.end()) {
+    kinds[it->second] = kind;
+    return it->second;
+  }
+  uint16_t opcode = kinds.size();
+  kinds.push_back(kind);
+  opcodes[kind.name] = opcode;
+  return opcode;
+}
+
+uint16_t ActionRegistry::opcode(const string &name) const {
+  auto it = opcodes.find(name);
+  if (it == opcodes.end()) {
+    return ACTION_UNKNOWN;
+  }
+  return it->second;
+}
+
+const ActionKind &ActionRegistry::kind(uint16_t opcode) const {
+  return kinds[opcode];
+}
+
+ActionRegistrar::ActionRegistrar(const ActionKind &kind) {
+  ActionRegistry::global().add(kind);
+}
+
+ActionBatch::ActionBatch() { intern(""); }
+
+ActionBatch ActionBatch::compile(const Json::Value &actionsJson,
+                                 const ActionRegistry &registry) {
+  ActionBatch batch;
+  batch.actions.reserve(actionsJson.size());
+  for (const Json::Value &json : actionsJson) {
+    Action &action = batch.actions.emplace_back();
+    string name = json["action"].asString();
+    action.opcode = registry.opcode(name);
+    action.name = batch.intern(name);
+    action.who = batch.intern(json["who"].asString());
+    if (json["timespan"].isString()) {
+      action.timespan = SimClock::parseTimespan(json["timespan"].asString());
+    }
+    if (action.opcode != ACTION_UNKNOWN) {
+      registry.kind(action.opcode).compile(json, batch, action);
+    }
+  }
+  return batch;
+}
+
+uint32_t ActionBatch::intern(const string &value) {
+  auto [it, isNew] = stringIds.try_emplace(value, strings.size());
+  if (isNew) {
+    strings.push_back(value);
+  }
+  return it->second;
+}
+
+const string &ActionBatch::str(uint32_t id) const { return strings[id]; }
+
+ActionDispatcher::ActionDispatcher(World &world, const ActionBatch &batch,
+                                   const ActionRegistry &registry)
+    : world(world), batch(batch), registry(registry),
+      users(batch.strings.size(), nullptr) {}
+
+bool ActionDispatcher::run(const Action &action) {
+  if (action.opcode == ACTION_UNKNOWN) {
+    cerr << "Unknown action: " << batch.str(action.name) << endl;
+    return false;
+  }
+  User *&user = users[action.who];
+  if (user == nullptr) {
+    auto it = world.users.find(batch.str(action.who));
+    if (it == world.users.end() || it->second == nullptr) {
+      cerr << "Unknown user: " << batch.str(action.who) << endl;
+      return false;
+    }
+    user = it->second;
+  }
+  return registry.kind(action.opcode).execute(world, *user, batch, action);
+}
@@ -0,0 +1,163 @@
+#ifndef ACTION_DISPATCHER_H
+#define ACTION_DISPATCHER_H
+
+#include "Core/ee1520_Common.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ActionBatch;
+class User;
+class World;
+
+// Opcodes of the built-in actions, registered kinds get the following ones
+enum ActionOpcode : uint16_t {
+  ACTION_ADD_CARD,
+  ACTION_REMOVE_CARD,
+  ACTION_GET_CARD,
+  ACTION_DROP_CARD,
+  ACTION_RETRIEVE_CARD,
+  ACTION_READ_MAIL,
+  ACTION_SET_VERIFICATION_TYPE,
+  ACTION_REDEEM_REWARD,
+  ACTION_REJECT_RETRIEVE,
+  ACTION_LEAK_VERIFICATION_CODE,
+  ACTION_STEAL_CARD,
+  ACTION_DROP_TO_FAKE,
+  ACTION_BUILTIN_COUNT,
+  ACTION_UNKNOWN = 0xFFFF, // Name not registered, fails when run
+};
+
+/*
+ * One entry of actions.json, compiled: the strings are ids into the string
+ * table of its ActionBatch, and the meaning of args and number is up to the
+ * kind of the action.
+ */
+struct Action {
+  uint16_t opcode = ACTION_UNKNOWN;
+  uint32_t name = 0;         // The "action" field
+  uint32_t who = 0;          // The "who" field, username of the actor
+  uint32_t args[4] = {};     // String arguments, e.g. the card id
+  int number = 0;            // Integer argument, e.g. the amount
+  long long timespan = 3600; // Seconds the clock moves after the action
+  // "latitude" and "longitude" of the actor, for actions at the nearest box
+  bool located = false;
+  double latitude = 0;
+  double longitude = 0;
+};
+
+struct ActionKind {
+  std::string name; // The "action" field it handles
+  /**
+   * @brief read the arguments of an action
+   * @param json: the entry of actions.json
+   * @param batch: the batch, for interning strings
+   * @param action[out]: the action, opcode, name, who and timespan are set
+   */
+  void (*compile)(const Json::Value &json, ActionBatch &batch, Action &action);
+  /**
+   * @brief run an action
+   * @param world: the world to run it on
+   * @param user: the actor
+   * @param batch: the batch of the action, for its strings
+   * @param action: the action
+   * @return false to stop the replay, after reporting why on stderr
+   */
+  bool (*execute)(World &world, User &user, const ActionBatch &batch,
+                  const Action &action);
+};
+
+/*
+ * The kinds of actions known by name. Kinds must be added before replaying
+ * starts, e.g. by a static ActionRegistrar, later on it is only read.
+ */
+class ActionRegistry {
+private:
+  std::vector<ActionKind> kinds; // opcode -> kind
+  std::unordered_map<std::string, uint16_t> opcodes;
+
+  ActionRegistry(); // Adds the built-in kinds
+
+public:
+  /**
+   * @brief get the registry used by ActionBatch::compile
+   */
+  static ActionRegistry &global();
+  /**
+   * @brief add a kind of action, replacing a kind of the same name
+   * @return the opcode of the kind
+   */
+  uint16_t add(const ActionKind &kind);
+  /**
+   * @brief get the opcode of a name
+   * @return the opcode, ACTION_UNKNOWN if no kind has the name
+   */
+  uint16_t opcode(const std::string &name) const;
+  /**
+   * @brief get the kind of an opcode other than ACTION_UNKNOWN
+   */
+  const ActionKind &kind(uint16_t opcode) const;
+};
+
+/*
+ * Registers a kind of action when constructed, meant to be a static object:
+ *   static ActionRegistrar registrar{{"myAction", compileMy, executeMy}};
+ */
+struct ActionRegistrar {
+  ActionRegistrar(const ActionKind &kind);
+};
+
+/*
+ * A compiled actions.json: the actions and the strings they refer to, each
+ * distinct string stored once.
+ */
+class ActionBatch {
+private:
+  std::unordered_map<std::string, uint32_t> stringIds;
+
+public:
+  std::vector<Action> actions;
+  std::vector<std::string> strings; // id -> string, id 0 is ""
+
+  ActionBatch();
+  /**
+   * @brief compile the entries of actions.json
+   * @param actionsJson: the array of entries
+   * @param registry: the kinds of actions
+   */
+  static ActionBatch compile(const Json::Value &actionsJson,
+                             const ActionRegistry &registry =
+                                 ActionRegistry::global());
+  /**
+   * @brief get the id of a string, adding it to the table if needed
+   */
+  uint32_t intern(const std::string &value);
+  /**
+   * @brief get the string of an id
+   */
+  const std::string &str(uint32_t id) const;
+};
+
+/*
+ * Runs the actions of a batch on a world through the dispatch table of a
+ * registry. Actors are looked up once per username.
+ */
+class ActionDispatcher {
+private:
+  World &world;
+  const ActionBatch &batch;
+  const ActionRegistry &registry;
+  std::vector<User *> users; // string id -> user, nullptr if not looked up
+
+public:
+  ActionDispatcher(World &world, const ActionBatch &batch,
+                   const ActionRegistry &registry = ActionRegistry::global());
+  /**
+   * @brief run one action of the batch
+   * @return false if it failed, after reporting why on stderr
+   */
+  bool run(const Action &action);
+};
+
+#endif // ACTION_DISPATCHER_H
@@ -1,21 +1,32 @@
 #include "App2FA.h"
-#include "Core/utils.h"
-#include "Env.h"
+#include "Clock.h"
+#include "Core/TotpEngine.h"
+#include "Metrics.h"
 #include "Server.h"
 #include <ctime>
 #include <utility>
 using namespace std;
 
-App2FA::App2FA() : secret(0), id(-1) {}
+namespace {
+const Counter codesGenerated =
+    MetricsRegistry::global().counter("app2fa_code_total");
+} // namespace
 
-App2FA::App2FA(const string &username, Server *server) {
+App2FA::App2FA() : secret(0), id(-1), clock(&defaultClock()) {}
+
+App2FA::App2FA(const string &username, Server *server)
+    : secret(0), id(-1), clock(&defaultClock()) {
   setServer(username, server);
 }
 
+App2FA::App2FA(long long id, long long secret, const Clock *clock)
+    : secret(secret), id(id), clock(clock) {}
+
 App2FA::~App2FA() {}
 
 void App2FA::setServer(const string &username, Server *server) {
   if (server) {
+    clock = &server->getClock();
     auto ret = server->setup2FA(username);
     if (ret.first != -1) {
       id = ret.first;      // Set the ID for the 2FA
@@ -32,6 +43,7 @@ int App2FA::generateVerificationCode() const {
     return -1; // Return -1 if the secret is not set
   }
   // Generate a verification code based on the secret and current time
-  long long currentTime = mktime(Env::getNow().getStdTM());
-  return Utils::generateVerificationCode(secret, currentTime); // 6-digit code
+  codesGenerated.add();
+  long long currentTime = clock->now().getEpoch();
+  return TotpEngine::local().code(secret, currentTime); // 6-digit code
 }
@@ -3,17 +3,26 @@
 
 #include <string>
 
+class Clock;
 class Server;
 
 class App2FA {
 private:
   long long secret; // Secret key for the app 2FA
   long long id;
+  const Clock *clock; // Clock of the server the app is set up with
 
 protected:
 public:
   App2FA();
   App2FA(const std::string &username, Server *server);
+  /**
+   * @brief Attach to a 2FA the server already set up, without a new secret
+   * @param id The ID of the 2FA
+   * @param secret The secret key of the 2FA
+   * @param clock The clock of the server
+   */
+  App2FA(long long id, long long secret, const Clock *clock);
   virtual ~App2FA();
   /**
    * @brief Generate a verification code based on the app secret and current
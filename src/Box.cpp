@@ -1,19 +1,40 @@
 #include "Box.h"
 #include "Card.h"
+#include "Clock.h"
+#include "Core/BinaryIO.h"
 #include "Core/ee1520_Common.h"
-#include "Env.h"
+#include "Metrics.h"
+#include "RateLimiter.h"
 #include "Server.h"
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 using namespace std;
 
-void Box::Session::clear() {
-  username = "";
-  passwd = "";
+namespace {
+MetricsRegistry &metrics = MetricsRegistry::global();
+const Counter logins = metrics.counter("box_login_total");
+const Counter loginFailures = metrics.counter("box_login_failed_total");
+const Histogram addCardLatency = metrics.histogram("box_add_card_ns");
+const Histogram retrieveCardLatency = metrics.histogram("box_retrieve_card_ns");
+const Gauge cardsInBoxes = metrics.gauge("box_cards");
+const Counter throttled = metrics.counter("box_throttled_total");
+
+/**
+ * @brief get the key of a box in the attempt limiter
+ * @param gps: the location of the box
+ * @return the label and the coordinates, the same for every load of the box
+ */
+string limiterKeyOf(const Labeled_GPS &gps) {
+  return gps.label + '@' + to_string(gps.latitude) + ',' +
+         to_string(gps.longitude);
 }
 
+const string NOBODY = ""; // Username and password without a valid session
+} // namespace
+
 Box::Box(Server *server, const Labeled_GPS &gpsLocation)
-    : server(server), gps(gpsLocation) {}
+    : server(server), gps(gpsLocation), limiterKey(limiterKeyOf(gps)) {}
 
 Box::Box(Server *server, Json::Value *arg_json_ptr) : server(server) {
   JSON2Object(arg_json_ptr);
@@ -21,42 +42,72 @@ Box::Box(Server *server, Json::Value *arg_json_ptr) : server(server) {
 
 Box::~Box() {
   // Clean up the cards in the box
+  cardsInBoxes.add(-(long long)cards.size());
   for (auto &pair : cards) {
     delete pair.second; // Assuming ownership of Card objects
   }
   cards.clear();
 }
 
-const Box::Session &Box::getSession() {
-  constexpr int VALID_SEC = 60;
-  if (JvTime currentTime = Env::getNow();
-      currentTime - sess.lastActive > VALID_SEC) {
-    // session outdated.
-    sess.clear();
-  } else
-    sess.lastActive = currentTime;
-  return sess;
+const SessionTable::Session *Box::getSession(SessionToken token,
+                                             long long now) {
+  return sessions.find(token, now);
 }
 
-string Box::login(const string &username, const string &passwd) {
+Box::SessionToken Box::openSession(const string &username,
+                                   const string &passwd, string *nickname) {
   // NOTE: 為了防暴搜username，實際上要在錯誤時拖延時間
   //       或是讓用戶能用QRcode登入，讓用戶必須有密碼
+  logins.add();
+  if (nickname != nullptr) {
+    *nickname = "";
+  }
+  RateLimiter &limiter = server->getAttemptLimiter();
+  long long now = server->getClock().now().getEpoch();
+  const string &boxKey = limiterKey;
+  if (!limiter.allowed(RateLimiter::BOX, boxKey, now) ||
+      (!passwd.empty() &&
+       !limiter.allowed(RateLimiter::USERNAME, username, now))) {
+    throttled.add();
+    return NO_SESSION;
+  }
   string ret = server->getNickname(username);
-  if (!passwd.empty() && !server->checkUser(username, passwd))
-    return "";
-  sess.username = username;
-  sess.passwd = passwd;
-  sess.lastActive = Env::getNow();
-  return ret;
+  if (!passwd.empty() && !server->checkUser(username, passwd)) {
+    loginFailures.add();
+    limiter.charge(RateLimiter::USERNAME, username, now);
+    limiter.charge(RateLimiter::BOX, boxKey, now);
+    return NO_SESSION;
+  }
+  if (nickname != nullptr) {
+    *nickname = ret;
+  }
+  return sessions.open(username, passwd, now);
 }
 
-Card *Box::addCard(Card *card) {
+void Box::closeSession(SessionToken token) { sessions.close(token); }
+
+string Box::login(const string &username, const string &passwd) {
+  string nickname;
+  SessionToken token = openSession(username, passwd, &nickname);
+  if (token != NO_SESSION) {
+    closeSession(current);
+    current = token;
+  }
+  return nickname;
+}
+
+Card *Box::addCard(Card *card) { return addCard(current, card); }
+
+Card *Box::addCard(SessionToken token, Card *card) {
+  ScopedLatency latency(addCardLatency);
   if (card == nullptr) {
     return card; // Return the card itself if it's null
   }
-  const string &username = getSession().username;
-  if (username.empty())
+  const SessionTable::Session *session =
+      getSession(token, server->getClock().now().getEpoch());
+  if (session == nullptr || session->username.empty())
     return card;
+  const string &username = session->username;
   assert(cards.find(card->getId()) == cards.end() &&
          "Card with the same ID already exists in the box");
   int reward =
@@ -65,16 +116,39 @@ Card *Box::addCard(Card *card) {
     return card; // Card with the same ID already exists, return the card itself
   }
   cards[card->getId()] = card; // Add the card to the box
-  return nullptr;              // Card added successfully
+  cardsInBoxes.add(1);
+  return nullptr; // Card added successfully
 }
 
 Card *Box::retrieveCard(const std::string &cardId, int verificationCode,
                         Card *paymentCard) {
-  const Session &sess = getSession();
-  const string &username = sess.username;
-  const string &passwd = sess.passwd;
+  return retrieveCard(current, cardId, verificationCode, paymentCard);
+}
+
+Card *Box::retrieveCard(SessionToken token, const std::string &cardId,
+                        int verificationCode, Card *paymentCard) {
+  ScopedLatency latency(retrieveCardLatency);
+  long long now = server->getClock().now().getEpoch();
+  const SessionTable::Session *session = getSession(token, now);
+  // An expired session is checked as nobody, and fails like a wrong password;
+  // it is charged to the box, not to a username bucket all of them would share
+  const string &username = session ? session->username : NOBODY;
+  const string &passwd = session ? session->passwd : NOBODY;
+  // Turn away keys that failed too often before asking the server anything
+  RateLimiter &limiter = server->getAttemptLimiter();
+  const string &boxKey = limiterKey;
+  if (!limiter.allowed(RateLimiter::BOX, boxKey, now) ||
+      (session && !limiter.allowed(RateLimiter::USERNAME, username, now)) ||
+      !limiter.allowed(RateLimiter::CARD, cardId, now)) {
+    throttled.add();
+    return nullptr;
+  }
   // Check if the user is authenticated
   if (!server->checkUser(username, passwd)) {
+    if (session) {
+      limiter.charge(RateLimiter::USERNAME, username, now);
+    }
+    limiter.charge(RateLimiter::BOX, boxKey, now);
     return nullptr; // Authentication failed
   }
 
@@ -87,13 +161,19 @@ Card *Box::retrieveCard(const std::string &cardId, int verificationCode,
     }
     // Notify the server that the card is retrieved
     if (!server->notifyCardRetrieved(cardId, verificationCode)) {
+      // Most likely a wrong verification code
+      limiter.charge(RateLimiter::USERNAME, username, now);
+      limiter.charge(RateLimiter::CARD, cardId, now);
+      limiter.charge(RateLimiter::BOX, boxKey, now);
       return nullptr; // Failed to notify the server
     }
     paymentCard->adjustBalance(-reward); // Deduct the reward from payment card
     cards.erase(it);                     // Remove the card from the box
-    return card;                         // Return the card pointer
+    cardsInBoxes.add(-1);
+    return card; // Return the card pointer
   }
 
+  limiter.charge(RateLimiter::BOX, boxKey, now); // Probing for card ids
   return nullptr; // Card not found
 }
 
@@ -102,9 +182,14 @@ Labeled_GPS Box::getGPSLocation() const {
 }
 
 int Box::redeemReward(int amount, Card *card) {
-  const Session &sess = getSession();
-  const string &username = sess.username;
-  const string &passwd = sess.passwd;
+  return redeemReward(current, amount, card);
+}
+
+int Box::redeemReward(SessionToken token, int amount, Card *card) {
+  const SessionTable::Session *session =
+      getSession(token, server->getClock().now().getEpoch());
+  const string &username = session ? session->username : NOBODY;
+  const string &passwd = session ? session->passwd : NOBODY;
   if (card == nullptr) {
     return -1; // No card provided for payment
   }
@@ -120,10 +205,10 @@ int Box::redeemReward(int amount, Card *card) {
 
 Json::Value *Box::dump2JSON() const {
   Json::Value *json = new Json::Value();
-  (*json)["gps"] = *gps.dump2JSON();
+  (*json)["gps"] = adoptJSON(gps.dump2JSON());
   (*json)["cards"] = Json::Value(Json::arrayValue);
   for (const auto &pair : cards) {
-    (*json)["cards"].append(*pair.second->dump2JSON());
+    (*json)["cards"].append(adoptJSON(pair.second->dump2JSON()));
   }
   return json; // Return the JSON representation of the box
 }
@@ -134,17 +219,27 @@ void Box::JSON2Object(const Json::Value *arg_json_ptr) {
 
   JSON2Object_precheck(arg_json_ptr, lv_exception_ptr,
                        EE1520_ERROR_JSON2OBJECT_BOX);
-  if (!hasException(Object, (*arg_json_ptr)["GPS"], lv_exception_ptr,
+  // dump2JSON writes "gps", accept it as well so snapshots can be reloaded
+  const char *gpsKey = arg_json_ptr->isMember("GPS") ? "GPS" : "gps";
+  if (!hasException(Object, (*arg_json_ptr)[gpsKey], lv_exception_ptr,
                     EE1520_ERROR_JSON2OBJECT_BOX, "GPS")) {
-    this->gps.JSON2Object(&(*arg_json_ptr)["GPS"]);
+    this->gps.JSON2Object(&(*arg_json_ptr)[gpsKey]);
+    limiterKey = limiterKeyOf(gps);
   }
   if (!hasException(Array, (*arg_json_ptr)["cards"], lv_exception_ptr,
                     EE1520_ERROR_JSON2OBJECT_BOX, "cards")) {
     for (unsigned int i = 0; i < (*arg_json_ptr)["cards"].size(); i++) {
-      if (!hasException(Object, (*arg_json_ptr)["card"][i], lv_exception_ptr,
+      if (!hasException(Object, (*arg_json_ptr)["cards"][i], lv_exception_ptr,
                         EE1520_ERROR_JSON2OBJECT_BOX, "cards")) {
+        // Store the card directly, addCard would notify the server again
+        // and leak the card when nobody is logged in
         Card *card = new Card(&(*arg_json_ptr)["cards"][i]);
-        this->addCard(card);
+        Card *&slot = cards[card->getId()];
+        if (slot == nullptr) {
+          cardsInBoxes.add(1);
+        }
+        delete slot;
+        slot = card;
       }
     }
   }
@@ -152,3 +247,29 @@ void Box::JSON2Object(const Json::Value *arg_json_ptr) {
     throw(*lv_exception_ptr); // Throw exception if there are errors
   }
 }
+
+void Box::dump2Binary(BinaryWriter &writer) const {
+  writer.beginRecord(BINARY_TAG_BOX);
+  writer.writeGPS(gps);
+  writer.writeVarint(cards.size());
+  for (const auto &pair : cards) {
+    pair.second->dump2Binary(writer);
+  }
+  writer.endRecord();
+}
+
+void Box::Binary2Object(BinaryReader &reader) {
+  BinaryReader payload = reader.expectRecord(BINARY_TAG_BOX);
+  this->gps = payload.readGPS();
+  limiterKey = limiterKeyOf(gps);
+  uint64_t count = payload.readVarint();
+  for (uint64_t i = 0; i < count; i++) {
+    Card *card = new Card(payload);
+    Card *&slot = cards[card->getId()];
+    if (slot == nullptr) {
+      cardsInBoxes.add(1);
+    }
+    delete slot;
+    slot = card;
+  }
+}
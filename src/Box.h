@@ -1,34 +1,46 @@
 #ifndef BOX_H
 #define BOX_H
 
-#include "Core/JvTime.h"
 #include "Core/Labeled_GPS.h"
+#include "SessionTable.h"
 #include <map>
 
+class BinaryReader;
+class BinaryWriter;
 class Card;
 class Server;
 
+/*
+ * A box serves many users at once, each through a session token from
+ * openSession; a session expires after VALID_SEC seconds without use.
+ * login, addCard, retrieveCard and redeemReward without a token act on the
+ * session of the last successful login.
+ */
 class Box : public Core {
+public:
+  using SessionToken = SessionTable::Token;
+  static constexpr SessionToken NO_SESSION = SessionTable::NO_SESSION;
+  static constexpr int VALID_SEC = 60;
+
 private:
 protected:
-  struct Session {
-    JvTime lastActive;
-    string username = "";
-    string passwd = "";
-    void clear();
-  };
   // id --> card mapping
   std::map<std::string, Card *> cards;
   // GPS location of the box
   Labeled_GPS gps;
+  // Key of the box in the attempt limiter, from its location, so a box
+  // reloaded from a snapshot keeps its failures
+  std::string limiterKey;
   Server *server; // Pointer to the server for communication
-  Session sess;
+  SessionTable sessions{VALID_SEC};
+  SessionToken current = NO_SESSION; // Session of the last login
 
   /**
-   * @brief get current session and check session is still valid
-   * @return current session
+   * @brief get a session and extend it if it is still valid
+   * @param now: the current time, in seconds
+   * @return the session, nullptr if the token is unknown or expired
    */
-  const Session &getSession();
+  const SessionTable::Session *getSession(SessionToken token, long long now);
 
 public:
   Box(Server *server, const Labeled_GPS &gpsLocation);
@@ -37,30 +49,50 @@ public:
   virtual ~Box();
 
   /**
-   * @brief login the session
+   * @brief login a new session, alongside the open ones
+   * @param username: username to login
+   * @param passwd: password, not necessary when addCard
+   * @param nickname[out]: nickname of user, optional
+   * @return token of the session, NO_SESSION if the login fails
+   */
+  virtual SessionToken openSession(const string &username,
+                                   const string &passwd = "",
+                                   string *nickname = nullptr);
+  /**
+   * @brief logout a session, does nothing if it is unknown
+   */
+  void closeSession(SessionToken token);
+
+  /**
+   * @brief login the session, replacing the one of the last login
    * @param username: username to login
    * @param passwd: password, not necessary when addCard
    * @return nickname of user
    */
-  virtual string login(const string &username, const string &passwd = "");
+  string login(const string &username, const string &passwd = "");
 
   /**
    * @brief put a card into the box
+   * @param token: session of the finder
    * @param card: pointer to the card to be added
    * @return nullptr if the card add successfully
    *         otherwise, return the card itself
    */
-  virtual Card *addCard(Card *card);
+  virtual Card *addCard(SessionToken token, Card *card);
+  Card *addCard(Card *card);
 
   /**
    * @brief retrieve a card from the box
+   * @param token: session of the owner
    * @param cardId: the id of the card to be retrieved
    * @param verificationCode:
    * @param card: pointer to the card for payment
    * @return: pointer to the card if found, nullptr if not found or error occurs
    */
-  virtual Card *retrieveCard(const std::string &cardId, int verificationCode,
-                             Card *card = nullptr);
+  virtual Card *retrieveCard(SessionToken token, const std::string &cardId,
+                             int verificationCode, Card *card = nullptr);
+  Card *retrieveCard(const std::string &cardId, int verificationCode,
+                     Card *card = nullptr);
 
   /**
    * @brief get the GPS location of the box
@@ -70,14 +102,25 @@ public:
 
   /**
    * @brief redeem a reward for a user
+   * @param token: session of the user
    * @param amount: the amount of reward to redeem, -1 for all available
    * @param card: pointer to the card for receive reward
    * @return the reward balance after redemption, or -1 if the user is invalid
    */
-  virtual int redeemReward(int amount, Card *card);
+  virtual int redeemReward(SessionToken token, int amount, Card *card);
+  int redeemReward(int amount, Card *card);
 
   virtual Json::Value *dump2JSON(void) const override;
   virtual void JSON2Object(const Json::Value *arg_json_ptr) override;
+  /**
+   * @brief write the box and its cards as a binary snapshot record
+   */
+  void dump2Binary(BinaryWriter &writer) const;
+  /**
+   * @brief read the box and its cards from a binary snapshot record
+   * @throw ee1520_Exception if the record is malformed
+   */
+  void Binary2Object(BinaryReader &reader);
 };
 
 #endif // BOX_H
@@ -0,0 +1,168 @@
+#include "BoxRegistry.h"
+#include "Box.h"
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+namespace {
+constexpr double PI = 3.14159265358979323846;
+constexpr double MILES_PER_RADIAN = GPS_Batch::MILES_PER_RADIAN;
+
+void toUnitVector(const GPS_DD &point, double *xyz) {
+  GPS_Batch::unitVector(point.latitude, point.longitude, xyz);
+}
+
+double chord2(const double *a, const double *b) {
+  double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+  return dx * dx + dy * dy + dz * dz;
+}
+
+double chord2ToMiles(double chord2) {
+  return 2 * asin(min(1.0, sqrt(chord2) / 2)) * MILES_PER_RADIAN;
+}
+
+double milesToChord2(double miles) {
+  double angle = miles / MILES_PER_RADIAN;
+  if (angle >= PI) {
+    return 4.0; // Covers the whole sphere
+  }
+  double chord = 2 * sin(angle / 2);
+  return chord * chord;
+}
+} // namespace
+
+void BoxRegistry::addBox(Box *box) {
+  Entry entry;
+  entry.box = box;
+  toUnitVector(box->getGPSLocation(), entry.xyz);
+  entries.push_back(entry);
+  dirty = true;
+}
+
+bool BoxRegistry::removeBox(const Box *box) {
+  auto it = find_if(entries.begin(), entries.end(),
+                    [box](const Entry &entry) { return entry.box == box; });
+  if (it == entries.end()) {
+    return false; // Box not registered
+  }
+  entries.erase(it);
+  dirty = true;
+  return true;
+}
+
+size_t BoxRegistry::size() const { return entries.size(); }
+
+void BoxRegistry::build() {
+  buildRange(0, entries.size(), 0);
+  dirty = false;
+}
+
+void BoxRegistry::buildRange(size_t begin, size_t end, int axis) {
+  if (end - begin <= 1) {
+    return;
+  }
+  size_t mid = (begin + end) / 2;
+  nth_element(entries.begin() + begin, entries.begin() + mid,
+              entries.begin() + end, [axis](const Entry &a, const Entry &b) {
+                return a.xyz[axis] < b.xyz[axis];
+              });
+  buildRange(begin, mid, (axis + 1) % 3);
+  buildRange(mid + 1, end, (axis + 1) % 3);
+}
+
+void BoxRegistry::searchNearest(size_t begin, size_t end, int axis,
+                                const double *xyz, size_t k,
+                                vector<pair<double, Box *>> &heap) {
+  if (begin >= end) {
+    return;
+  }
+  size_t mid = (begin + end) / 2;
+  const Entry &entry = entries[mid];
+  double d2 = chord2(entry.xyz, xyz);
+  if (heap.size() < k) {
+    heap.emplace_back(d2, entry.box);
+    push_heap(heap.begin(), heap.end());
+  } else if (d2 < heap.front().first) {
+    pop_heap(heap.begin(), heap.end());
+    heap.back() = make_pair(d2, entry.box);
+    push_heap(heap.begin(), heap.end());
+  }
+
+  // The chord is never shorter than its projection on the split axis
+  double diff = xyz[axis] - entry.xyz[axis];
+  int next = (axis + 1) % 3;
+  if (diff < 0) {
+    searchNearest(begin, mid, next, xyz, k, heap);
+    if (heap.size() < k || diff * diff < heap.front().first) {
+      searchNearest(mid + 1, end, next, xyz, k, heap);
+    }
+  } else {
+    searchNearest(mid + 1, end, next, xyz, k, heap);
+    if (heap.size() < k || diff * diff < heap.front().first) {
+      searchNearest(begin, mid, next, xyz, k, heap);
+    }
+  }
+}
+
+void BoxRegistry::searchRadius(size_t begin, size_t end, int axis,
+                               const double *xyz, double chord2Limit,
+                               vector<pair<Box *, double>> &out) {
+  if (begin >= end) {
+    return;
+  }
+  size_t mid = (begin + end) / 2;
+  const Entry &entry = entries[mid];
+  double d2 = chord2(entry.xyz, xyz);
+  if (d2 <= chord2Limit) {
+    out.emplace_back(entry.box, d2);
+  }
+  double diff = xyz[axis] - entry.xyz[axis];
+  int next = (axis + 1) % 3;
+  if (diff < 0 || diff * diff <= chord2Limit) {
+    searchRadius(begin, mid, next, xyz, chord2Limit, out);
+  }
+  if (diff >= 0 || diff * diff <= chord2Limit) {
+    searchRadius(mid + 1, end, next, xyz, chord2Limit, out);
+  }
+}
+
+vector<pair<Box *, double>> BoxRegistry::nearest(const GPS_DD &point,
+                                                 size_t k) {
+  if (dirty) {
+    build();
+  }
+  double xyz[3];
+  toUnitVector(point, xyz);
+  vector<pair<double, Box *>> heap; // Max-heap on chord length
+  heap.reserve(k);
+  if (k > 0) {
+    searchNearest(0, entries.size(), 0, xyz, k, heap);
+  }
+  sort_heap(heap.begin(), heap.end());
+
+  vector<pair<Box *, double>> result;
+  result.reserve(heap.size());
+  for (const auto &item : heap) {
+    result.emplace_back(item.second, chord2ToMiles(item.first));
+  }
+  return result;
+}
+
+vector<pair<Box *, double>> BoxRegistry::withinRadius(const GPS_DD &point,
+                                                      double miles) {
+  if (dirty) {
+    build();
+  }
+  double xyz[3];
+  toUnitVector(point, xyz);
+  vector<pair<Box *, double>> result;
+  if (miles >= 0) {
+    searchRadius(0, entries.size(), 0, xyz, milesToChord2(miles), result);
+  }
+  sort(result.begin(), result.end(),
+       [](const auto &a, const auto &b) { return a.second < b.second; });
+  for (auto &item : result) {
+    item.second = chord2ToMiles(item.second);
+  }
+  return result;
+}
@@ -0,0 +1,70 @@
+#ifndef BOX_REGISTRY_H
+#define BOX_REGISTRY_H
+
+#include "Core/GPS.h"
+#include <utility>
+#include <vector>
+
+class Box;
+
+/*
+ * Registry of boxes with a spatial index for nearest-box queries.
+ * Box locations are stored as unit vectors in a k-d tree, the chord length
+ * between two unit vectors grows with their great-circle distance, so the
+ * tree can prune by chord length without any trigonometry.
+ * The tree is rebuilt lazily on the first query after boxes change.
+ * Distances are in miles, the same as GPS_DD::distance.
+ * Not synchronized, guard it externally if boxes are added concurrently.
+ */
+class BoxRegistry {
+private:
+  struct Entry {
+    Box *box;
+    double xyz[3]; // Unit vector of the box location
+  };
+  // k-d tree in implicit layout: the median of [begin, end) is the node, its
+  // children are the medians of the two halves
+  std::vector<Entry> entries;
+  bool dirty = false; // entries changed since the last build
+
+  void build();
+  void buildRange(size_t begin, size_t end, int axis);
+  void searchNearest(size_t begin, size_t end, int axis, const double *xyz,
+                     size_t k, std::vector<std::pair<double, Box *>> &heap);
+  void searchRadius(size_t begin, size_t end, int axis, const double *xyz,
+                    double chord2, std::vector<std::pair<Box *, double>> &out);
+
+public:
+  /**
+   * @brief add a box to the registry
+   * @param box: the box, its location must not change while registered
+   */
+  void addBox(Box *box);
+  /**
+   * @brief remove a box from the registry
+   * @return true if the box was registered
+   */
+  bool removeBox(const Box *box);
+  /**
+   * @brief get the number of registered boxes
+   */
+  size_t size() const;
+
+  /**
+   * @brief find the k nearest boxes to a point
+   * @param point: the GPS location to search from
+   * @param k: the number of boxes to find
+   * @return pairs of box and distance in miles, nearest first
+   */
+  std::vector<std::pair<Box *, double>> nearest(const GPS_DD &point, size_t k);
+  /**
+   * @brief find all boxes within a radius of a point
+   * @param point: the GPS location to search from
+   * @param miles: the radius in miles
+   * @return pairs of box and distance in miles, nearest first
+   */
+  std::vector<std::pair<Box *, double>> withinRadius(const GPS_DD &point,
+                                                     double miles);
+};
+
+#endif // BOX_REGISTRY_H
@@ -1,6 +1,31 @@
 #include "Card.h"
+#include "Core/BinaryIO.h"
+#include "Core/ObjectPool.h"
 #include "Core/ee1520_Common.h"
 
+namespace {
+ObjectPool<Card> &cardPool() {
+  // Never destroyed, cards may still be deleted during static destruction
+  static ObjectPool<Card> *pool = new ObjectPool<Card>();
+  return *pool;
+}
+} // namespace
+
+void *Card::operator new(std::size_t size) {
+  if (size != sizeof(Card)) {
+    return ::operator new(size); // A derived class, bigger than the blocks
+  }
+  return cardPool().allocate();
+}
+
+void Card::operator delete(void *ptr, std::size_t size) {
+  if (size != sizeof(Card)) {
+    ::operator delete(ptr);
+    return;
+  }
+  cardPool().deallocate(ptr);
+}
+
 Card::Card(const std::string &cardId, int balance)
     : id(cardId), balance(balance) {}
 
@@ -24,6 +49,12 @@ Card::Card(const Json::Value *arg_json_ptr) {
   }
 }
 
+Card::Card(BinaryReader &reader) {
+  BinaryReader payload = reader.expectRecord(BINARY_TAG_CARD);
+  id = payload.readString();
+  balance = payload.readSigned();
+}
+
 Card::~Card() {}
 
 std::string Card::getId() const { return id; }
@@ -41,3 +72,10 @@ long long Card::getBalance() const { return balance; }
 void Card::adjustBalance(long long amount) {
   balance += amount; // Adjust the balance by the specified amount
 }
+
+void Card::dump2Binary(BinaryWriter &writer) const {
+  writer.beginRecord(BINARY_TAG_CARD);
+  writer.writeString(id);
+  writer.writeSigned(balance);
+  writer.endRecord();
+}
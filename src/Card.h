@@ -2,8 +2,12 @@
 #define CARD_H
 
 #include "Core/Core.h"
+#include <cstddef>
 #include <string>
 
+class BinaryReader;
+class BinaryWriter;
+
 class Card : public Core {
 private:
   // Unique identifier for the card
@@ -15,7 +19,11 @@ public:
   // 不應該有卡片沒ID，所以禁止使用無參數的建構子
   Card(const std::string &cardId, int balance = 0);
   Card(const Json::Value *arg_json_ptr);
+  Card(BinaryReader &reader);
   virtual ~Card();
+  // Cards are allocated from a pool, deleting them returns them to it
+  static void *operator new(std::size_t size);
+  static void operator delete(void *ptr, std::size_t size);
   /**
    * @brief Get the ID of the card
    * @return The ID of the card
@@ -33,6 +41,10 @@ public:
   void adjustBalance(long long amount);
 
   virtual Json::Value *dump2JSON(void) const override;
+  /**
+   * @brief write the card as a binary snapshot record
+   */
+  void dump2Binary(BinaryWriter &writer) const;
 };
 
 #endif // CARD_H
@@ -0,0 +1,53 @@
+#include "Clock.h"
+#include <cstdio>
+#include <ctime>
+using namespace std;
+
+SimClock::SimClock() : epoch(base.getEpoch()) {}
+
+SimClock::SimClock(const JvTime &time) : base(time), epoch(time.getEpoch()) {}
+
+JvTime SimClock::now() const {
+  JvTime time = base;
+  if (long long current = epoch.load(); current != time.getEpoch()) {
+    time.setEpoch(current);
+  }
+  return time;
+}
+
+void SimClock::set(const JvTime &time) {
+  base = time;
+  epoch = time.getEpoch();
+}
+
+void SimClock::set(const string &time) { set(JvTime(time.c_str())); }
+
+void SimClock::advance(int hours, int minutes, int seconds) {
+  advance(hours * 3600LL + minutes * 60LL + seconds);
+}
+
+void SimClock::advance(long long seconds) { epoch += seconds; }
+
+void SimClock::advance(const string &timespan) {
+  advance(parseTimespan(timespan));
+}
+
+long long SimClock::parseTimespan(const string &timespan) {
+  int hours = 0, minutes = 0, seconds = 0;
+  sscanf(timespan.c_str(), "%d:%d:%d", &hours, &minutes, &seconds);
+  return hours * 3600LL + minutes * 60LL + seconds;
+}
+
+JvTime WallClock::now() const {
+  time_t ticks = time(nullptr);
+  struct tm utc;
+  gmtime_r(&ticks, &utc);
+  JvTime time;
+  time.setStdTM(&utc);
+  return time;
+}
+
+SimClock &defaultClock() {
+  static SimClock clock;
+  return clock;
+}
@@ -0,0 +1,83 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "Core/JvTime.h"
+#include <atomic>
+#include <string>
+
+/*
+ * Source of the current time. Every world has its own clock, so worlds
+ * simulated side by side in one process do not share a time.
+ */
+class Clock {
+public:
+  virtual ~Clock() = default;
+  /**
+   * @brief get the current time
+   */
+  virtual JvTime now() const = 0;
+};
+
+/*
+ * Simulated time, only moving when told to. now and advance are safe to be
+ * called from many threads, set is not.
+ */
+class SimClock : public Clock {
+private:
+  JvTime base;                  // The time last set, keeps its timezone
+  std::atomic<long long> epoch; // Current time as a Unix timestamp
+
+public:
+  SimClock();
+  explicit SimClock(const JvTime &time);
+
+  JvTime now() const override;
+  /**
+   * @brief set the current time
+   * @param time: the new time
+   */
+  void set(const JvTime &time);
+  /**
+   * @brief set the current time from a string
+   * @param time: format: "YYYY-MM-DDTHH:MM:SS+HHMM"
+   */
+  void set(const std::string &time);
+  /**
+   * @brief move the current time forward
+   * @param hours: number of hours to move forward
+   * @param minutes: number of minutes to move forward
+   * @param seconds: number of seconds to move forward
+   */
+  void advance(int hours, int minutes, int seconds);
+  /**
+   * @brief move the current time forward
+   * @param seconds: number of seconds to move forward
+   */
+  void advance(long long seconds);
+  /**
+   * @brief move the current time forward
+   * @param timespan: format: "HH:MM:SS"
+   */
+  void advance(const std::string &timespan);
+  /**
+   * @brief get the length of a timespan
+   * @param timespan: format: "HH:MM:SS"
+   * @return the length in seconds
+   */
+  static long long parseTimespan(const std::string &timespan);
+};
+
+/*
+ * Real time, in UTC.
+ */
+class WallClock : public Clock {
+public:
+  JvTime now() const override;
+};
+
+/**
+ * @brief get the clock used by objects that were not given one
+ */
+SimClock &defaultClock();
+
+#endif // CLOCK_H
@@ -0,0 +1,176 @@
+#include "AsyncLogger.h"
+#include "JvTime.h"
+using namespace std;
+
+namespace {
+const char *levelPrefix(LogLevel level) {
+  switch (level) {
+  case LOG_DEBUG:
+    return "DEBUG: ";
+  case LOG_WARNING:
+    return "WARNING: ";
+  case LOG_ERROR:
+    return "ERROR: ";
+  default:
+    return "";
+  }
+}
+} // namespace
+
+AsyncLogger::AsyncLogger(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  slots.reset(new Slot[size]);
+  mask = size - 1;
+  for (size_t i = 0; i < size; i++) {
+    slots[i].sequence.store(i, memory_order_relaxed);
+  }
+  writer = thread(&AsyncLogger::writeLoop, this);
+}
+
+AsyncLogger::~AsyncLogger() {
+  {
+    lock_guard lock(mutex);
+    stopping = true;
+  }
+  wakeup.notify_one();
+  writer.join();
+}
+
+AsyncLogger &AsyncLogger::global() {
+  static AsyncLogger logger;
+  return logger;
+}
+
+void AsyncLogger::setLevel(LogLevel level) {
+  minLevel.store(level, memory_order_relaxed);
+}
+
+void AsyncLogger::log(LogLevel level, const string &fileName, string content) {
+  if (level < minLevel.load(memory_order_relaxed)) {
+    return;
+  }
+  // Claim a slot, as in Vyukov's bounded MPMC queue
+  size_t pos = enqueuePos.load(memory_order_relaxed);
+  Slot *slot;
+  while (true) {
+    slot = &slots[pos & mask];
+    size_t sequence = slot->sequence.load(memory_order_acquire);
+    if (sequence == pos) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                           memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < pos) {
+      // Full, the writer is busy making room
+      this_thread::yield();
+      pos = enqueuePos.load(memory_order_relaxed);
+    } else {
+      pos = enqueuePos.load(memory_order_relaxed);
+    }
+  }
+  slot->level = level;
+  slot->time = time(nullptr);
+  slot->fileName = fileName;
+  slot->content = std::move(content);
+  slot->sequence.store(pos + 1, memory_order_release);
+  // Pairs with the fence in writeLoop: either the writer sees the line
+  // before it sleeps, or this sees it asleep and wakes it
+  atomic_thread_fence(memory_order_seq_cst);
+  if (idle.load(memory_order_relaxed)) {
+    {
+      lock_guard lock(mutex);
+      wakeupRequested = true;
+    }
+    wakeup.notify_one();
+  }
+}
+
+bool AsyncLogger::ready() const {
+  const Slot &slot = slots[dequeuePos & mask];
+  return slot.sequence.load(memory_order_acquire) == dequeuePos + 1;
+}
+
+size_t AsyncLogger::drain() {
+  unordered_map<string, string> batches; // File name -> lines
+  time_t lastTime = -1;
+  char timeString[JvTime::TIME_STRING_SIZE];
+  size_t count = 0;
+  while (ready()) {
+    Slot &slot = slots[dequeuePos & mask];
+    if (slot.time != lastTime) {
+      JvTime time;
+      time.setEpoch(slot.time);
+      time.format(timeString, sizeof(timeString));
+      lastTime = slot.time;
+    }
+    string &batch = batches[slot.fileName];
+    batch += '[';
+    batch += timeString;
+    batch += "] ";
+    batch += levelPrefix(slot.level);
+    batch += slot.content;
+    batch += '\n';
+    slot.content.clear();
+    slot.sequence.store(dequeuePos + mask + 1, memory_order_release);
+    dequeuePos++;
+    count++;
+  }
+  if (count == 0) {
+    return 0;
+  }
+  for (const auto &batch : batches) {
+    FILE *&file = files[batch.first];
+    if (file == nullptr) {
+      file = fopen(batch.first.c_str(), "a");
+      if (file == nullptr) {
+        files.erase(batch.first);
+        continue; // Lost, as with myPrintLog before
+      }
+    }
+    fwrite(batch.second.data(), 1, batch.second.size(), file);
+    fflush(file);
+  }
+  {
+    lock_guard lock(mutex);
+    writtenPos.store(dequeuePos, memory_order_release);
+  }
+  written.notify_all();
+  return count;
+}
+
+void AsyncLogger::writeLoop() {
+  while (true) {
+    if (drain() > 0) {
+      continue;
+    }
+    unique_lock lock(mutex);
+    if (stopping && dequeuePos == enqueuePos.load(memory_order_acquire)) {
+      break;
+    }
+    idle.store(true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    // A line still being filled wakes the writer when it is published
+    if (!ready()) {
+      wakeup.wait(lock, [this] { return stopping || wakeupRequested; });
+    }
+    idle.store(false, memory_order_relaxed);
+    wakeupRequested = false;
+  }
+  for (const auto &file : files) {
+    fclose(file.second);
+  }
+  files.clear();
+}
+
+void AsyncLogger::flush() {
+  size_t target = enqueuePos.load(memory_order_acquire);
+  unique_lock lock(mutex);
+  wakeupRequested = true;
+  wakeup.notify_one();
+  written.wait(lock, [this, target] {
+    return writtenPos.load(memory_order_acquire) >= target;
+  });
+}
@@ -0,0 +1,106 @@
+#ifndef _ASYNC_LOGGER_H_
+#define _ASYNC_LOGGER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR };
+
+/*
+ * Logger writing lines to files from a background thread.
+ *
+ * log only moves the line into a bounded lock-free ring buffer (many
+ * producers, one consumer); when the buffer is full it waits for room
+ * instead of dropping lines. The writer drains whatever is queued, groups
+ * the lines by file, and writes each group with one fwrite and one fflush.
+ * Once the buffer is empty it sleeps until log or flush wakes it; log only
+ * takes the mutex to do so while the writer is asleep.
+ * Files stay open until the logger is destroyed.
+ *
+ * A line reads "[<UTC time>] <content>", with "WARNING: ", "ERROR: " or
+ * "DEBUG: " before the content for levels other than LOG_INFO.
+ */
+class AsyncLogger {
+public:
+  static constexpr size_t DEFAULT_CAPACITY = 4096; // Lines, a power of two
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence; // Position it can be written/read at
+    LogLevel level;
+    time_t time;
+    std::string fileName;
+    std::string content;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> enqueuePos{0};
+  alignas(64) size_t dequeuePos = 0; // Only used by the writer
+  std::atomic<size_t> writtenPos{0}; // Lines before it are flushed
+  std::atomic<int> minLevel{LOG_DEBUG};
+
+  std::mutex mutex;
+  std::condition_variable wakeup;  // Signals the writer
+  std::condition_variable written; // Signals flush waiters
+  std::atomic<bool> idle{false};   // The writer waits, or is about to
+  bool stopping = false;
+  bool wakeupRequested = false;
+  std::thread writer;
+  std::unordered_map<std::string, FILE *> files; // Only used by the writer
+
+  void writeLoop();
+  /**
+   * @brief check if the next line to write is ready, writer only
+   */
+  bool ready() const;
+  /**
+   * @brief write every line that is ready
+   * @return the number of lines written
+   */
+  size_t drain();
+
+public:
+  /**
+   * @brief start the writer thread
+   * @param capacity: lines the buffer holds, rounded up to a power of two
+   */
+  explicit AsyncLogger(size_t capacity = DEFAULT_CAPACITY);
+  /**
+   * @brief write every queued line, then stop the writer
+   */
+  ~AsyncLogger();
+  AsyncLogger(const AsyncLogger &) = delete;
+  AsyncLogger &operator=(const AsyncLogger &) = delete;
+
+  /**
+   * @brief get the logger behind myPrintLog
+   */
+  static AsyncLogger &global();
+
+  /**
+   * @brief queue a line, stamped with the current time
+   * @param level: lines below the minimum level are dropped
+   * @param fileName: the file to append it to
+   * @param content: the line, without the newline
+   */
+  void log(LogLevel level, const std::string &fileName, std::string content);
+  /**
+   * @brief set the minimum level of the lines kept, LOG_DEBUG by default
+   */
+  void setLevel(LogLevel level);
+  /**
+   * @brief wait until every line queued so far is written and flushed
+   */
+  void flush();
+};
+
+#endif // _ASYNC_LOGGER_H_
@@ -0,0 +1,338 @@
+#include "BinaryIO.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+void throwBinaryFormatError(const string &which) {
+  ee1520_Exception lv_exception{};
+  Exception_Info *ei_ptr = new Exception_Info{};
+  ei_ptr->where_code = EE1520_ERROR_BINARY_FORMAT;
+  ei_ptr->which_string = which;
+  ei_ptr->how_code = EE1520_ERROR_NORMAL;
+  ei_ptr->what_code = EE1520_ERROR_BINARY_FORMAT;
+  lv_exception.info_vector.push_back(ei_ptr);
+  throw lv_exception;
+}
+
+namespace {
+bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+/**
+ * @brief make a rename in the directory of a file durable
+ */
+bool syncDirectory(const string &fileName) {
+  size_t slash = fileName.rfind('/');
+  string dir = slash == string::npos ? "." : fileName.substr(0, slash + 1);
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = ::fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+}
+
+void appendVarint(string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char)value);
+}
+} // namespace
+
+void BinaryWriter::writeVarint(uint64_t value) { appendVarint(body, value); }
+
+void BinaryWriter::writeSigned(int64_t value) {
+  // Zigzag: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+  writeVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void BinaryWriter::writeBool(bool value) { writeVarint(value ? 1 : 0); }
+
+void BinaryWriter::writeDouble(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  for (int i = 0; i < 8; i++) {
+    body.push_back((char)(bits >> (8 * i)));
+  }
+}
+
+void BinaryWriter::writeString(const string &value) {
+  auto it = stringIndex.find(value);
+  if (it == stringIndex.end()) {
+    it = stringIndex.emplace(value, strings.size()).first;
+    strings.push_back(value);
+  }
+  writeVarint(it->second);
+}
+
+void BinaryWriter::writeTime(const JvTime &value) {
+  writeSigned(value.getEpoch());
+  writeString(string(value.tail4, strnlen(value.tail4, 4)));
+}
+
+void BinaryWriter::writeGPS(const Labeled_GPS &value) {
+  writeDouble(value.latitude);
+  writeDouble(value.longitude);
+  writeString(value.label);
+}
+
+void BinaryWriter::beginRecord(BinaryTag tag) {
+  writeVarint(tag);
+  openRecords.push_back(body.size());
+}
+
+void BinaryWriter::endRecord() {
+  size_t start = openRecords.back();
+  openRecords.pop_back();
+  string length;
+  appendVarint(length, body.size() - start);
+  body.insert(start, length);
+}
+
+string BinaryWriter::finish() const {
+  string file = BINARY_SNAPSHOT_MAGIC;
+  appendVarint(file, BINARY_SNAPSHOT_VERSION);
+  appendVarint(file, strings.size());
+  for (const string &value : strings) {
+    appendVarint(file, value.size());
+    file += value;
+  }
+  file += body;
+  return file;
+}
+
+int BinaryWriter::save(const string &fileName) const {
+  return saveFileAtomically(fileName, finish());
+}
+
+int saveFileAtomically(const string &fileName, string_view contents) {
+  // Never truncate the file in place, it may be mapped, e.g. by a lazily
+  // loaded snapshot, or be a hard link to one
+  string tempName = fileName + ".tmp" + to_string(::getpid());
+  int fd = ::open(tempName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    return EE1520_ERROR_FILE_WRITE;
+  }
+  bool ok = writeAll(fd, contents.data(), contents.size()) && ::fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || ::rename(tempName.c_str(), fileName.c_str()) != 0) {
+    ::unlink(tempName.c_str());
+    return EE1520_ERROR_FILE_WRITE;
+  }
+  return syncDirectory(fileName) ? EE1520_ERROR_NORMAL
+                                 : EE1520_ERROR_FILE_WRITE;
+}
+
+BinaryReader::BinaryReader(const char *begin, const char *end,
+                           const vector<string_view> *strings)
+    : cursor(begin), end(end), strings(strings) {}
+
+const char *BinaryReader::readBytes(size_t n) {
+  if ((size_t)(end - cursor) < n) {
+    throwBinaryFormatError("unexpected end of data");
+  }
+  const char *result = cursor;
+  cursor += n;
+  return result;
+}
+
+bool BinaryReader::atEnd() const { return cursor == end; }
+
+const char *BinaryReader::position() const { return cursor; }
+
+uint64_t BinaryReader::readVarint() {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte = *readBytes(1);
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throwBinaryFormatError("varint too long");
+}
+
+int64_t BinaryReader::readSigned() {
+  uint64_t value = readVarint();
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+bool BinaryReader::readBool() { return readVarint() != 0; }
+
+double BinaryReader::readDouble() {
+  const char *bytes = readBytes(8);
+  uint64_t bits = 0;
+  for (int i = 0; i < 8; i++) {
+    bits |= (uint64_t)(uint8_t)bytes[i] << (8 * i);
+  }
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+string_view BinaryReader::readString() {
+  uint64_t index = readVarint();
+  if (strings == nullptr || index >= strings->size()) {
+    throwBinaryFormatError("string index out of range");
+  }
+  return (*strings)[index];
+}
+
+JvTime BinaryReader::readTime() {
+  JvTime value;
+  long long epoch = readSigned();
+  string_view tail = readString();
+  if (tail.size() >= sizeof(value.tail4)) {
+    throwBinaryFormatError("time zone too long");
+  }
+  memcpy(value.tail4, tail.data(), tail.size());
+  value.tail4[tail.size()] = '\0';
+  value.setEpoch(epoch);
+  return value;
+}
+
+Labeled_GPS BinaryReader::readGPS() {
+  double latitude = readDouble();
+  double longitude = readDouble();
+  return Labeled_GPS(latitude, longitude, string(readString()));
+}
+
+uint64_t BinaryReader::readRecord(BinaryReader &payload) {
+  uint64_t tag = readVarint();
+  uint64_t length = readVarint();
+  const char *begin = readBytes(length);
+  payload = BinaryReader(begin, begin + length, strings);
+  return tag;
+}
+
+BinaryReader BinaryReader::expectRecord(BinaryTag tag) {
+  BinaryReader payload;
+  if (readRecord(payload) != tag) {
+    throwBinaryFormatError("expected record tag " + to_string(tag));
+  }
+  return payload;
+}
+
+void BinaryReader::skipRecord() {
+  readVarint();
+  readBytes(readVarint());
+}
+
+BinaryReader BinaryReader::takeRecords(uint64_t count) {
+  const char *begin = cursor;
+  for (uint64_t i = 0; i < count; i++) {
+    skipRecord();
+  }
+  return BinaryReader(begin, cursor, strings);
+}
+
+bool BinarySnapshot::isBinary(string_view bytes) {
+  return bytes.substr(0, strlen(BINARY_SNAPSHOT_MAGIC)) ==
+         BINARY_SNAPSHOT_MAGIC;
+}
+
+BinarySnapshot::~BinarySnapshot() { release(); }
+
+void BinarySnapshot::release() {
+  if (mapping != nullptr) {
+    munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+  }
+  owned.clear();
+  data = nullptr;
+  size = 0;
+  strings.clear();
+  recordsOffset = 0;
+}
+
+int BinarySnapshot::parseHeader() {
+  if (!isBinary(string_view(data, size))) {
+    return EE1520_ERROR_BINARY_FORMAT;
+  }
+  BinaryReader header(data + strlen(BINARY_SNAPSHOT_MAGIC), data + size,
+                      nullptr);
+  try {
+    uint64_t version = header.readVarint();
+    if (version == 0 || version > BINARY_SNAPSHOT_VERSION) {
+      return EE1520_ERROR_BINARY_FORMAT;
+    }
+    uint64_t count = header.readVarint();
+    if (count > size) {
+      return EE1520_ERROR_BINARY_FORMAT; // Every string takes a byte at least
+    }
+    strings.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+      uint64_t length = header.readVarint();
+      strings.emplace_back(header.readBytes(length), length);
+    }
+    recordsOffset = header.position() - data;
+  } catch (ee1520_Exception &) {
+    return EE1520_ERROR_BINARY_FORMAT;
+  }
+  return EE1520_ERROR_NORMAL;
+}
+
+int BinarySnapshot::parse(string bytes) {
+  release();
+  owned = std::move(bytes);
+  data = owned.data();
+  size = owned.size();
+  return parseHeader();
+}
+
+int BinarySnapshot::load(const string &fileName) {
+  ifstream ifs(fileName, ios::binary);
+  if (!ifs.is_open()) {
+    return EE1520_ERROR_FILE_NOT_EXIST;
+  }
+  return parse(string(istreambuf_iterator<char>(ifs), {}));
+}
+
+int BinarySnapshot::map(const string &fileName) {
+  release();
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return EE1520_ERROR_FILE_NOT_EXIST;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return EE1520_ERROR_BINARY_FORMAT;
+  }
+  void *address = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps the file open
+  if (address == MAP_FAILED) {
+    return EE1520_ERROR_FILE_NOT_EXIST;
+  }
+  mapping = address;
+  mappingSize = st.st_size;
+  data = (const char *)address;
+  size = mappingSize;
+  return parseHeader();
+}
+
+BinaryReader BinarySnapshot::records() const {
+  return BinaryReader(data + recordsOffset, data + size, &strings);
+}
@@ -0,0 +1,231 @@
+#ifndef _BINARY_IO_H_
+#define _BINARY_IO_H_
+
+// BinaryIO.h
+//
+// Compact binary snapshot format, an alternative to dump2JSON/JSON2Object
+// for large states.
+//
+//   file   := magic "FMCB" version:varint
+//             stringCount:varint (length:varint bytes)*  -- string table
+//             record*
+//   record := tag:varint length:varint payload
+//
+// Integers are LEB128 varints (signed ones zigzag encoded first), doubles
+// are 8 bytes little-endian, and strings are varint indexes into the string
+// table, so repeated usernames, card ids and addresses are stored once.
+// A payload is a fixed sequence of values and nested records defined by the
+// writer of its tag; readers ignore whatever follows the values they know,
+// so new fields can be appended without breaking old files.
+//
+// A snapshot can be memory-mapped (BinarySnapshot::map), then strings are
+// views into the mapping and nothing is decoded until it is read.
+
+#include "JvTime.h"
+#include "Labeled_GPS.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#define BINARY_SNAPSHOT_MAGIC "FMCB"
+#define BINARY_SNAPSHOT_VERSION 1
+
+// Record tags, never reuse or renumber them
+enum BinaryTag : uint64_t {
+  BINARY_TAG_WORLD = 1,
+  BINARY_TAG_EMAIL_SERVER = 2,
+  BINARY_TAG_EMAIL = 3,
+  BINARY_TAG_SERVER = 4,
+  BINARY_TAG_SERVER_USER = 5,
+  BINARY_TAG_CARD_RECORD = 6,
+  BINARY_TAG_FIND_INFO = 7,
+  BINARY_TAG_REJECT_INFO = 8,
+  BINARY_TAG_USER = 9,
+  BINARY_TAG_CARD = 10,
+  BINARY_TAG_BOX = 11,
+  // Write-ahead log entries of Server mutations, see Server::attachLog
+  BINARY_TAG_LOG_ADD_USER = 12,
+  BINARY_TAG_LOG_REMOVE_USER = 13,
+  BINARY_TAG_LOG_VERIFICATION_TYPE = 14,
+  BINARY_TAG_LOG_ADD_CARD = 15,
+  BINARY_TAG_LOG_REJECT_RETRIEVE = 16,
+  BINARY_TAG_LOG_CARD_FOUND = 17,
+  BINARY_TAG_LOG_CARD_RETRIEVED = 18,
+  BINARY_TAG_LOG_REDEEM_REWARD = 19,
+  BINARY_TAG_LOG_SETUP_2FA = 20,
+  BINARY_TAG_LOG_EXPIRE_FIND = 21,
+  BINARY_TAG_LOG_FORGET_REJECT = 22,
+  BINARY_TAG_LOG_CHECKPOINT = 23,
+};
+
+/**
+ * @brief throw the exception for a malformed snapshot
+ * @param which: what was wrong
+ * @throw ee1520_Exception with EE1520_ERROR_BINARY_FORMAT
+ */
+[[noreturn]] void throwBinaryFormatError(const std::string &which);
+
+/**
+ * @brief replace a file with new contents atomically: they are written to a
+ * temporary file next to it, made durable, then renamed over it, so readers
+ * and mappings of the old file keep seeing the old contents
+ * @param fileName: the file to replace or create
+ * @param contents: the new contents
+ * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_FILE_WRITE on failure
+ */
+int saveFileAtomically(const std::string &fileName, std::string_view contents);
+
+class BinaryWriter {
+private:
+  std::string body; // Records written so far
+  std::vector<std::string> strings;
+  std::unordered_map<std::string, uint64_t> stringIndex;
+  std::vector<size_t> openRecords; // Payload offsets of unfinished records
+
+public:
+  void writeVarint(uint64_t value);
+  void writeSigned(int64_t value);
+  void writeBool(bool value);
+  void writeDouble(double value);
+  /**
+   * @brief write a string as an index into the string table
+   */
+  void writeString(const std::string &value);
+  void writeTime(const JvTime &value);
+  void writeGPS(const Labeled_GPS &value);
+
+  /**
+   * @brief start a record, everything written until the matching endRecord
+   * is its payload
+   */
+  void beginRecord(BinaryTag tag);
+  void endRecord();
+
+  /**
+   * @brief get the whole file: header, string table and records
+   */
+  std::string finish() const;
+  /**
+   * @brief write the whole file atomically, see saveFileAtomically
+   * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_FILE_WRITE on failure
+   */
+  int save(const std::string &fileName) const;
+};
+
+/*
+ * Cursor over a run of values and records. Reading past the end or a
+ * malformed value throws an ee1520_Exception with EE1520_ERROR_BINARY_FORMAT.
+ */
+class BinaryReader {
+private:
+  const char *cursor = nullptr;
+  const char *end = nullptr;
+  const std::vector<std::string_view> *strings = nullptr;
+
+public:
+  BinaryReader() = default;
+  BinaryReader(const char *begin, const char *end,
+               const std::vector<std::string_view> *strings);
+
+  bool atEnd() const;
+  /**
+   * @brief get the current read position
+   */
+  const char *position() const;
+  /**
+   * @brief take n raw bytes
+   * @return pointer to the bytes, valid as long as the underlying data
+   */
+  const char *readBytes(size_t n);
+  uint64_t readVarint();
+  int64_t readSigned();
+  bool readBool();
+  double readDouble();
+  /**
+   * @brief read a string from the string table
+   * @return a view valid as long as the snapshot
+   */
+  std::string_view readString();
+  JvTime readTime();
+  Labeled_GPS readGPS();
+
+  /**
+   * @brief read the next record
+   * @param payload: output, a reader over the payload of the record
+   * @return the tag of the record
+   */
+  uint64_t readRecord(BinaryReader &payload);
+  /**
+   * @brief read the next record, which must have the given tag
+   * @return a reader over the payload of the record
+   */
+  BinaryReader expectRecord(BinaryTag tag);
+  /**
+   * @brief skip the next record without decoding its payload
+   */
+  void skipRecord();
+  /**
+   * @brief skip the next count records without decoding their payloads
+   * @return a reader over the skipped records
+   */
+  BinaryReader takeRecords(uint64_t count);
+};
+
+/*
+ * A loaded snapshot file: the raw bytes, either owned or memory-mapped, and
+ * the string table as views into them.
+ */
+class BinarySnapshot {
+private:
+  std::string owned;       // The bytes when given to parse
+  void *mapping = nullptr; // The bytes when mapped
+  size_t mappingSize = 0;
+  const char *data = nullptr; // Begin of the bytes in use
+  size_t size = 0;
+  std::vector<std::string_view> strings;
+  size_t recordsOffset = 0;
+
+  /**
+   * @brief decode the header of data
+   */
+  int parseHeader();
+  void release();
+
+public:
+  BinarySnapshot() = default;
+  ~BinarySnapshot();
+  BinarySnapshot(const BinarySnapshot &) = delete;
+  BinarySnapshot &operator=(const BinarySnapshot &) = delete;
+
+  /**
+   * @brief check if bytes start like a binary snapshot
+   */
+  static bool isBinary(std::string_view bytes);
+  /**
+   * @brief take the bytes of a snapshot and decode its header
+   * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_BINARY_FORMAT
+   */
+  int parse(std::string bytes);
+  /**
+   * @brief read a snapshot file and decode its header
+   * @return EE1520_ERROR_NORMAL, EE1520_ERROR_FILE_NOT_EXIST, or
+   *         EE1520_ERROR_BINARY_FORMAT
+   */
+  int load(const std::string &fileName);
+  /**
+   * @brief map a snapshot file read-only and decode its header, pages are
+   * only read from disk when the records on them are
+   * @return EE1520_ERROR_NORMAL, EE1520_ERROR_FILE_NOT_EXIST, or
+   *         EE1520_ERROR_BINARY_FORMAT
+   */
+  int map(const std::string &fileName);
+  /**
+   * @brief get a reader over the records of the snapshot, valid while the
+   * snapshot is alive
+   */
+  BinaryReader records() const;
+};
+
+#endif /* _BINARY_IO_H_ */
@@ -2,7 +2,7 @@
 #include "Core.h"
 #include <iostream>
 
-unsigned int Core::core_count{};
+std::atomic<unsigned int> Core::core_count{};
 
 Core::Core(void) {
   core_count++;
@@ -6,13 +6,14 @@
 
 #include "ee1520_Common.h"
 #include "ee1520_Exception.h"
+#include <atomic>
 
 using namespace std;
 
 class Core {
 private:
 public:
-  static unsigned int core_count;
+  static std::atomic<unsigned int> core_count;
 
   std::string host_url;
   std::string class_name;
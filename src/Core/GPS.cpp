@@ -231,3 +231,121 @@ GPS_DD::JSON2Object
 
   return;
 }
+
+// GPS_Batch
+
+void GPS_Batch::unitVector(double latitude, double longitude, double *xyz)
+{
+  double lat = deg2rad(latitude), lon = deg2rad(longitude);
+  xyz[0] = cos(lat) * cos(lon);
+  xyz[1] = cos(lat) * sin(lon);
+  xyz[2] = sin(lat);
+}
+
+void GPS_Batch::reserve(size_t n)
+{
+  latitudes.reserve(n);
+  longitudes.reserve(n);
+  x.reserve(n);
+  y.reserve(n);
+  z.reserve(n);
+}
+
+void GPS_Batch::push_back(double latitude, double longitude)
+{
+  double xyz[3];
+  unitVector(latitude, longitude, xyz);
+  latitudes.push_back(latitude);
+  longitudes.push_back(longitude);
+  x.push_back(xyz[0]);
+  y.push_back(xyz[1]);
+  z.push_back(xyz[2]);
+}
+
+void GPS_Batch::push_back(const GPS_DD &point)
+{
+  push_back(point.latitude, point.longitude);
+}
+
+void GPS_Batch::clear()
+{
+  latitudes.clear();
+  longitudes.clear();
+  x.clear();
+  y.clear();
+  z.clear();
+}
+
+size_t GPS_Batch::size() const { return latitudes.size(); }
+
+double GPS_Batch::getLatitude(size_t index) const { return latitudes[index]; }
+
+double GPS_Batch::getLongitude(size_t index) const
+{
+  return longitudes[index];
+}
+
+namespace {
+// The main loops run a multiple of 4 times, which lets -O2 vectorize them
+// without a runtime trip count check; the remainder is done one by one.
+
+/**
+ * @brief out[i] = dot product of q and point i
+ */
+void dotKernel(const double *__restrict x, const double *__restrict y,
+               const double *__restrict z, const double *q,
+               double *__restrict out, size_t n)
+{
+  double qx = q[0], qy = q[1], qz = q[2];
+  size_t blocked = n & ~(size_t)3;
+  for (size_t i = 0; i < blocked; i++) {
+    out[i] = qx * x[i] + qy * y[i] + qz * z[i];
+  }
+  for (size_t i = blocked; i < n; i++) {
+    out[i] = qx * x[i] + qy * y[i] + qz * z[i];
+  }
+}
+
+/**
+ * @brief out[i] = squared chord length between q and point i
+ */
+void chordKernel(const double *__restrict x, const double *__restrict y,
+                 const double *__restrict z, const double *q,
+                 double *__restrict out, size_t n)
+{
+  double qx = q[0], qy = q[1], qz = q[2];
+  size_t blocked = n & ~(size_t)3;
+  for (size_t i = 0; i < blocked; i++) {
+    double dx = x[i] - qx, dy = y[i] - qy, dz = z[i] - qz;
+    out[i] = dx * dx + dy * dy + dz * dz;
+  }
+  for (size_t i = blocked; i < n; i++) {
+    double dx = x[i] - qx, dy = y[i] - qy, dz = z[i] - qz;
+    out[i] = dx * dx + dy * dy + dz * dz;
+  }
+}
+} // namespace
+
+void GPS_Batch::distance(const GPS_DD &point, vector<double> &out) const
+{
+  double q[3];
+  unitVector(point.latitude, point.longitude, q);
+  out.resize(size());
+  dotKernel(x.data(), y.data(), z.data(), q, out.data(), size());
+  for (double &d : out) {
+    // Rounding can push the cosine just past 1 for (nearly) equal points
+    d = acos(fmin(1.0, fmax(-1.0, d))) * MILES_PER_RADIAN;
+  }
+}
+
+void GPS_Batch::haversine(const GPS_DD &point, vector<double> &out) const
+{
+  double q[3];
+  unitVector(point.latitude, point.longitude, q);
+  out.resize(size());
+  chordKernel(x.data(), y.data(), z.data(), q, out.data(), size());
+  for (double &d : out) {
+    // hav(angle) = chord^2 / 4, so angle = 2 * asin(chord / 2)
+    d = 2 * asin(fmin(1.0, sqrt(d) / 2)) * MILES_PER_RADIAN;
+  }
+}
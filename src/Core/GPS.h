@@ -5,6 +5,7 @@
 // GPS.h
 
 #include "Core.h"
+#include <vector>
 
 using namespace std;
 
@@ -29,4 +30,56 @@ public:
   virtual void JSON2Object(const Json::Value *) override;
 };
 
+/*
+ * Structure-of-arrays of GPS points, for the distances from one query point
+ * to many points at once.
+ * Radians and cos(latitude) are folded into a precomputed unit vector per
+ * point, kept in one contiguous array per axis, so the per-point arithmetic
+ * is a branch-free loop the compiler vectorizes and only one inverse trig
+ * call is left per point. Distances are in miles, the same as
+ * GPS_DD::distance.
+ */
+class GPS_Batch {
+private:
+  vector<double> latitudes;
+  vector<double> longitudes;
+  vector<double> x, y, z; // Unit vectors of the points
+
+public:
+  // Miles per radian of great-circle angle, the scale of GPS_DD::distance
+  static constexpr double MILES_PER_RADIAN =
+      180 / 3.14159265358979323846 * 60 * 1.1515;
+
+  /**
+   * @brief convert a GPS location to a unit vector
+   * @param latitude: latitude in decimal degrees
+   * @param longitude: longitude in decimal degrees
+   * @param xyz: output, the 3 components of the unit vector
+   */
+  static void unitVector(double latitude, double longitude, double *xyz);
+
+  void reserve(size_t n);
+  void push_back(double latitude, double longitude);
+  void push_back(const GPS_DD &point);
+  void clear();
+  size_t size() const;
+  double getLatitude(size_t index) const;
+  double getLongitude(size_t index) const;
+
+  /**
+   * @brief distances from a point to every point, by the spherical law of
+   * cosines like GPS_DD::distance
+   * @param point: the query point
+   * @param out: output, resized to size()
+   */
+  void distance(const GPS_DD &point, vector<double> &out) const;
+  /**
+   * @brief distances from a point to every point, by the haversine formula,
+   * accurate for short distances where the law of cosines loses precision
+   * @param point: the query point
+   * @param out: output, resized to size()
+   */
+  void haversine(const GPS_DD &point, vector<double> &out) const;
+};
+
 #endif /* _GPS_H_ */
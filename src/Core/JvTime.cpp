@@ -22,51 +22,65 @@ JvTime *getNowJvTime(void) {
  * @return: ERROR_NORMAL 正常
  *          ERROR_NULL_CPP_PTR: timer_str 是 NULL or time_str是空時間
  *          ERROR_TIME_STRING_FORMAT: 時間格式不是 YYYY-MM-DDTHH:MM:SS+ZZZZ
+ *                                    或 YYYY-MM-DDTHH:MM:SS+
  *
  */
 int JvTime::Parse(const char *time_str) {
-  const char zero_str[] = "0000-00-00T00:00:00+0000";
-
-  if ((time_str == NULL) || (strlen(time_str) != strlen(zero_str))) {
+  // 'd' stands for a digit, other characters must match exactly
+  const char pattern[] = "dddd-dd-ddTdd:dd:dd+dddd";
+  // format() leaves out the zone, accept that form too so dumped times can
+  // be read back, the zone is taken as "0000" then
+  const size_t shortLength = sizeof(pattern) - 1 - 4;
+  size_t length = sizeof(pattern) - 1;
+
+  if (time_str == NULL) {
     return EE1520_ERROR_NULL_CPP_PTR;
   }
-
-  if (((time_str[0] < '0') || (time_str[0] > '9')) ||
-      ((time_str[1] < '0') || (time_str[1] > '9')) ||
-      ((time_str[2] < '0') || (time_str[2] > '9')) ||
-      ((time_str[3] < '0') || (time_str[3] > '9')) || (time_str[4] != '-') ||
-      ((time_str[5] < '0') || (time_str[5] > '9')) ||
-      ((time_str[6] < '0') || (time_str[6] > '9')) || (time_str[7] != '-') ||
-      ((time_str[8] < '0') || (time_str[8] > '9')) ||
-      ((time_str[9] < '0') || (time_str[9] > '9')) || (time_str[10] != 'T') ||
-      ((time_str[11] < '0') || (time_str[11] > '9')) ||
-      ((time_str[12] < '0') || (time_str[12] > '9')) || (time_str[13] != ':') ||
-      ((time_str[14] < '0') || (time_str[14] > '9')) ||
-      ((time_str[15] < '0') || (time_str[15] > '9')) || (time_str[16] != ':') ||
-      ((time_str[17] < '0') || (time_str[17] > '9')) ||
-      ((time_str[18] < '0') || (time_str[18] > '9')) || (time_str[19] != '+') ||
-      ((time_str[20] < '0') || (time_str[20] > '9')) ||
-      ((time_str[21] < '0') || (time_str[21] > '9')) ||
-      ((time_str[22] < '0') || (time_str[22] > '9')) ||
-      ((time_str[23] < '0') || (time_str[23] > '9'))) {
-    return EE1520_ERROR_TIME_STRING_FORMAT;
+  size_t actualLength = strnlen(time_str, length + 1);
+  if (actualLength == shortLength) {
+    length = shortLength;
+  } else if (actualLength != length) {
+    return EE1520_ERROR_NULL_CPP_PTR;
   }
 
-  sscanf(time_str, "%4d-%2d-%2dT%2d:%2d:%2d+%4s", &(this->year), &(this->month),
-         &(this->day), &(this->hour), &(this->minute), &(this->second),
-         this->tail4);
+  for (size_t i = 0; i < length; i++) {
+    if (pattern[i] == 'd' ? (time_str[i] < '0' || time_str[i] > '9')
+                          : (time_str[i] != pattern[i])) {
+      return EE1520_ERROR_TIME_STRING_FORMAT;
+    }
+  }
 
-  // std::cout << *(this->getTimeString()) << std::endl;
+  auto digits = [time_str](int begin, int count) {
+    int value = 0;
+    for (int i = begin; i < begin + count; i++) {
+      value = value * 10 + (time_str[i] - '0');
+    }
+    return value;
+  };
+  this->year = digits(0, 4);
+  this->month = digits(5, 2);
+  this->day = digits(8, 2);
+  this->hour = digits(11, 2);
+  this->minute = digits(14, 2);
+  this->second = digits(17, 2);
+  if (length == shortLength) {
+    memcpy(this->tail4, "0000", 5);
+  } else {
+    memcpy(this->tail4, time_str + 20, 4);
+    this->tail4[4] = '\0';
+  }
+  this->updateEpoch();
 
   return EE1520_ERROR_NORMAL;
 }
 
 JvTime::JvTime(const char *time_str) {
-  const char zero_str[] = "0000-00-00T00:00:00+0000";
   if (this->Parse(time_str) != EE1520_ERROR_NORMAL) {
-    sscanf(zero_str, "%4d-%2d-%2dT%2d:%2d:%2d+%4s", &(this->year),
-           &(this->month), &(this->day), &(this->hour), &(this->minute),
-           &(this->second), this->tail4);
+    // Fall back to "0000-00-00T00:00:00+0000", set by the member initializers
+    this->year = this->month = this->day = 0;
+    this->hour = this->minute = this->second = 0;
+    snprintf(this->tail4, sizeof(this->tail4), "0000");
+    this->updateEpoch();
   }
   return;
 }
@@ -98,92 +112,137 @@ int JvTime::setStdTM(struct std::tm *arg_tm_ptr) {
 
   bzero(this->tail4, 16);
   snprintf(this->tail4, strlen("0000") + 1, "0000");
+  this->updateEpoch();
 
   return 0;
 }
 
-std::string *JvTime::getTimeString(void) const {
-  struct std::tm *tm_ptr = this->getStdTM();
+namespace {
+/**
+ * @brief write a decimal number padded with zeros to at least width digits
+ * @return the end of the written number
+ */
+char *writeNumber(char *out, long long value, int width) {
+  if (value < 0) {
+    *out++ = '-';
+    value = -value;
+  }
+  char digits[20];
+  int count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (count < width) {
+    digits[count++] = '0';
+  }
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+} // namespace
 
-  char buffer[128];
-  bzero(buffer, 128);
-  char buffer_dst[128];
-  bzero(buffer_dst, 128);
-  std::strftime(buffer, 32, "%Y-%m-%dT%H:%M:%S+", tm_ptr);
-  snprintf(buffer_dst, strlen(buffer) + strlen(this->tail4) + 1, "%s%s", buffer,
-           this->tail4);
-  return (new std::string(buffer));
+int JvTime::format(char *buffer, size_t size) const {
+  if (buffer == NULL || size < TIME_STRING_SIZE) {
+    return -1;
+  }
+  // Same as strftime "%Y-%m-%dT%H:%M:%S+", the year is not padded and
+  // tail4 is not printed
+  char *out = writeNumber(buffer, this->year, 1);
+  *out++ = '-';
+  out = writeNumber(out, this->month, 2);
+  *out++ = '-';
+  out = writeNumber(out, this->day, 2);
+  *out++ = 'T';
+  out = writeNumber(out, this->hour, 2);
+  *out++ = ':';
+  out = writeNumber(out, this->minute, 2);
+  *out++ = ':';
+  out = writeNumber(out, this->second, 2);
+  *out++ = '+';
+  *out = '\0';
+  return out - buffer;
 }
 
-bool JvTime::operator==(JvTime &arg_jvt) {
-  return ((this->year == arg_jvt.year) && (this->month == arg_jvt.month) &&
-          (this->day == arg_jvt.day) && (this->hour == arg_jvt.hour) &&
-          (this->minute == arg_jvt.minute) && (this->second == arg_jvt.second));
+std::string JvTime::toString(void) const {
+  char buffer[TIME_STRING_SIZE];
+  int length = this->format(buffer, sizeof(buffer));
+  return std::string(buffer, length);
 }
 
-bool JvTime::operator<(JvTime &arg_jvt) {
-  if (this->year <= arg_jvt.year) {
-    if (this->year < arg_jvt.year) {
-      return true;
-    } else {
-      if (this->month <= arg_jvt.month) {
-        if (this->month < arg_jvt.month) {
-          return true;
-        } else {
-          if (this->day <= arg_jvt.day) {
-            if (this->day < arg_jvt.day) {
-              return true;
-            } else {
-              if (this->hour <= arg_jvt.hour) {
-                if (this->hour < arg_jvt.hour) {
-                  return true;
-                } else {
-                  if (this->minute <= arg_jvt.minute) {
-                    if (this->minute < arg_jvt.minute) {
-                      return true;
-                    } else {
-                      if (this->second <= arg_jvt.second) {
-                        if (this->second < arg_jvt.second) {
-                          return true;
-                        } else {
-                          return false;
-                        }
-                      }
-                    }
-                  }
-                }
-              }
-            }
-          }
-        }
-      }
-    }
-  }
+std::string *JvTime::getTimeString(void) const {
+  return new std::string(this->toString());
+}
 
-  return false;
+namespace {
+/**
+ * @brief count days from 1970-01-01 to a date of the proleptic Gregorian
+ * calendar, see http://howardhinnant.github.io/date_algorithms.html
+ */
+long long daysFromCivil(long long y, long long m, long long d) {
+  y -= m <= 2;
+  const long long era = (y >= 0 ? y : y - 399) / 400;
+  const long long yoe = y - era * 400;                         // [0, 399]
+  const long long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy; // [0, 146096]
+  return era * 146097 + doe - 719468;
 }
 
-double JvTime::operator-(JvTime &arg_jvt) {
-  // arg_jvt should be older timestamp
+/**
+ * @brief inverse of daysFromCivil
+ */
+void civilFromDays(long long z, int &y, int &m, int &d) {
+  z += 719468;
+  const long long era = (z >= 0 ? z : z - 146096) / 146097;
+  const long long doe = z - era * 146097;
+  const long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const long long mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = yoe + era * 400 + (m <= 2);
+}
+} // namespace
 
-  struct tm *end_tm_ptr = this->getStdTM();
-  if (end_tm_ptr == NULL)
-    return 0.0;
-  struct tm *begin_tm_ptr = arg_jvt.getStdTM();
-  if (begin_tm_ptr == NULL)
-    return 0.0;
+void JvTime::updateEpoch(void) {
+  this->epoch = daysFromCivil(this->year, this->month, this->day) * 86400 +
+                this->hour * 3600 + this->minute * 60 + this->second;
+}
 
-  // end, beginning
-  double result_diff = difftime(mktime(end_tm_ptr), mktime(begin_tm_ptr));
-  free(end_tm_ptr);
-  free(begin_tm_ptr);
+long long JvTime::getEpoch(void) const { return this->epoch; }
 
-  return result_diff;
+void JvTime::setEpoch(long long arg_epoch) {
+  long long days = arg_epoch / 86400, seconds = arg_epoch % 86400;
+  if (seconds < 0) {
+    days--;
+    seconds += 86400;
+  }
+  civilFromDays(days, this->year, this->month, this->day);
+  this->hour = seconds / 3600;
+  this->minute = seconds / 60 % 60;
+  this->second = seconds % 60;
+  this->epoch = arg_epoch;
+}
+
+bool JvTime::operator==(const JvTime &arg_jvt) const {
+  return this->epoch == arg_jvt.epoch;
+}
+
+bool JvTime::operator<(const JvTime &arg_jvt) const {
+  return this->epoch < arg_jvt.epoch;
+}
+
+double JvTime::operator-(const JvTime &arg_jvt) const {
+  // arg_jvt should be older timestamp
+  return (double)(this->epoch - arg_jvt.epoch);
 }
 
 Json::Value *JvTime::dump2JSON(void) const {
   Json::Value *result_ptr = new Json::Value();
-  (*result_ptr)["time"] = (*(this->getTimeString()));
+  char buffer[TIME_STRING_SIZE];
+  this->format(buffer, sizeof(buffer));
+  (*result_ptr)["time"] = buffer;
   return result_ptr;
 }
 
@@ -10,16 +10,30 @@ using namespace std;
 class JvTime
 {
  private:
+  // Seconds since 1970-01-01T00:00:00 of the date and time fields read as
+  // UTC, tail4 not applied: format() leaves the zone out, so times must
+  // compare the same once printed and read back. Cached so that comparison
+  // and subtraction are integer operations.
+  long long epoch = 0;
+
+  /**
+   * @brief recompute epoch from the date/time fields and tail4
+   */
+  void updateEpoch(void);
+
  protected:
  public:
   bool good;
-  int year;
-  int month;
-  int day;
-  int hour;
-  int minute;
-  int second;
-  char tail4[64];
+  int year = 0;
+  int month = 0;
+  int day = 0;
+  int hour = 0;
+  int minute = 0;
+  int second = 0;
+  char tail4[64] = "0000"; // Timezone offset HHMM, kept but not applied
+
+  // Buffer size that fits the output of format() for any field values
+  static constexpr size_t TIME_STRING_SIZE = 80;
 
   JvTime(const char *);
   JvTime() { }
@@ -27,10 +41,32 @@ class JvTime
   struct std::tm * getStdTM(void) const;
   int setStdTM(struct std::tm *);
   std::string * getTimeString(void) const;
+  /**
+   * @brief write the time string into a buffer, without allocating
+   * @param buffer: the output buffer, NUL terminated
+   * @param size: the size of buffer, at least TIME_STRING_SIZE
+   * @return the length of the time string, -1 if size is too small
+   */
+  int format(char *buffer, size_t size) const;
+  /**
+   * @brief get the time string, same as getTimeString() but by value
+   */
+  std::string toString(void) const;
+
+  /**
+   * @brief get the time as a Unix timestamp, of the fields taken as UTC
+   * @return seconds since 1970-01-01T00:00:00
+   */
+  long long getEpoch(void) const;
+  /**
+   * @brief set the time from a Unix timestamp, keeping tail4
+   * @param arg_epoch: seconds since 1970-01-01T00:00:00
+   */
+  void setEpoch(long long arg_epoch);
 
-  bool operator==(JvTime& arg_jvt);
-  bool operator< (JvTime& arg_jvt);
-  double operator-(JvTime& arg_jvt);
+  bool operator==(const JvTime& arg_jvt) const;
+  bool operator< (const JvTime& arg_jvt) const;
+  double operator-(const JvTime& arg_jvt) const;
   
   virtual Json::Value * dump2JSON(void) const;
   virtual void JSON2Object(const Json::Value *);
@@ -85,22 +85,18 @@ Labeled_GPS::JSON2Object
       JSON2Object_appendEI(e, lv_exception_ptr, 0);
     }
   
-  if (((*arg_json_ptr)["label"].isNull() == true) ||
-      ((*arg_json_ptr)["label"].isString() == false))
+  if ((*arg_json_ptr)["label"].isNull() == true)
+    {
+      // dump2JSON leaves out the "default" label
+      this->label = "default";
+    }
+  else if ((*arg_json_ptr)["label"].isString() == false)
     {
       ei_ptr = new Exception_Info {};
       ei_ptr->where_code = EE1520_ERROR_JSON2OBJECT_LABELED_GPS;
       ei_ptr->which_string = "label";
       ei_ptr->how_code = EE1520_ERROR_NORMAL;
-
-      if ((*arg_json_ptr)["label"].isNull() == true)
-	{
-	  ei_ptr->what_code = EE1520_ERROR_JSON_KEY_MISSING;
-	}
-      else
-	{
-	  ei_ptr->what_code = EE1520_ERROR_JSON_KEY_TYPE_MISMATCHED;
-	}
+      ei_ptr->what_code = EE1520_ERROR_JSON_KEY_TYPE_MISMATCHED;
       (lv_exception_ptr->info_vector).push_back(ei_ptr);
     }
   else
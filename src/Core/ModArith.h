@@ -0,0 +1,106 @@
+#ifndef _MOD_ARITH_H_
+#define _MOD_ARITH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Modular arithmetic with a modulus fixed at compile time, using Montgomery
+ * reduction: numbers are kept as x * 2^32 mod MOD, so a product is reduced
+ * with two 32x32-bit multiplies and a shift instead of a 64-bit division.
+ *
+ * pow matches Utils::pow(base, exp, MOD) for base >= 0 and exp >= 0.
+ * powBatch raises many bases to the same exponent; it runs LANES
+ * exponentiations side by side with no branches on the data, so they
+ * overlap in the pipeline and the compiler can vectorize the lanes.
+ */
+template <uint32_t MOD> class ModArith {
+  static_assert(MOD % 2 == 1, "Montgomery reduction needs an odd modulus");
+  static_assert(MOD < (1u << 30), "2 * MOD squared must stay below MOD * 2^32");
+
+public:
+  static constexpr size_t LANES = 8;
+
+private:
+  // -MOD^-1 mod 2^32, by Newton's iteration (each step doubles the bits)
+  static constexpr uint32_t negInverse() {
+    uint32_t inverse = MOD;
+    for (int i = 0; i < 4; i++) {
+      inverse *= 2 - MOD * inverse;
+    }
+    return -inverse;
+  }
+  static constexpr uint32_t NEG_INVERSE = negInverse();
+  static constexpr uint32_t ONE = (uint32_t)(((uint64_t)1 << 32) % MOD);
+  static constexpr uint32_t R2 = (uint32_t)((uint64_t)ONE * ONE % MOD);
+
+  /**
+   * @brief x * 2^-32 mod MOD, for x < MOD * 2^32
+   * @return the result, plus MOD or not
+   */
+  static uint32_t reduceLazy(uint64_t x) {
+    uint32_t m = (uint32_t)x * NEG_INVERSE;
+    return (x + (uint64_t)m * MOD) >> 32;
+  }
+  static uint32_t reduce(uint64_t x) {
+    uint32_t result = reduceLazy(x);
+    return result >= MOD ? result - MOD : result;
+  }
+  // Operands and result are below 2 * MOD, their product below MOD * 2^32
+  static uint32_t multiply(uint32_t a, uint32_t b) {
+    return reduceLazy((uint64_t)a * b);
+  }
+  static uint32_t toMontgomery(uint64_t x) {
+    return multiply(x % MOD, R2);
+  }
+
+public:
+  /**
+   * @brief calculate base^exp mod MOD
+   */
+  static long long pow(long long base, long long exp) {
+    uint32_t power = toMontgomery(base);
+    uint32_t result = ONE;
+    for (; exp; exp >>= 1, power = multiply(power, power)) {
+      if (exp & 1) {
+        result = multiply(result, power);
+      }
+    }
+    return reduce(result);
+  }
+
+  /**
+   * @brief calculate bases[i]^exp mod MOD for count bases
+   * @param results[out]: count results, may be bases
+   */
+  static void powBatch(const long long *bases, size_t count, long long exp,
+                       long long *results) {
+    size_t i = 0;
+    for (; i + LANES <= count; i += LANES) {
+      uint32_t power[LANES], result[LANES];
+      for (size_t lane = 0; lane < LANES; lane++) {
+        power[lane] = toMontgomery(bases[i + lane]);
+        result[lane] = ONE;
+      }
+      // The same exponent bit for every lane, so only the data differs
+      for (long long e = exp; e; e >>= 1) {
+        if (e & 1) {
+          for (size_t lane = 0; lane < LANES; lane++) {
+            result[lane] = multiply(result[lane], power[lane]);
+          }
+        }
+        for (size_t lane = 0; lane < LANES; lane++) {
+          power[lane] = multiply(power[lane], power[lane]);
+        }
+      }
+      for (size_t lane = 0; lane < LANES; lane++) {
+        results[i + lane] = reduce(result[lane]);
+      }
+    }
+    for (; i < count; i++) {
+      results[i] = pow(bases[i], exp);
+    }
+  }
+};
+
+#endif // _MOD_ARITH_H_
@@ -0,0 +1,86 @@
+#ifndef _OBJECT_POOL_H_
+#define _OBJECT_POOL_H_
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/*
+ * Pool of fixed-size blocks for objects of type T, meant to back a class
+ * operator new/delete. Blocks are carved from chunks of BLOCKS_PER_CHUNK
+ * blocks and recycled through a free list, so steady-state allocation does
+ * not reach malloc; chunks are only freed when the pool is destroyed.
+ * Safe to be called from many threads.
+ */
+template <typename T, size_t BLOCKS_PER_CHUNK = 256> class ObjectPool {
+private:
+  union Block {
+    Block *next; // Next free block, valid while the block is free
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  mutable std::mutex mutex;
+  Block *freeList = nullptr;
+  std::vector<Block *> chunks;
+  size_t liveCount = 0;
+
+public:
+  ObjectPool() = default;
+  ~ObjectPool() {
+    for (Block *chunk : chunks) {
+      ::operator delete(chunk);
+    }
+  }
+  ObjectPool(const ObjectPool &) = delete;
+  ObjectPool &operator=(const ObjectPool &) = delete;
+
+  /**
+   * @brief get uninitialized storage for one T
+   */
+  void *allocate() {
+    std::lock_guard lock(mutex);
+    if (freeList == nullptr) {
+      Block *chunk = static_cast<Block *>(
+          ::operator new(sizeof(Block) * BLOCKS_PER_CHUNK));
+      chunks.push_back(chunk);
+      for (size_t i = BLOCKS_PER_CHUNK; i > 0; i--) {
+        chunk[i - 1].next = freeList;
+        freeList = &chunk[i - 1];
+      }
+    }
+    Block *block = freeList;
+    freeList = block->next;
+    liveCount++;
+    return block;
+  }
+  /**
+   * @brief give back storage from allocate(), the object must be destroyed
+   */
+  void deallocate(void *ptr) {
+    if (ptr == nullptr) {
+      return;
+    }
+    std::lock_guard lock(mutex);
+    Block *block = static_cast<Block *>(ptr);
+    block->next = freeList;
+    freeList = block;
+    liveCount--;
+  }
+  /**
+   * @brief get the number of blocks in use
+   */
+  size_t size() const {
+    std::lock_guard lock(mutex);
+    return liveCount;
+  }
+  /**
+   * @brief get the number of blocks allocated from the system
+   */
+  size_t capacity() const {
+    std::lock_guard lock(mutex);
+    return chunks.size() * BLOCKS_PER_CHUNK;
+  }
+};
+
+#endif /* _OBJECT_POOL_H_ */
@@ -0,0 +1,121 @@
+#include "TotpEngine.h"
+#include "ModArith.h"
+#include <algorithm>
+using namespace std;
+
+using TotpArith = ModArith<TotpEngine::MOD>;
+
+TotpEngine::TotpEngine(size_t cacheSize) {
+  size_t size = 1;
+  while (size < cacheSize) {
+    size <<= 1;
+  }
+  cache.resize(size);
+}
+
+TotpEngine &TotpEngine::local() {
+  thread_local TotpEngine engine;
+  return engine;
+}
+
+TotpEngine::Entry &TotpEngine::slot(long long secret) {
+  // Fibonacci hashing, secrets are small random numbers
+  size_t index = (((unsigned long long)secret * 0x9E3779B97F4A7C15ull) >> 32) &
+                 (cache.size() - 1);
+  return cache[index];
+}
+
+void TotpEngine::install(Entry &entry, long long secret, long long step,
+                         long long power) {
+  entry.secret = secret;
+  entry.base = secret % MOD;
+  entry.inverse = 0;
+  entry.step = step;
+  entry.power = power;
+}
+
+TotpEngine::Entry &TotpEngine::seek(long long secret, long long step) {
+  Entry &entry = slot(secret);
+  if (entry.secret != secret) {
+    install(entry, secret, step, TotpArith::pow(secret, step));
+    return entry;
+  }
+  long long distance = step - entry.step;
+  if (distance == 0) {
+    return entry;
+  }
+  if (entry.base == 0 || distance > MAX_WALK || distance < -MAX_WALK) {
+    entry.power = TotpArith::pow(entry.base, step); // No inverse, or far
+  } else if (distance > 0) {
+    for (long long i = 0; i < distance; i++) {
+      entry.power = entry.power * entry.base % MOD;
+    }
+  } else {
+    if (entry.inverse == 0) {
+      entry.inverse = TotpArith::pow(entry.base, MOD - 2); // MOD is prime
+    }
+    for (long long i = 0; i < -distance; i++) {
+      entry.power = entry.power * entry.inverse % MOD;
+    }
+  }
+  entry.step = step;
+  return entry;
+}
+
+int TotpEngine::code(long long secret, long long timestamp) {
+  return seek(secret, timestamp / TIME_STEP).power % CODE_MODULUS;
+}
+
+bool TotpEngine::verify(long long secret, long long timestamp, int code,
+                        int window, int *offset) {
+  long long step = timestamp / TIME_STEP;
+  long long first = max(step - window, 0LL);
+  Entry &entry = seek(secret, first);
+  long long power = entry.power;
+  long long matched = -1;
+  for (long long s = first; s <= step + window; s++) {
+    if (s > first) {
+      power = power * entry.base % MOD;
+    }
+    if (s == step) {
+      // Keep the current step cached, the next call is likely close to it
+      entry.step = step;
+      entry.power = power;
+    }
+    // The current step wins over the others with the same code
+    if (power % CODE_MODULUS == code && (matched == -1 || s == step)) {
+      matched = s;
+    }
+  }
+  if (matched == -1) {
+    return false;
+  }
+  if (offset != nullptr) {
+    *offset = (int)(matched - step);
+  }
+  return true;
+}
+
+void TotpEngine::verifyBatch(const Request *requests, size_t count,
+                             long long timestamp, int window, bool *results) {
+  long long first = max(timestamp / TIME_STEP - window, 0LL);
+  for (size_t begin = 0; begin < count; begin += BATCH_SIZE) {
+    size_t end = min(count, begin + BATCH_SIZE);
+    // Secrets missing from the cache share the exponent, raise them together
+    long long missing[BATCH_SIZE], powers[BATCH_SIZE];
+    size_t missingCount = 0;
+    for (size_t i = begin; i < end; i++) {
+      if (slot(requests[i].secret).secret != requests[i].secret) {
+        missing[missingCount++] = requests[i].secret;
+      }
+    }
+    TotpArith::powBatch(missing, missingCount, first, powers);
+    for (size_t i = 0; i < missingCount; i++) {
+      install(slot(missing[i]), missing[i], first, powers[i]);
+    }
+    for (size_t i = begin; i < end; i++) {
+      results[i] =
+          verify(requests[i].secret, timestamp, requests[i].code, window);
+    }
+  }
+}
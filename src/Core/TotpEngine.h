@@ -0,0 +1,93 @@
+#ifndef TOTP_ENGINE_H
+#define TOTP_ENGINE_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Time-based verification codes, the same as
+ * Utils::generateVerificationCode: code = secret^(timestamp / 30) mod
+ * 998244353, mod 10^6.
+ *
+ * Each engine keeps a direct-mapped cache of secrets with the power of the
+ * last step used and the modular inverse of the secret, so moving to an
+ * adjacent step, forward or backward, costs one modular multiply instead of
+ * a whole exponentiation. An engine is not synchronized, local() gives each
+ * thread its own.
+ */
+class TotpEngine {
+public:
+  static constexpr long long MOD = 998244353;
+  static constexpr int TIME_STEP = 30; // Seconds per step
+  static constexpr int CODE_MODULUS = 1000000;
+  // Farthest a cached power is walked step by step, a full exponentiation
+  // takes about as many multiplies
+  static constexpr long long MAX_WALK = 32;
+  // Requests verifyBatch computes the missing powers of at a time
+  static constexpr size_t BATCH_SIZE = 64;
+
+  struct Request {
+    long long secret;
+    int code;
+  };
+
+private:
+  struct Entry {
+    long long secret = -1; // -1 if empty
+    long long base;        // secret mod MOD
+    long long inverse;     // Inverse of base, 0 until needed
+    long long step;
+    long long power; // base^step mod MOD
+  };
+  std::vector<Entry> cache;
+
+  /**
+   * @brief get the cache entry a secret maps to, it may hold another secret
+   */
+  Entry &slot(long long secret);
+  /**
+   * @brief make an entry hold a secret with its power at a step
+   */
+  void install(Entry &entry, long long secret, long long step,
+               long long power);
+  /**
+   * @brief get the cache entry of a secret at a step
+   * @return the entry, its power is the one of step
+   */
+  Entry &seek(long long secret, long long step);
+
+public:
+  /**
+   * @param cacheSize: number of secrets cached, rounded up to a power of two
+   */
+  explicit TotpEngine(size_t cacheSize = 1024);
+  /**
+   * @brief get the engine of the calling thread
+   */
+  static TotpEngine &local();
+
+  /**
+   * @brief get the code of a secret at a time
+   * @param timestamp: Unix time in seconds
+   */
+  int code(long long secret, long long timestamp);
+  /**
+   * @brief check a code against the steps around a time in one pass
+   * @param window: steps accepted before and after the current one
+   * @param offset[out]: the step of the match relative to the current one,
+   *                     optional
+   * @return true if the code matches one of the 2 * window + 1 steps
+   */
+  bool verify(long long secret, long long timestamp, int code, int window = 0,
+              int *offset = nullptr);
+  /**
+   * @brief check the codes of many users at the same time
+   * @param requests: the secrets and the codes to check
+   * @param count: number of requests
+   * @param results[out]: count results, true where the code matches
+   */
+  void verifyBatch(const Request *requests, size_t count, long long timestamp,
+                   int window, bool *results);
+};
+
+#endif // TOTP_ENGINE_H
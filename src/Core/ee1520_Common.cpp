@@ -3,6 +3,7 @@
 // #define _EE1520_DEBUG_
 
 #include "ee1520_Common.h"
+#include "AsyncLogger.h"
 #include "JvTime.h"
 #include "ee1520_Exception.h"
 #include <cassert>
@@ -82,21 +83,8 @@ void JSON2Object_appendEI(ee1520_Exception &arg_e,
 void myPrintLog(std::string content, std::string fname) {
   if (fname.size() == 0)
     return;
-
-  FILE *log_f = fopen(fname.c_str(), "a");
-  if (log_f == NULL)
-    return;
-
-  JvTime *jv_ptr = getNowJvTime();
-  std::string *str_ptr = jv_ptr->getTimeString();
-  fprintf(log_f, "[%s] %s\n", str_ptr->c_str(), content.c_str());
-
-  delete str_ptr;
-  delete jv_ptr;
-
-  fflush(log_f);
-  fclose(log_f);
-  return;
+  // Queued, the file is written by the background thread of the logger
+  AsyncLogger::global().log(LOG_INFO, fname, std::move(content));
 }
 
 /*
@@ -165,6 +153,20 @@ char *myFile2String(const char *f_name) {
   return result_ptr;
 }
 
+/*
+ * 取得dump2JSON回傳的JSON物件並釋放指標，不做深層複製
+ * @param jv_ptr: heap上的JSON物件指標，會被delete，可為NULL
+ * @return result: JSON物件
+ */
+Json::Value adoptJSON(Json::Value *jv_ptr) {
+  Json::Value result;
+  if (jv_ptr != NULL) {
+    result.swap(*jv_ptr);
+    delete jv_ptr;
+  }
+  return result;
+}
+
 /*
  * 將檔案內容讀取成JSON物件
  * @param f_name: 檔案名稱
@@ -277,6 +279,8 @@ const char *ee1520error[] = {
     "JSON2Object class User",
     "JSON2Object class Server",
     "JSON User not found",
+    "Binary snapshot format",
+    "JSON2Object class EmailServer",
     "Invalid Error Code (EE1520_ERROR_MAX)",
 };
 
@@ -366,13 +370,35 @@ Json::Value *JSON_Diff::dump2JSON(void) {
   return result_ptr;
 }
 
-vector<JSON_Diff *> *JSON_Difference(Json::Value arg_first,
-                                     Json::Value arg_second,
+/*
+ * 比較兩個JSON物件，列出差異
+ * @param arg_first: 舊的JSON
+ * @param arg_second: 新的JSON
+ * @param arg_prefix: 目前的key path
+ * @return: 差異列表，Value差異會有order 1(舊值)與order 2(新值)兩筆，
+ *          Key差異的order 1表示只在舊的出現，order 2表示只在新的出現。
+ *          長度相同的陣列會逐項比較，index以字串放進key path
+ */
+vector<JSON_Diff *> *JSON_Difference(const Json::Value &arg_first,
+                                     const Json::Value &arg_second,
                                      vector<std::string> arg_prefix) {
   int i;
   vector<JSON_Diff *> *result_ptr = new vector<JSON_Diff *>();
 
-  if ((arg_first.isNull() == true) || (arg_second.isNull() == true)) {
+  if ((arg_first.isNull() == true) && (arg_second.isNull() == true)) {
+    return result_ptr;
+  }
+
+  if ((arg_first.isArray() == true) && (arg_second.isArray() == true) &&
+      (arg_first.size() == arg_second.size())) {
+    for (Json::ArrayIndex index = 0; index < arg_first.size(); index++) {
+      vector<std::string> prefix_copy = arg_prefix;
+      prefix_copy.push_back(std::to_string(index));
+      vector<JSON_Diff *> *sub_ptr =
+          JSON_Difference(arg_first[index], arg_second[index], prefix_copy);
+      result_ptr->insert(result_ptr->end(), sub_ptr->begin(), sub_ptr->end());
+      delete sub_ptr;
+    }
     return result_ptr;
   }
 
@@ -404,11 +430,9 @@ vector<JSON_Diff *> *JSON_Difference(Json::Value arg_first,
   }
 
   vector<std::string> lv_first_members;
-  std::cout << arg_first << std::endl;
   lv_first_members = arg_first.getMemberNames();
 
   vector<std::string> lv_second_members;
-  std::cout << arg_second << std::endl;
   lv_second_members = arg_second.getMemberNames();
 
   int k1, k2;
@@ -482,7 +506,7 @@ vector<JSON_Diff *> *JSON_Difference(Json::Value arg_first,
 
     (lv_JD_ptr->key_path).push_back(lv_second_members[k2]);
     lv_JD_ptr->order = 2;
-    lv_JD_ptr->diff = arg_first[lv_second_members[k2]];
+    lv_JD_ptr->diff = arg_second[lv_second_members[k2]];
     k2++;
     result_ptr->push_back(lv_JD_ptr);
   }
@@ -639,7 +663,6 @@ vector<std::string> matchDirent(std::string dir_str, std::string prefix,
 bool hasException(const JSONType type, const Json::Value &jv_ptr,
                   ee1520_Exception *lv_exception_ptr, const int where_code,
                   const string &which_string) {
-  assert(jv_ptr != NULL);
   if (type == Null && jv_ptr.isNull()) {
     return false; // No exception, it's just null
   }
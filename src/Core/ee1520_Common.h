@@ -47,6 +47,12 @@ int myParseJSON(std::string input, Json::Value *jv_ptr);
 char *myFile2String(const char *f_name);
 int myFile2JSON(const char *f_name, Json::Value *jv_ptr);
 int myJSON2File(char *f_name, Json::Value *jv_ptr);
+/**
+ * @brief Take ownership of a JSON value returned by dump2JSON.
+ * @param jv_ptr[in]: Heap-allocated JSON value, deleted by this call.
+ * @return The JSON value, moved out without a deep copy.
+ */
+Json::Value adoptJSON(Json::Value *jv_ptr);
 int checkPostID(std::string);
 int checkBigID(std::string);
 const char *error_string(int);
@@ -86,7 +92,7 @@ public:
   Json::Value *dump2JSON(void);
 };
 
-vector<JSON_Diff *> *JSON_Difference(Json::Value, Json::Value,
+vector<JSON_Diff *> *JSON_Difference(const Json::Value &, const Json::Value &,
                                      vector<std::string>);
 
 /* for profile, post, comment IDs.
@@ -173,8 +179,10 @@ public:
 #define EE1520_ERROR_JSON2OBJECT_USER -54
 #define EE1520_ERROR_JSON2OBJECT_SERVER -55
 #define EE1520_ERROR_USER_NOT_FOUND -56
+#define EE1520_ERROR_BINARY_FORMAT -57
+#define EE1520_ERROR_JSON2OBJECT_EMAIL_SERVER -58
 
-#define EE1520_ERROR_MAX -57
+#define EE1520_ERROR_MAX -59
 
 extern const vector<std::string> keys_Thing;
 extern const vector<std::string> keys_Locatable;
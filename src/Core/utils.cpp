@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "ModArith.h"
 
 long long Utils::pow(long long base, int exp, long long mod) {
   long long result = 1;
@@ -14,6 +15,6 @@ int Utils::generateVerificationCode(long long secret, int timestamp) {
   constexpr long long MOD = 998244353; // A large prime number for modulus
   constexpr int timeStep =
       30; // Time step in seconds for verification code generation
-  return pow(secret, timestamp / timeStep, MOD) %
+  return ModArith<MOD>::pow(secret, timestamp / timeStep) %
          1000000; // Generate a 6-digit code
 }
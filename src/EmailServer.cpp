@@ -1,14 +1,69 @@
 #include "EmailServer.h"
-#include "Env.h"
+#include "Clock.h"
+#include "Core/BinaryIO.h"
+#include "Metrics.h"
 using namespace std;
 
-EmailServer::EmailServer() : nextId(0) {}
-EmailServer::~EmailServer() {
-  for (auto &userEmails : emails) {
-    for (auto &emailPair : userEmails.second) {
-      delete emailPair.second; // Delete each Email object
+namespace {
+MetricsRegistry &metrics = MetricsRegistry::global();
+const Histogram sendEmailLatency = metrics.histogram("email_send_ns");
+const Counter sendEmailFailures = metrics.counter("email_send_failed_total");
+const Counter getEmailsCalls = metrics.counter("email_get_emails_total");
+} // namespace
+
+EmailServer::EmailServer() : clock(&defaultClock()) {}
+EmailServer::~EmailServer() {}
+
+void EmailServer::setClock(const Clock *serverClock) { clock = serverClock; }
+
+mutex &EmailServer::mailboxLock(long long id) const {
+  return mailboxMutex[id % MAILBOX_LOCK_COUNT];
+}
+
+void EmailServer::Mailbox::readEmails(BinaryReader &reader, uint64_t slotCount,
+                                      uint64_t liveCount) {
+  if (liveCount > slotCount) {
+    throwBinaryFormatError("mailbox email count");
+  }
+  emails.clear();
+  emails.resize(slotCount);
+  this->liveCount = liveCount;
+  for (uint64_t i = 0; i < liveCount; i++) {
+    BinaryReader payload = reader.expectRecord(BINARY_TAG_EMAIL);
+    uint64_t emailId = payload.readVarint();
+    if (emailId >= slotCount || emails[emailId]) {
+      throwBinaryFormatError("email id " + to_string(emailId));
     }
+    Email &email = emails[emailId].emplace();
+    email.subject = payload.readString();
+    email.body = payload.readString();
+    email.sender = payload.readString();
+    email.recipient = payload.readString();
+    email.time = payload.readTime();
+    email.verificationCode = (int)payload.readSigned();
+    email.cardId = payload.readString();
+  }
+}
+
+EmailServer::Mailbox &EmailServer::loadMailbox(long long id) const {
+  Mailbox &mailbox = mailboxes[id];
+  if (mailbox.isCold) {
+    mailbox.readEmails(mailbox.cold, mailbox.coldSlotCount, mailbox.liveCount);
+    mailbox.isCold = false;
+    mailbox.cold = BinaryReader();
   }
+  return mailbox;
+}
+
+const EmailServer::Mailbox &EmailServer::peekMailbox(long long id,
+                                                     Mailbox &scratch) const {
+  const Mailbox &mailbox = mailboxes[id];
+  if (!mailbox.isCold) {
+    return mailbox;
+  }
+  BinaryReader cold = mailbox.cold;
+  scratch.readEmails(cold, mailbox.coldSlotCount, mailbox.liveCount);
+  return scratch;
 }
 
 bool EmailServer::checkPasswd(const std::string &address,
@@ -23,6 +78,7 @@ bool EmailServer::checkPasswd(const std::string &address,
 
 EmailError EmailServer::addAddress(const string &address,
                                    const string &passwd) {
+  unique_lock lock(addressMutex);
   if (addressId.find(address) != addressId.end()) {
     return ADDRESS_ALREADY_EXISTS; // Address already exists
   }
@@ -33,14 +89,16 @@ EmailError EmailServer::addAddress(const string &address,
   if (address.find('@') == string::npos || address.find('.') == string::npos) {
     return INVALID_ADDRESS; // Invalid email address format
   }
-  long long id = nextId++;
+  long long id = mailboxes.size();
   addressId[address] = id;
   idPasswd[id] = passwd;
-  emailIdCounter[id] = 0;
-  return NONE; // Address added successfully
+  mailboxes.emplace_back(); // Create the mailbox up front, so sending only
+                            // needs the lock of the mailbox
+  return NONE;              // Address added successfully
 }
 
 bool EmailServer::removeAddress(const string &address, const string &passwd) {
+  unique_lock lock(addressMutex);
   if (!checkPasswd(address, passwd)) {
     return false; // Password does not match
   }
@@ -50,105 +108,142 @@ bool EmailServer::removeAddress(const string &address, const string &passwd) {
   // Remove the address and associated data
   addressId.erase(it);
   idPasswd.erase(id);
-  emails.erase(id);         // Remove all emails for this user
-  emailIdCounter.erase(id); // Remove email ID counter for this user
+  mailboxes[id] = Mailbox(); // Remove all emails for this user
 
   return true; // Address removed successfully
 }
 
 EmailError EmailServer::sendEmail(const Email &email, const string &passwd) {
+  ScopedLatency latency(sendEmailLatency);
+  shared_lock lock(addressMutex);
   if (!checkPasswd(email.sender, passwd)) {
+    sendEmailFailures.add();
     return WRONG_SENDER_OR_PASSWORD; // Password does not match
   }
 
   auto participantIt = addressId.find(email.recipient);
   // Check recipient addresses
   if (participantIt == addressId.end()) {
+    sendEmailFailures.add();
     return INVALID_RECIPIENT; // Recipient address does not exist
   }
 
   long long participantId = participantIt->second;
-  // Create a new email object
-  long long emailId = emailIdCounter[participantId]++;
-  Email *newEmail = new Email(email);
-  newEmail->time = Env::getNow(); // Set the current time
-
-  // Store the email in the sender's email map
-  emails[participantId][emailId] = newEmail;
+  // Append the email to the recipient's mailbox
+  lock_guard mailboxGuard(mailboxLock(participantId));
+  Mailbox &mailbox = loadMailbox(participantId);
+  Email &newEmail = mailbox.emails.emplace_back(email).value();
+  newEmail.time = clock->now(); // Set the current time
+  mailbox.liveCount++;
 
   // Optionally, you can also store the email in recipients' maps if needed
 
   return NONE; // Email sent successfully
 }
 
-// TODO: find a faster way to get emails' ids
 const set<long long> EmailServer::getEmails(const string &address,
                                             const string &passwd) const {
+  getEmailsCalls.add();
+  shared_lock lock(addressMutex);
   if (!checkPasswd(address, passwd)) {
     return {}; // Password does not match, return empty set
   }
 
-  auto it = addressId.find(address);
-
-  long long id = it->second;
-  auto emailIt = emails.find(id);
-  if (emailIt == emails.end()) {
-    return {}; // No emails found for this user, return empty set
-  }
+  long long id = addressId.find(address)->second;
+  lock_guard mailboxGuard(mailboxLock(id));
+  const Mailbox &mailbox = loadMailbox(id);
   set<long long> emailIds;
-  for (const auto &emailPair : emailIt->second) {
-    emailIds.insert(emailPair.first); // Collect email IDs
+  for (size_t emailId = 0; emailId < mailbox.emails.size(); emailId++) {
+    if (mailbox.emails[emailId]) {
+      emailIds.insert(emailIds.end(), emailId); // Ids come in order
+    }
   }
   return emailIds; // Return set of email IDs
 }
 
+long long EmailServer::listEmails(const string &address, const string &passwd,
+                                  long long cursor, size_t limit,
+                                  vector<long long> &ids) const {
+  ids.clear();
+  shared_lock lock(addressMutex);
+  if (!checkPasswd(address, passwd) || cursor < 0) {
+    return -1; // Password does not match
+  }
+
+  long long id = addressId.find(address)->second;
+  lock_guard mailboxGuard(mailboxLock(id));
+  const Mailbox &mailbox = loadMailbox(id);
+  long long end = mailbox.emails.size();
+  long long emailId = cursor;
+  for (; emailId < end && ids.size() < limit; emailId++) {
+    if (mailbox.emails[emailId]) {
+      ids.push_back(emailId);
+    }
+  }
+  // Skip tombstones, so an empty page always means the end
+  while (emailId < end && !mailbox.emails[emailId]) {
+    emailId++;
+  }
+  return emailId < end ? emailId : -1;
+}
+
+size_t EmailServer::getEmailCount(const string &address,
+                                  const string &passwd) const {
+  shared_lock lock(addressMutex);
+  if (!checkPasswd(address, passwd)) {
+    return 0; // Password does not match
+  }
+
+  long long id = addressId.find(address)->second;
+  lock_guard mailboxGuard(mailboxLock(id));
+  return mailboxes[id].liveCount;
+}
+
 const Email *EmailServer::getEmailById(const string &address,
                                        const string &passwd,
                                        long long emailId) const {
+  shared_lock lock(addressMutex);
   if (!checkPasswd(address, passwd)) {
     return nullptr; // Password does not match, return nullptr
   }
 
   long long id = addressId.find(address)->second;
-  auto emailIt = emails.find(id);
-  if (emailIt == emails.end()) {
-    return nullptr; // No emails found for this user, return nullptr
-  }
-
-  auto emailPair = emailIt->second.find(emailId);
-  if (emailPair == emailIt->second.end()) {
+  lock_guard mailboxGuard(mailboxLock(id));
+  const Mailbox &mailbox = loadMailbox(id);
+  if (emailId < 0 || emailId >= (long long)mailbox.emails.size() ||
+      !mailbox.emails[emailId]) {
     return nullptr; // Email ID not found, return nullptr
   }
 
-  return emailPair->second; // Return the Email object
+  return &*mailbox.emails[emailId]; // Return the Email object
 }
 
 EmailError EmailServer::deleteEmailById(const string &address,
                                         const string &passwd,
                                         long long emailId) {
+  shared_lock lock(addressMutex);
   if (!checkPasswd(address, passwd)) {
     return WRONG_SENDER_OR_PASSWORD; // Password does not match
   }
 
   long long id = addressId.find(address)->second;
-  auto emailIt = emails.find(id);
-  if (emailIt == emails.end()) {
-    return EMAIL_NOT_FOUND; // No emails found for this user
-  }
-
-  auto emailPair = emailIt->second.find(emailId);
-  if (emailPair == emailIt->second.end()) {
+  lock_guard mailboxGuard(mailboxLock(id));
+  Mailbox &mailbox = loadMailbox(id);
+  if (emailId < 0 || emailId >= (long long)mailbox.emails.size() ||
+      !mailbox.emails[emailId]) {
     return EMAIL_NOT_FOUND; // Email ID not found
   }
 
-  delete emailPair->second;         // Delete the Email object
-  emailIt->second.erase(emailPair); // Remove from the map
+  mailbox.emails[emailId].reset(); // Leave a tombstone
+  mailbox.liveCount--;
 
   return NONE; // Email deleted successfully
 }
 
 Json::Value *EmailServer::dump2JSON() const {
+  unique_lock lock(addressMutex);
   Json::Value *json = new Json::Value();
+  Mailbox scratch;
 
   for (auto user : addressId) {
     long long id = user.second;
@@ -156,20 +251,21 @@ Json::Value *EmailServer::dump2JSON() const {
     userJson["password"] = idPasswd.at(id);              // Password
     userJson["emails"] = Json::Value(Json::objectValue); // Emails for this user
 
-    auto emailIt = emails.find(id);
-    if (emailIt != emails.end()) {
-      for (const auto &emailPair : emailIt->second) {
-        const Email *email = emailPair.second;
-        Json::Value emailJson;
-        emailJson["id"] = (Json::Value::Int64)emailPair.first; // Email ID
-        emailJson["subject"] = email->subject;
-        emailJson["body"] = email->body;
-        emailJson["sender"] = email->sender;
-        emailJson["recipient"] = email->recipient;
-        emailJson["time"] = *email->time.dump2JSON();
-
-        userJson["emails"][std::to_string(emailPair.first)] = emailJson;
+    const Mailbox &mailbox = peekMailbox(id, scratch);
+    for (size_t emailId = 0; emailId < mailbox.emails.size(); emailId++) {
+      if (!mailbox.emails[emailId]) {
+        continue; // Deleted
       }
+      const Email &email = *mailbox.emails[emailId];
+      Json::Value emailJson;
+      emailJson["id"] = (Json::Value::Int64)emailId; // Email ID
+      emailJson["subject"] = email.subject;
+      emailJson["body"] = email.body;
+      emailJson["sender"] = email.sender;
+      emailJson["recipient"] = email.recipient;
+      emailJson["time"] = adoptJSON(email.time.dump2JSON());
+
+      userJson["emails"][std::to_string(emailId)] = emailJson;
     }
 
     (*json)[user.first] = userJson; // Store user data by ID
@@ -177,3 +273,152 @@ Json::Value *EmailServer::dump2JSON() const {
 
   return json; // Return the JSON representation of the email server
 }
+
+void EmailServer::JSON2Object(const Json::Value *arg_json_ptr) {
+  ee1520_Exception lv_exception{};
+  ee1520_Exception *lv_exception_ptr = &lv_exception;
+  JSON2Object_precheck(arg_json_ptr, lv_exception_ptr,
+                       EE1520_ERROR_JSON2OBJECT_EMAIL_SERVER);
+#define exceptionCheck(type, jv_ptr, which_string)                             \
+  hasException(type, jv_ptr, lv_exception_ptr,                                 \
+               EE1520_ERROR_JSON2OBJECT_EMAIL_SERVER, which_string)
+  // A temporary registry, swapped in once the whole JSON is parsed
+  map<string, long long> tmpAddressId;
+  map<long long, string> tmpIdPasswd;
+  deque<Mailbox> tmpMailboxes;
+  for (const auto &address : arg_json_ptr->getMemberNames()) {
+    const Json::Value &userJson = (*arg_json_ptr)[address];
+    long long id = tmpMailboxes.size();
+    tmpAddressId[address] = id;
+    Mailbox &mailbox = tmpMailboxes.emplace_back();
+    if (!exceptionCheck(String, userJson["password"],
+                        address + ".password")) {
+      tmpIdPasswd[id] = userJson["password"].asString();
+    }
+    if (exceptionCheck(Object, userJson["emails"], address + ".emails")) {
+      continue;
+    }
+    for (const auto &key : userJson["emails"].getMemberNames()) {
+      const Json::Value &emailJson = userJson["emails"][key];
+      string which = address + ".emails." + key;
+      if (exceptionCheck(Object, emailJson, which) ||
+          exceptionCheck(Integer, emailJson["id"], which + ".id")) {
+        continue;
+      }
+      long long emailId = emailJson["id"].asInt64();
+      if (emailId < 0) {
+        continue; // Not given out by sendEmail
+      }
+      Email email;
+      if (!exceptionCheck(String, emailJson["subject"], which + ".subject")) {
+        email.subject = emailJson["subject"].asString();
+      }
+      if (!exceptionCheck(String, emailJson["body"], which + ".body")) {
+        email.body = emailJson["body"].asString();
+      }
+      if (!exceptionCheck(String, emailJson["sender"], which + ".sender")) {
+        email.sender = emailJson["sender"].asString();
+      }
+      if (!exceptionCheck(String, emailJson["recipient"],
+                          which + ".recipient")) {
+        email.recipient = emailJson["recipient"].asString();
+      }
+      if (!exceptionCheck(Object, emailJson["time"], which + ".time")) {
+        email.time.JSON2Object(&emailJson["time"]);
+      }
+      // Deleted emails are missing, leave tombstones so ids stay the same
+      if ((long long)mailbox.emails.size() <= emailId) {
+        mailbox.emails.resize(emailId + 1);
+      }
+      if (!mailbox.emails[emailId]) {
+        mailbox.liveCount++;
+      }
+      mailbox.emails[emailId] = std::move(email);
+    }
+  }
+#undef exceptionCheck
+  if (lv_exception_ptr->info_vector.size() != 0) {
+    throw(*lv_exception_ptr); // Throw exception if there are errors
+  }
+
+  // No mailbox lock is taken by anyone while addressMutex is held exclusively
+  unique_lock lock(addressMutex);
+  swap(addressId, tmpAddressId);
+  swap(idPasswd, tmpIdPasswd);
+  swap(mailboxes, tmpMailboxes);
+  snapshot.reset();
+}
+
+void EmailServer::materializeAll() {
+  unique_lock lock(addressMutex);
+  for (size_t id = 0; id < mailboxes.size(); id++) {
+    loadMailbox(id);
+  }
+  snapshot.reset();
+}
+
+void EmailServer::dump2Binary(BinaryWriter &writer) const {
+  unique_lock lock(addressMutex);
+  writer.beginRecord(BINARY_TAG_EMAIL_SERVER);
+  writer.writeVarint(addressId.size());
+  Mailbox scratch;
+  for (const auto &user : addressId) {
+    long long id = user.second;
+    const Mailbox &mailbox = peekMailbox(id, scratch);
+    writer.writeString(user.first);
+    writer.writeString(idPasswd.at(id));
+    // Slot count first, so the tombstones between the emails come back
+    writer.writeVarint(mailbox.emails.size());
+    writer.writeVarint(mailbox.liveCount);
+    for (size_t emailId = 0; emailId < mailbox.emails.size(); emailId++) {
+      if (!mailbox.emails[emailId]) {
+        continue; // Deleted
+      }
+      const Email &email = *mailbox.emails[emailId];
+      writer.beginRecord(BINARY_TAG_EMAIL);
+      writer.writeVarint(emailId);
+      writer.writeString(email.subject);
+      writer.writeString(email.body);
+      writer.writeString(email.sender);
+      writer.writeString(email.recipient);
+      writer.writeTime(email.time);
+      writer.writeSigned(email.verificationCode);
+      writer.writeString(email.cardId);
+      writer.endRecord();
+    }
+  }
+  writer.endRecord();
+}
+
+void EmailServer::Binary2Object(BinaryReader &reader,
+                                shared_ptr<const BinarySnapshot> snapshot) {
+  BinaryReader payload = reader.expectRecord(BINARY_TAG_EMAIL_SERVER);
+  map<string, long long> tmpAddressId;
+  map<long long, string> tmpIdPasswd;
+  deque<Mailbox> tmpMailboxes;
+  uint64_t addressCount = payload.readVarint();
+  for (uint64_t id = 0; id < addressCount; id++) {
+    tmpAddressId[string(payload.readString())] = id;
+    tmpIdPasswd[id] = payload.readString();
+    Mailbox &mailbox = tmpMailboxes.emplace_back();
+    uint64_t slotCount = payload.readVarint();
+    uint64_t liveCount = payload.readVarint();
+    if (snapshot) {
+      if (liveCount > slotCount) {
+        throwBinaryFormatError("mailbox email count");
+      }
+      mailbox.isCold = true;
+      mailbox.coldSlotCount = slotCount;
+      mailbox.liveCount = liveCount;
+      mailbox.cold = payload.takeRecords(liveCount);
+    } else {
+      mailbox.readEmails(payload, slotCount, liveCount);
+    }
+  }
+
+  unique_lock lock(addressMutex);
+  swap(addressId, tmpAddressId);
+  swap(idPasswd, tmpIdPasswd);
+  swap(mailboxes, tmpMailboxes);
+  swap(this->snapshot, snapshot);
+}
@@ -1,11 +1,21 @@
 #ifndef EMAIL_SERVER_H
 #define EMAIL_SERVER_H
 
+#include "Core/BinaryIO.h"
 #include "Core/Core.h"
 #include "Core/JvTime.h"
+#include <array>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <shared_mutex>
 #include <string>
+#include <vector>
+
+class Clock;
 
 enum EmailError {
   NONE = 0,
@@ -31,20 +41,71 @@ struct Email {
   std::string cardId = ""; // Card ID if applicable
 };
 
+/*
+ * EmailServer is safe to be called from many threads. addressMutex guards the
+ * address tables, each mailbox is guarded by one of the striped mailboxMutex.
+ */
 class EmailServer : public Core {
 private:
+  static constexpr size_t MAILBOX_LOCK_COUNT = 64;
+  mutable std::shared_mutex addressMutex;
+  mutable std::array<std::mutex, MAILBOX_LOCK_COUNT> mailboxMutex;
   // address -> id
   std::map<std::string, long long> addressId;
   // id -> password mapping
   std::map<long long, std::string> idPasswd;
-  // id -> email ID -> Email object
-  std::map<long long, std::map<long long, Email *>> emails;
-  // Counter for email IDs per user
-  std::map<long long, long long> emailIdCounter;
-  // Next available ID for new users
-  long long nextId;
-  /**
-   * @brief Check if the email&password match
+  /*
+   * Emails received by one address. Email ids are given out in order from 0
+   * and the email of id i is stored at index i, so lookup is O(1); deleted
+   * emails are left as empty tombstones to keep the ids stable. A deque
+   * appends in O(1) without moving the stored emails, so pointers returned
+   * by getEmailById stay valid.
+   * A mailbox loaded lazily keeps its emails in the snapshot until first
+   * accessed.
+   */
+  struct Mailbox {
+    std::deque<std::optional<Email>> emails;
+    size_t liveCount = 0; // Number of emails not deleted
+    bool isCold = false;  // Whether emails are still in the snapshot
+    size_t coldSlotCount = 0;
+    BinaryReader cold; // The EMAIL records of the mailbox
+
+    /**
+     * @brief decode the EMAIL records of a mailbox
+     * @param reader: reader positioned at the records
+     * @param slotCount: number of email ids given out, deleted ones included
+     * @param liveCount: number of EMAIL records
+     */
+    void readEmails(BinaryReader &reader, uint64_t slotCount,
+                    uint64_t liveCount);
+  };
+  // id -> mailbox, ids are given out in order from 0. Cold mailboxes are
+  // decoded on first access, by const readers as well.
+  mutable std::deque<Mailbox> mailboxes;
+  // The snapshot the cold mailboxes live in
+  std::shared_ptr<const BinarySnapshot> snapshot;
+  // Clock giving the time emails are sent at
+  const Clock *clock;
+  /**
+   * @brief Get the lock guarding the mailbox of an id
+   */
+  std::mutex &mailboxLock(long long id) const;
+  /**
+   * @brief Get a mailbox, decoding it from the snapshot on first access, the
+   * caller must hold its lock or addressMutex exclusively
+   * @throw ee1520_Exception if the cold mailbox is malformed
+   */
+  Mailbox &loadMailbox(long long id) const;
+  /**
+   * @brief Get a mailbox without keeping it decoded, for dumps, the caller
+   * must hold its lock or addressMutex exclusively
+   * @param scratch: where a cold mailbox is decoded, it is not kept
+   * @throw ee1520_Exception if the cold mailbox is malformed
+   */
+  const Mailbox &peekMailbox(long long id, Mailbox &scratch) const;
+  /**
+   * @brief Check if the email&password match, the caller must hold
+   * addressMutex
    * @param address: email address of the user
    * @param passwd: password for the user
    * @return true if the email and password match, false otherwise
@@ -55,6 +116,12 @@ protected:
 public:
   EmailServer();
   virtual ~EmailServer();
+  /**
+   * @brief Set the clock of the email server, call before the server is
+   * shared between threads
+   * @param serverClock: the clock, not owned
+   */
+  void setClock(const Clock *serverClock);
   /**
    * @brief Add a addres to the email server
    * @param address: email address of the user
@@ -94,6 +161,28 @@ public:
    */
   const std::set<long long> getEmails(const std::string &address,
                                       const std::string &passwd) const;
+  /**
+   * @brief List the email IDs in box page by page, in increasing order
+   * @param address: email address of the user
+   * @param passwd: password for the user
+   * @param cursor: ID to start listing from, 0 for the first page
+   * @param limit: maximum number of IDs to list
+   * @param ids: output, replaced by the IDs of this page
+   * @return cursor of the next page, -1 if there are no more emails or the
+   *         address or password is wrong
+   */
+  long long listEmails(const std::string &address, const std::string &passwd,
+                       long long cursor, size_t limit,
+                       std::vector<long long> &ids) const;
+  /**
+   * @brief Get the number of emails in box
+   * @param address: email address of the user
+   * @param passwd: password for the user
+   * @return number of emails not deleted, 0 if the address or password is
+   *         wrong
+   */
+  size_t getEmailCount(const std::string &address,
+                       const std::string &passwd) const;
   /**
    * @brief Get an email by ID
    * @param address: email address of the user
@@ -117,6 +206,33 @@ public:
                              const std::string &passwd, long long emailId);
 
   virtual Json::Value *dump2JSON() const;
+  /**
+   * @brief replace all addresses and emails with the ones in a dump2JSON
+   * result, emails keep their ids
+   * @throw ee1520_Exception if the JSON is malformed, the server is left
+   * untouched then
+   */
+  virtual void JSON2Object(const Json::Value *arg_json_ptr);
+  /**
+   * @brief write all addresses and emails as a binary snapshot record
+   */
+  void dump2Binary(BinaryWriter &writer) const;
+  /**
+   * @brief replace all addresses and emails with a binary snapshot record
+   * @param reader: reader positioned at the record
+   * @param snapshot: the snapshot reader reads from, optional. When given, the
+   * emails are decoded mailbox by mailbox on first access, the snapshot is
+   * kept alive for that.
+   * @throw ee1520_Exception if the record is malformed, the server is left
+   * untouched then
+   */
+  void Binary2Object(BinaryReader &reader,
+                     std::shared_ptr<const BinarySnapshot> snapshot = nullptr);
+  /**
+   * @brief decode every mailbox still in the snapshot, after which the server
+   * no longer reads it, e.g. before the snapshot file is overwritten
+   */
+  void materializeAll();
 };
 
 #endif // EMAIL_SERVER_H
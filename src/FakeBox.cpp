@@ -1,19 +1,37 @@
 #include "FakeBox.h"
 #include "Card.h"
+#include "Metrics.h"
 using namespace std;
 
-string FakeBox::login(const string &username, const string &passwd) {
-  return "";
+namespace {
+// Shared with Box, which lets the cards go when destroyed
+const Gauge cardsInBoxes = MetricsRegistry::global().gauge("box_cards");
+} // namespace
+
+FakeBox::SessionToken FakeBox::openSession(const string &username,
+                                           const string &passwd,
+                                           string *nickname) {
+  if (nickname != nullptr) {
+    *nickname = "";
+  }
+  return NO_SESSION;
 }
 
-Card *FakeBox::addCard(Card *card) {
-  cards[card->getId()] = card; // Add the card to the box
-  return nullptr;              // Card added successfully
+Card *FakeBox::addCard(SessionToken /*token*/, Card *card) {
+  Card *&slot = cards[card->getId()];
+  if (slot == nullptr) {
+    cardsInBoxes.add(1);
+  }
+  slot = card;    // Add the card to the box
+  return nullptr; // Card added successfully
 }
 
-Card *FakeBox::retrieveCard(const std::string &cardId, int verificationCode,
+Card *FakeBox::retrieveCard(SessionToken /*token*/,
+                            const std::string &cardId, int verificationCode,
                             Card *paymentCard) {
   return nullptr;
 }
 
-int FakeBox::redeemReward(int amount, Card *card) { return -1; }
+int FakeBox::redeemReward(SessionToken /*token*/, int amount, Card *card) {
+  return -1;
+}
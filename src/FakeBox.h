@@ -7,39 +7,49 @@ class FakeBox : public Box {
 private:
 protected:
 public:
+  // The calls without a token forward to the ones below
+  using Box::addCard;
+  using Box::redeemReward;
+  using Box::retrieveCard;
+
   /**
-   * @brief login the session
+   * @brief login a session
    * @param username: username to login
    * @param passwd: password, not necessary when addCard
-   * @return empty string
+   * @param nickname[out]: empty string, optional
+   * @return NO_SESSION, the box takes cards from anyone
    */
-  string login(const string &username, const string &passwd = "") override;
+  SessionToken openSession(const string &username, const string &passwd = "",
+                           string *nickname = nullptr) override;
 
   /**
    * @brief put a card into the box
+   * @param token: ignored
    * @param card: pointer to the card to be added
    * @return nullptr if the card add successfully
    *         otherwise, return the card itself
    */
-  Card *addCard(Card *card) override;
+  Card *addCard(SessionToken token, Card *card) override;
 
   /**
    * @brief retrieve a card from the box
+   * @param token: ignored
    * @param cardId: the id of the card to be retrieved
    * @param verificationCode:
    * @param card: pointer to the card for payment
    * @return: always return nullptr
    */
-  Card *retrieveCard(const std::string &cardId, int verificationCode,
-                     Card *card = nullptr) override;
+  Card *retrieveCard(SessionToken token, const std::string &cardId,
+                     int verificationCode, Card *card = nullptr) override;
 
   /**
    * @brief redeem a reward for a user
+   * @param token: ignored
    * @param amount: the amount of reward to redeem, -1 for all available
    * @param card: pointer to the card for receive reward
    * @return always return -1
    */
-  int redeemReward(int amount, Card *card) override;
+  int redeemReward(SessionToken token, int amount, Card *card) override;
 };
 
 #endif // FAKE_BOX_H
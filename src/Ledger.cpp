@@ -0,0 +1,252 @@
+#include "Ledger.h"
+#include <cassert>
+#include <thread>
+#include <vector>
+using namespace std;
+
+namespace {
+/**
+ * @brief get a chunk from a chunk directory, allocate it if needed
+ */
+template <typename T> T *getChunk(atomic<T *> &slot, size_t chunkSize) {
+  T *chunk = slot.load(memory_order_acquire);
+  if (chunk == nullptr) {
+    T *fresh = new T[chunkSize];
+    if (slot.compare_exchange_strong(chunk, fresh, memory_order_acq_rel)) {
+      chunk = fresh;
+    } else {
+      delete[] fresh; // Another thread allocated it first
+    }
+  }
+  return chunk;
+}
+} // namespace
+
+Ledger::Ledger()
+    : accountChunks(new atomic<Account *>[MAX_ACCOUNT_CHUNKS]()),
+      logChunks(new atomic<LogEntry *>[MAX_LOG_CHUNKS]()) {}
+
+Ledger::~Ledger() { clear(); }
+
+Ledger::Account *Ledger::account(long long userId) {
+  if (userId < 0 || (size_t)userId >= MAX_ACCOUNTS) {
+    return nullptr;
+  }
+  Account *chunk = getChunk(accountChunks[userId >> CHUNK_BITS], CHUNK_SIZE);
+  return &chunk[userId & (CHUNK_SIZE - 1)];
+}
+
+const Ledger::Account *Ledger::findAccount(long long userId) const {
+  if (userId < 0 || (size_t)userId >= MAX_ACCOUNTS) {
+    return nullptr;
+  }
+  Account *chunk =
+      accountChunks[userId >> CHUNK_BITS].load(memory_order_acquire);
+  return chunk == nullptr ? nullptr : &chunk[userId & (CHUNK_SIZE - 1)];
+}
+
+size_t Ledger::reserve() {
+  size_t index = logSize.load(memory_order_relaxed);
+  do {
+    if (index >= MAX_TRANSACTIONS) {
+      return NO_ENTRY; // Readers wait for every index below logSize
+    }
+  } while (!logSize.compare_exchange_weak(index, index + 1,
+                                          memory_order_relaxed));
+  return index;
+}
+
+void Ledger::write(size_t index, LedgerTransaction::Type type,
+                   long long userId, long long amount) {
+  LogEntry *chunk = getChunk(logChunks[index >> CHUNK_BITS], CHUNK_SIZE);
+  LogEntry &entry = chunk[index & (CHUNK_SIZE - 1)];
+  entry.transaction.type = type;
+  entry.transaction.userId = userId;
+  entry.transaction.amount = amount;
+  entry.committed.store(true, memory_order_release);
+}
+
+bool Ledger::open(long long userId, long long balance) {
+  Account *acc = account(userId);
+  if (acc == nullptr) {
+    return false;
+  }
+  if (acc->opened.load()) {
+    return true;
+  }
+  size_t index = reserve();
+  if (index == NO_ENTRY) {
+    return false;
+  }
+  bool opened = false;
+  if (acc->opened.compare_exchange_strong(opened, true)) {
+    // Add instead of store, a concurrent credit may already have landed
+    acc->balance.fetch_add(balance);
+    write(index, LedgerTransaction::OPEN, userId, balance);
+  } else {
+    // Opened by another thread meanwhile, fill the reserved entry anyway
+    write(index, LedgerTransaction::OPEN, userId, 0);
+  }
+  return true;
+}
+
+bool Ledger::credit(long long userId, long long amount) {
+  assert(amount >= 0);
+  if (!open(userId)) {
+    return false;
+  }
+  size_t index = reserve();
+  if (index == NO_ENTRY) {
+    return false;
+  }
+  account(userId)->balance.fetch_add(amount);
+  write(index, LedgerTransaction::CREDIT, userId, amount);
+  return true;
+}
+
+long long Ledger::debit(long long userId, long long amount) {
+  if (!open(userId)) {
+    return -1;
+  }
+  // Reserved before the balance changes, so a taken amount is always logged
+  size_t index = reserve();
+  if (index == NO_ENTRY) {
+    return -1;
+  }
+  Account &acc = *account(userId);
+  long long current = acc.balance.load();
+  long long taken;
+  do {
+    taken = amount < 0 ? current : amount; // Redeem all if amount < 0
+    if (current < taken) {
+      write(index, LedgerTransaction::DEBIT, userId, 0);
+      return -1; // Not enough balance
+    }
+  } while (!acc.balance.compare_exchange_weak(current, current - taken));
+  write(index, LedgerTransaction::DEBIT, userId, taken);
+  return taken;
+}
+
+optional<long long> Ledger::balance(long long userId) const {
+  const Account *acc = findAccount(userId);
+  if (acc == nullptr || !acc->opened.load()) {
+    return nullopt;
+  }
+  return acc->balance.load();
+}
+
+size_t Ledger::transactionCount() const {
+  return logSize.load(memory_order_acquire);
+}
+
+LedgerTransaction Ledger::transaction(size_t index) const {
+  assert(index < transactionCount());
+  const atomic<LogEntry *> &slot = logChunks[index >> CHUNK_BITS];
+  // The writer may have reserved the entry but not written it yet
+  while (slot.load(memory_order_acquire) == nullptr) {
+    this_thread::yield();
+  }
+  const LogEntry &entry =
+      slot.load(memory_order_acquire)[index & (CHUNK_SIZE - 1)];
+  while (!entry.committed.load(memory_order_acquire)) {
+    this_thread::yield();
+  }
+  return entry.transaction;
+}
+
+namespace {
+/**
+ * @brief replay a transaction log into a balance table
+ */
+vector<optional<long long>> replay(const Ledger &ledger) {
+  vector<optional<long long>> balances;
+  for (size_t i = 0; i < ledger.transactionCount(); i++) {
+    LedgerTransaction tx = ledger.transaction(i);
+    if ((size_t)tx.userId >= balances.size()) {
+      balances.resize(tx.userId + 1);
+    }
+    optional<long long> &balance = balances[tx.userId];
+    switch (tx.type) {
+    case LedgerTransaction::OPEN: // May be logged after a concurrent credit
+    case LedgerTransaction::CREDIT:
+      balance = balance.value_or(0) + tx.amount;
+      break;
+    case LedgerTransaction::DEBIT:
+      balance = balance.value_or(0) - tx.amount;
+      break;
+    }
+  }
+  return balances;
+}
+} // namespace
+
+bool Ledger::audit() const {
+  vector<optional<long long>> expected = replay(*this);
+  for (size_t chunk = 0; chunk < MAX_ACCOUNT_CHUNKS; chunk++) {
+    if (accountChunks[chunk].load() == nullptr) {
+      continue;
+    }
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+      long long userId = (chunk << CHUNK_BITS) | i;
+      optional<long long> logged;
+      if ((size_t)userId < expected.size()) {
+        logged = expected[userId];
+      }
+      if (balance(userId) != logged) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void Ledger::rebuild() {
+  vector<optional<long long>> expected = replay(*this);
+  for (size_t chunk = 0; chunk < MAX_ACCOUNT_CHUNKS; chunk++) {
+    Account *accounts = accountChunks[chunk].load();
+    if (accounts == nullptr) {
+      continue;
+    }
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+      accounts[i].opened.store(false);
+      accounts[i].balance.store(0);
+    }
+  }
+  for (size_t userId = 0; userId < expected.size(); userId++) {
+    if (expected[userId]) {
+      Account *acc = account(userId);
+      acc->opened.store(true);
+      acc->balance.store(*expected[userId]);
+    }
+  }
+}
+
+void Ledger::trim() {
+  for (size_t chunk = 0; chunk < MAX_LOG_CHUNKS; chunk++) {
+    delete[] logChunks[chunk].exchange(nullptr);
+  }
+  logSize.store(0);
+  static_assert(MAX_ACCOUNTS <= MAX_TRANSACTIONS, "an entry per account fits");
+  for (size_t chunk = 0; chunk < MAX_ACCOUNT_CHUNKS; chunk++) {
+    const Account *accounts = accountChunks[chunk].load();
+    if (accounts == nullptr) {
+      continue;
+    }
+    for (size_t i = 0; i < CHUNK_SIZE; i++) {
+      if (accounts[i].opened.load()) {
+        write(reserve(), LedgerTransaction::OPEN, (chunk << CHUNK_BITS) | i,
+              accounts[i].balance.load());
+      }
+    }
+  }
+}
+
+void Ledger::clear() {
+  for (size_t chunk = 0; chunk < MAX_ACCOUNT_CHUNKS; chunk++) {
+    delete[] accountChunks[chunk].exchange(nullptr);
+  }
+  for (size_t chunk = 0; chunk < MAX_LOG_CHUNKS; chunk++) {
+    delete[] logChunks[chunk].exchange(nullptr);
+  }
+  logSize.store(0);
+}
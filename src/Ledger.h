@@ -0,0 +1,145 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+struct LedgerTransaction {
+  enum Type : uint8_t {
+    OPEN,   // Account opened with an initial balance
+    CREDIT, // Reward added
+    DEBIT,  // Reward redeemed
+  };
+  Type type = OPEN;
+  long long userId = -1;
+  long long amount = 0; // Always non-negative
+};
+
+/*
+ * Reward balances of users, indexed by user id.
+ * Balances live in a dense array of atomics (allocated chunk by chunk, so it
+ * grows without moving), credit/debit are lock-free, and every change is
+ * appended to a lock-free transaction log for auditing. Both have a fixed
+ * capacity: operations on user ids beyond MAX_ACCOUNTS, or once the log holds
+ * MAX_TRANSACTIONS, are refused. trim shrinks the log back to one entry per
+ * account; the server does so whenever the log doubled and at checkpoints.
+ * audit, rebuild, trim and clear must only be called while no other thread
+ * uses the ledger.
+ */
+class Ledger {
+private:
+  static constexpr size_t CHUNK_BITS = 14;
+  static constexpr size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+  static constexpr size_t MAX_ACCOUNT_CHUNKS = 1 << 14;
+  static constexpr size_t MAX_LOG_CHUNKS = 1 << 16;
+  static constexpr size_t NO_ENTRY = SIZE_MAX; // The log is full
+
+public:
+  static constexpr size_t MAX_ACCOUNTS = MAX_ACCOUNT_CHUNKS * CHUNK_SIZE;
+  static constexpr size_t MAX_TRANSACTIONS = MAX_LOG_CHUNKS * CHUNK_SIZE;
+
+private:
+
+  struct Account {
+    std::atomic<long long> balance{0};
+    std::atomic<bool> opened{false};
+  };
+  struct LogEntry {
+    LedgerTransaction transaction;
+    std::atomic<bool> committed{false}; // Set once transaction is written
+  };
+
+  std::unique_ptr<std::atomic<Account *>[]> accountChunks;
+  std::unique_ptr<std::atomic<LogEntry *>[]> logChunks;
+  std::atomic<size_t> logSize{0}; // Number of reserved log entries
+
+  /**
+   * @brief get the account of a user, allocate its chunk if needed
+   * @return nullptr if the user id is out of range
+   */
+  Account *account(long long userId);
+  /**
+   * @brief get the account of a user
+   * @return nullptr if the chunk of the account is not allocated
+   */
+  const Account *findAccount(long long userId) const;
+  /**
+   * @brief reserve the next entry of the log, which must then be written
+   * @return the index of the entry, NO_ENTRY if the log is full
+   */
+  size_t reserve();
+  /**
+   * @brief write a reserved entry of the log
+   */
+  void write(size_t index, LedgerTransaction::Type type, long long userId,
+             long long amount);
+
+public:
+  Ledger();
+  ~Ledger();
+  Ledger(const Ledger &) = delete;
+  Ledger &operator=(const Ledger &) = delete;
+
+  /**
+   * @brief open an account, does nothing if it is already opened
+   * @param userId: the id of the user
+   * @param balance: the initial balance
+   * @return false if the user id is out of range or the log is full
+   */
+  bool open(long long userId, long long balance = 0);
+  /**
+   * @brief add reward to a user, opening the account if needed
+   * @param userId: the id of the user
+   * @param amount: the amount to add, must be non-negative
+   * @return false if the user id is out of range or the log is full, nothing
+   * is added then
+   */
+  bool credit(long long userId, long long amount);
+  /**
+   * @brief atomically take reward from a user, opening the account if needed.
+   * The log entry is reserved first, a refused debit leaves one of 0.
+   * @param userId: the id of the user
+   * @param amount: the amount to take, -1 for all available
+   * @return the amount taken, or -1 if the balance is not enough, the user id
+   * is out of range or the log is full
+   */
+  long long debit(long long userId, long long amount);
+  /**
+   * @brief get the balance of a user
+   * @return the balance, empty if the account is not opened
+   */
+  std::optional<long long> balance(long long userId) const;
+
+  /**
+   * @brief get the number of transactions in the log
+   */
+  size_t transactionCount() const;
+  /**
+   * @brief get a transaction from the log
+   * @param index: the index of the transaction, less than transactionCount()
+   */
+  LedgerTransaction transaction(size_t index) const;
+  /**
+   * @brief replay the log and compare with the current balances
+   * @return true if every balance matches the log
+   */
+  bool audit() const;
+  /**
+   * @brief reset every balance to the result of replaying the log
+   */
+  void rebuild();
+  /**
+   * @brief drop the transaction log, keeping one OPEN entry per account
+   * with its current balance, so audit still holds
+   */
+  void trim();
+  /**
+   * @brief remove all accounts and transactions
+   */
+  void clear();
+};
+
+#endif // LEDGER_H
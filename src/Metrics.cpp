@@ -0,0 +1,233 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <sstream>
+using namespace std;
+
+// Retires the buffer of a thread when the thread exits
+struct ThreadBufferOwner {
+  MetricsRegistry::ThreadBuffer *buffer = nullptr;
+  ~ThreadBufferOwner() {
+    if (buffer != nullptr) {
+      MetricsRegistry::global().retire(buffer);
+    }
+  }
+};
+
+namespace {
+thread_local ThreadBufferOwner threadBufferOwner;
+
+// Histogram slots: the buckets, then the sum, then the max
+constexpr size_t HISTOGRAM_SLOTS = MetricsRegistry::HISTOGRAM_BUCKETS + 2;
+
+void addToSlot(atomic<uint64_t> &cell, uint64_t value) {
+  // Only the owning thread writes, readers merge concurrently
+  cell.store(cell.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+} // namespace
+
+void Counter::add(uint64_t count) const {
+  if (slot == SIZE_MAX) {
+    return;
+  }
+  addToSlot(MetricsRegistry::global().threadBuffer().slots[slot], count);
+}
+
+void Gauge::set(long long value) const {
+  if (this->value != nullptr) {
+    this->value->store(value, memory_order_relaxed);
+  }
+}
+
+void Gauge::add(long long delta) const {
+  if (value != nullptr) {
+    value->fetch_add(delta, memory_order_relaxed);
+  }
+}
+
+void Histogram::record(uint64_t nanoseconds) const {
+  if (slot == SIZE_MAX) {
+    return;
+  }
+  MetricsRegistry::ThreadBuffer &buffer =
+      MetricsRegistry::global().threadBuffer();
+  addToSlot(buffer.slots[slot + MetricsRegistry::bucketOf(nanoseconds)], 1);
+  addToSlot(buffer.slots[slot + MetricsRegistry::HISTOGRAM_BUCKETS],
+            nanoseconds);
+  atomic<uint64_t> &max = buffer.slots[MetricsRegistry::maxSlot(slot)];
+  if (nanoseconds > max.load(memory_order_relaxed)) {
+    max.store(nanoseconds, memory_order_relaxed);
+  }
+}
+
+ScopedLatency::~ScopedLatency() {
+  chrono::nanoseconds elapsed = chrono::steady_clock::now() - begin;
+  histogram.record(elapsed.count());
+}
+
+MetricsRegistry::MetricsRegistry() : retired(MAX_SLOTS, 0) {}
+
+MetricsRegistry &MetricsRegistry::global() {
+  // Never destroyed, threads may still report while the program exits
+  static MetricsRegistry *registry = new MetricsRegistry();
+  return *registry;
+}
+
+MetricsRegistry::ThreadBuffer &MetricsRegistry::threadBuffer() {
+  if (threadBufferOwner.buffer == nullptr) {
+    ThreadBuffer *buffer = new ThreadBuffer();
+    lock_guard lock(mutex);
+    threads.push_back(buffer);
+    threadBufferOwner.buffer = buffer;
+  }
+  return *threadBufferOwner.buffer;
+}
+
+void MetricsRegistry::retire(ThreadBuffer *buffer) {
+  lock_guard lock(mutex);
+  for (const Metric &metric : metrics) {
+    if (metric.kind == GAUGE) {
+      continue;
+    }
+    size_t slots = metric.kind == COUNTER ? 1 : HISTOGRAM_SLOTS;
+    for (size_t slot = metric.slot; slot < metric.slot + slots; slot++) {
+      uint64_t value = buffer->slots[slot].load(memory_order_relaxed);
+      if (metric.kind == HISTOGRAM && slot == maxSlot(metric.slot)) {
+        retired[slot] = max(retired[slot], value);
+      } else {
+        retired[slot] += value;
+      }
+    }
+  }
+  threads.erase(find(threads.begin(), threads.end(), buffer));
+  delete buffer;
+}
+
+size_t MetricsRegistry::maxSlot(size_t histogramSlot) {
+  return histogramSlot + HISTOGRAM_BUCKETS + 1;
+}
+
+const MetricsRegistry::Metric *
+MetricsRegistry::findOrAdd(const string &name, Kind kind, size_t slots) {
+  lock_guard lock(mutex);
+  auto it = metricIndex.find(name);
+  if (it != metricIndex.end()) {
+    const Metric &metric = metrics[it->second];
+    return metric.kind == kind ? &metric : nullptr;
+  }
+  if (slotCount + slots > MAX_SLOTS) {
+    return nullptr;
+  }
+  Metric metric{name, kind, SIZE_MAX, nullptr};
+  if (kind == GAUGE) {
+    metric.value = &gauges.emplace_back(0);
+  } else {
+    metric.slot = slotCount;
+    slotCount += slots;
+  }
+  metricIndex[name] = metrics.size();
+  metrics.push_back(metric);
+  return &metrics.back();
+}
+
+Counter MetricsRegistry::counter(const string &name) {
+  Counter counter;
+  if (const Metric *metric = findOrAdd(name, COUNTER, 1)) {
+    counter.slot = metric->slot;
+  }
+  return counter;
+}
+
+Gauge MetricsRegistry::gauge(const string &name) {
+  Gauge gauge;
+  if (const Metric *metric = findOrAdd(name, GAUGE, 0)) {
+    gauge.value = metric->value;
+  }
+  return gauge;
+}
+
+Histogram MetricsRegistry::histogram(const string &name) {
+  Histogram histogram;
+  if (const Metric *metric = findOrAdd(name, HISTOGRAM, HISTOGRAM_SLOTS)) {
+    histogram.slot = metric->slot;
+  }
+  return histogram;
+}
+
+size_t MetricsRegistry::bucketOf(uint64_t value) {
+  if (value < 4) {
+    return value;
+  }
+  // 4 buckets per power of two, told apart by the 2 bits below the top one
+  size_t msb = 63 - __builtin_clzll(value);
+  size_t bucket = 4 * (msb - 1) + ((value >> (msb - 2)) & 3);
+  return min(bucket, HISTOGRAM_BUCKETS - 1);
+}
+
+uint64_t MetricsRegistry::bucketUpperBound(size_t bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  size_t msb = bucket / 4 + 1;
+  return ((4 + bucket % 4 + 1) << (msb - 2)) - 1;
+}
+
+uint64_t MetricsRegistry::merged(size_t slot, bool isMax) const {
+  uint64_t value = retired[slot];
+  for (const ThreadBuffer *buffer : threads) {
+    uint64_t local = buffer->slots[slot].load(memory_order_relaxed);
+    value = isMax ? max(value, local) : value + local;
+  }
+  return value;
+}
+
+string MetricsRegistry::dump() const {
+  static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+  lock_guard lock(mutex);
+  vector<const Metric *> sorted;
+  for (const Metric &metric : metrics) {
+    sorted.push_back(&metric);
+  }
+  sort(sorted.begin(), sorted.end(),
+       [](const Metric *a, const Metric *b) { return a->name < b->name; });
+
+  ostringstream out;
+  for (const Metric *metric : sorted) {
+    const string &name = metric->name;
+    if (metric->kind == COUNTER) {
+      out << "# TYPE " << name << " counter\n"
+          << name << " " << merged(metric->slot, false) << "\n";
+      continue;
+    }
+    if (metric->kind == GAUGE) {
+      out << "# TYPE " << name << " gauge\n"
+          << name << " " << metric->value->load(memory_order_relaxed) << "\n";
+      continue;
+    }
+    vector<uint64_t> buckets(HISTOGRAM_BUCKETS);
+    uint64_t count = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      buckets[b] = merged(metric->slot + b, false);
+      count += buckets[b];
+    }
+    uint64_t sum = merged(metric->slot + HISTOGRAM_BUCKETS, false);
+    uint64_t maxValue = merged(maxSlot(metric->slot), true);
+    out << "# TYPE " << name << " summary\n";
+    for (double quantile : QUANTILES) {
+      // The upper bound of the bucket holding the quantile, at most the max
+      uint64_t rank = (uint64_t)(quantile * count + 0.999999);
+      uint64_t seen = 0, value = 0;
+      for (size_t b = 0; b < HISTOGRAM_BUCKETS && count > 0; b++) {
+        seen += buckets[b];
+        if (seen >= rank) {
+          value = min(bucketUpperBound(b), maxValue);
+          break;
+        }
+      }
+      out << name << "{quantile=\"" << quantile << "\"} " << value << "\n";
+    }
+    out << name << "_sum " << sum << "\n"
+        << name << "_count " << count << "\n"
+        << name << "_max " << maxValue << "\n";
+  }
+  return out.str();
+}
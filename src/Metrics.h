@@ -0,0 +1,157 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class MetricsRegistry;
+
+/*
+ * Handles of metrics, cheap to copy and valid for the whole program. A
+ * default constructed handle records nothing.
+ */
+class Counter {
+private:
+  friend class MetricsRegistry;
+  size_t slot = SIZE_MAX; // Slot in the thread buffers
+
+public:
+  /**
+   * @brief add to the counter of the calling thread
+   */
+  void add(uint64_t count = 1) const;
+};
+
+class Gauge {
+private:
+  friend class MetricsRegistry;
+  std::atomic<long long> *value = nullptr;
+
+public:
+  void set(long long value) const;
+  void add(long long delta) const;
+};
+
+class Histogram {
+private:
+  friend class MetricsRegistry;
+  size_t slot = SIZE_MAX; // First slot in the thread buffers
+
+public:
+  /**
+   * @brief record a latency in the buffer of the calling thread
+   * @param nanoseconds: the latency
+   */
+  void record(uint64_t nanoseconds) const;
+};
+
+/*
+ * Records the time from its construction to its destruction (wall time, not
+ * the simulated clock) into a histogram.
+ */
+class ScopedLatency {
+private:
+  const Histogram &histogram;
+  std::chrono::steady_clock::time_point begin;
+
+public:
+  explicit ScopedLatency(const Histogram &histogram)
+      : histogram(histogram), begin(std::chrono::steady_clock::now()) {}
+  ~ScopedLatency();
+  ScopedLatency(const ScopedLatency &) = delete;
+  ScopedLatency &operator=(const ScopedLatency &) = delete;
+};
+
+/*
+ * Process-wide registry of counters, gauges and latency histograms.
+ *
+ * Counters and histograms are sharded per thread: every thread writes its
+ * own buffer of slots without contention, and dump sums the buffers of the
+ * live threads with what exited threads left behind. Gauges are a single
+ * atomic value. Histogram buckets are log-linear, 4 per power of two, so
+ * quantiles are exact to within 25%.
+ */
+class MetricsRegistry {
+public:
+  static constexpr size_t HISTOGRAM_BUCKETS = 160; // Up to about 18 minutes
+  static constexpr size_t MAX_SLOTS = 4096;        // Per thread buffer
+
+private:
+  enum Kind { COUNTER, GAUGE, HISTOGRAM };
+  struct Metric {
+    std::string name;
+    Kind kind;
+    size_t slot;                   // Counters and histograms
+    std::atomic<long long> *value; // Gauges
+  };
+  struct ThreadBuffer {
+    std::atomic<uint64_t> slots[MAX_SLOTS] = {};
+  };
+
+  mutable std::mutex mutex; // Guards everything below but the slots
+  std::deque<Metric> metrics; // Stable addresses
+  std::unordered_map<std::string, size_t> metricIndex;
+  std::deque<std::atomic<long long>> gauges; // Stable addresses
+  size_t slotCount = 0;
+  std::vector<ThreadBuffer *> threads; // Buffers of live threads
+  std::vector<uint64_t> retired;       // Sum of exited threads, MAX_SLOTS
+
+  MetricsRegistry();
+  /**
+   * @brief find or add a metric
+   * @param slots: slots the metric needs in the thread buffers
+   * @return the metric, nullptr if it exists with another kind or the
+   *         buffers are full
+   */
+  const Metric *findOrAdd(const std::string &name, Kind kind, size_t slots);
+  /**
+   * @brief merge a slot over every thread, live or exited
+   */
+  uint64_t merged(size_t slot, bool isMax) const;
+  static size_t maxSlot(size_t histogramSlot);
+
+  friend class Counter;
+  friend class Histogram;
+  friend struct ThreadBufferOwner;
+  /**
+   * @brief get the buffer of the calling thread, registering it if needed
+   */
+  ThreadBuffer &threadBuffer();
+  void retire(ThreadBuffer *buffer);
+
+public:
+  /**
+   * @brief get the registry every component reports to
+   */
+  static MetricsRegistry &global();
+  /**
+   * @brief get a metric by name, adding it on first use. Names should
+   * follow the Prometheus style, e.g. "server_card_found_ns".
+   * @return the handle, a handle recording nothing if the name is used by
+   *         another kind or there is no room left
+   */
+  Counter counter(const std::string &name);
+  Gauge gauge(const std::string &name);
+  Histogram histogram(const std::string &name);
+  /**
+   * @brief get the bucket of a value
+   */
+  static size_t bucketOf(uint64_t value);
+  /**
+   * @brief get the largest value of a bucket
+   */
+  static uint64_t bucketUpperBound(size_t bucket);
+  /**
+   * @brief dump every metric in the Prometheus text format, histograms as
+   * summaries with their p50, p90, p99 and p999, sum, count and max
+   */
+  std::string dump() const;
+};
+
+#endif // METRICS_H
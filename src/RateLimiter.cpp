@@ -0,0 +1,61 @@
+#include "RateLimiter.h"
+#include <algorithm>
+#include <functional>
+using namespace std;
+
+RateLimiter::RateLimiter() {
+  limits[USERNAME] = {5, 60};
+  limits[CARD] = {5, 60};
+  limits[BOX] = {30, 2};
+}
+
+void RateLimiter::setLimit(Scope scope, int burst, long long interval) {
+  limits[scope] = {max(burst, 0), max(interval, 1LL)};
+}
+
+RateLimiter::Shard &RateLimiter::shard(Scope scope, const string &key) {
+  return shards[scope][hash<string>{}(key) & (SHARD_COUNT - 1)];
+}
+
+bool RateLimiter::allowed(Scope scope, const string &key, long long now) {
+  const Limit &limit = limits[scope];
+  if (limit.burst == 0) {
+    return true;
+  }
+  Shard &s = shard(scope, key);
+  lock_guard lock(s.mutex);
+  auto it = s.fullAt.find(key);
+  // The bucket holds (burst * interval - (fullAt - now)) / interval tokens
+  return it == s.fullAt.end() ||
+         it->second - now <= (long long)(limit.burst - 1) * limit.interval;
+}
+
+void RateLimiter::charge(Scope scope, const string &key, long long now) {
+  const Limit &limit = limits[scope];
+  if (limit.burst == 0) {
+    return;
+  }
+  Shard &s = shard(scope, key);
+  lock_guard lock(s.mutex);
+  auto [it, inserted] = s.fullAt.try_emplace(key, now);
+  it->second = max(it->second, now) + limit.interval;
+  if (!inserted || s.fullAt.size() < s.sweepSize) {
+    return;
+  }
+  // Drop the keys whose buckets refilled, then wait for the map to double
+  for (auto entry = s.fullAt.begin(); entry != s.fullAt.end();) {
+    entry = entry->second <= now ? s.fullAt.erase(entry) : next(entry);
+  }
+  s.sweepSize = max(MIN_SWEEP_SIZE, 2 * s.fullAt.size());
+}
+
+size_t RateLimiter::size() {
+  size_t count = 0;
+  for (auto &scopeShards : shards) {
+    for (Shard &s : scopeShards) {
+      lock_guard lock(s.mutex);
+      count += s.fullAt.size();
+    }
+  }
+  return count;
+}
@@ -0,0 +1,83 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+ * Throttle of failed attempts, one token bucket per key.
+ *
+ * A key may fail `burst` times in a row, then once per `interval` seconds
+ * as its bucket refills. Callers ask allowed() before doing any work and
+ * charge() the key when the attempt fails, so users who get it right are
+ * never slowed down while a brute force is.
+ *
+ * Each bucket is kept as a single time, when it will be full again (the
+ * generic cell rate algorithm), so memory is one entry per key that failed
+ * recently; entries of full buckets are swept out as the map grows. Times
+ * come from the caller, i.e. the simulation clock.
+ *
+ * Safe to be called from many threads. allowed() and charge() are separate
+ * steps, so concurrent attempts on one key may overshoot the burst a little.
+ */
+class RateLimiter {
+public:
+  // What an attempt is keyed by, each with its own limit
+  enum Scope { USERNAME, CARD, BOX, SCOPE_COUNT };
+
+private:
+  static constexpr size_t SHARD_COUNT = 16; // Must be a power of 2
+  // Entries a shard holds at least before it is swept
+  static constexpr size_t MIN_SWEEP_SIZE = 64;
+
+  struct Limit {
+    int burst = 0; // 0 for no limit
+    long long interval = 0;
+  };
+  struct Shard {
+    std::mutex mutex;
+    // key -> time the bucket is full again, always in the future when swept
+    std::unordered_map<std::string, long long> fullAt;
+    size_t sweepSize = MIN_SWEEP_SIZE; // Sweep when holding this many
+  };
+
+  std::array<Limit, SCOPE_COUNT> limits;
+  std::array<std::array<Shard, SHARD_COUNT>, SCOPE_COUNT> shards;
+
+  Shard &shard(Scope scope, const std::string &key);
+
+public:
+  /**
+   * @brief start with the default limits: 5 failures then one a minute per
+   * username and per card, 30 failures then one every 2 seconds per box
+   */
+  RateLimiter();
+
+  /**
+   * @brief set the limit of a scope, call before the limiter is shared
+   * between threads
+   * @param burst: failures allowed in a row, 0 for no limit
+   * @param interval: seconds for one more failure to be allowed
+   */
+  void setLimit(Scope scope, int burst, long long interval);
+  /**
+   * @brief check if a key may make another attempt
+   * @param now: the current time, in seconds
+   * @return false if the key has used up its failures
+   */
+  bool allowed(Scope scope, const std::string &key, long long now);
+  /**
+   * @brief record a failed attempt of a key
+   * @param now: the current time, in seconds
+   */
+  void charge(Scope scope, const std::string &key, long long now);
+  /**
+   * @brief get the number of keys with failures tracked
+   */
+  size_t size();
+};
+
+#endif // RATE_LIMITER_H
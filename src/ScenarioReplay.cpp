@@ -0,0 +1,136 @@
+#include "ScenarioReplay.h"
+#include "ActionDispatcher.h"
+#include "SnapshotStream.h"
+#include "World.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+using namespace std;
+
+namespace {
+using SteadyClock = chrono::steady_clock;
+
+void dumpJSON(const World &world, const std::string &outputFile,
+              const std::string &desc = "") {
+  Json::Value json = world.snapshotJSON(desc);
+  ofstream ofs(outputFile);
+  if (ofs.is_open()) {
+    ofs << json.toStyledString();
+    ofs.close();
+  } else {
+    cerr << "Failed to open output file." << endl;
+  }
+}
+} // namespace
+
+ScenarioResult replayScenario(const string &dir, bool stream,
+                              const ExpiryPolicy *expiry, int checkpointEvery) {
+  ScenarioResult result;
+  result.dir = dir;
+  result.status = -1; // Until the last action is done
+  SteadyClock::time_point begin = SteadyClock::now();
+
+  // Load scenario from JSON file
+  string scenarioFile = dir + string("/scenario0.json");
+  Json::Value scenarioJson;
+  if (myFile2JSON(scenarioFile.c_str(), &scenarioJson) != EE1520_ERROR_NORMAL) {
+    cerr << "Failed to read scenario file: " << scenarioFile << endl;
+    return result;
+  }
+  try {
+    // Initialize environment
+    World world{&scenarioJson};
+    if (expiry != nullptr) {
+      world.server.setExpiryPolicy(*expiry);
+    }
+    if (checkpointEvery >= 0 &&
+        world.startLog(dir + string("/server.wal"),
+                       dir + string("/checkpoint.bin")) !=
+            EE1520_ERROR_NORMAL) {
+      cerr << "Failed to start the write-ahead log in " << dir << endl;
+      return result;
+    }
+
+    unique_ptr<SnapshotStream> snapshotStream;
+    if (stream) {
+      snapshotStream = make_unique<SnapshotStream>(
+          dir + string("/scenarioStream.jsonl"));
+      if (!snapshotStream->isOpen()) {
+        cerr << "Failed to open output file." << endl;
+        return result;
+      }
+      snapshotStream->append(world.snapshotJSON("Initial scenario"));
+    }
+
+    // Process actions from JSON file
+    string actionFile = dir + string("/actions.json");
+    Json::Value actionsJson;
+    if (myFile2JSON(actionFile.c_str(), &actionsJson) != EE1520_ERROR_NORMAL) {
+      cerr << "Failed to read action file: " << actionFile << endl;
+      return result;
+    }
+    ActionBatch batch = ActionBatch::compile(actionsJson);
+    ActionDispatcher dispatcher(world, batch);
+    SteadyClock::time_point loaded = SteadyClock::now();
+    result.loadSeconds = chrono::duration<double>(loaded - begin).count();
+
+    for (size_t i = 0; i < batch.actions.size(); i++) {
+      const Action &action = batch.actions[i];
+      if (!dispatcher.run(action)) {
+        return result;
+      }
+      world.clock.advance(action.timespan);
+      world.server.runTimers();
+      if (checkpointEvery > 0 && (i + 1) % checkpointEvery == 0 &&
+          world.checkpoint() != EE1520_ERROR_NORMAL) {
+        cerr << "Failed to checkpoint " << dir << endl;
+        return result;
+      }
+      string desc = "Scenario after action " + to_string(i + 1) + ": " +
+                    batch.str(action.name);
+      if (snapshotStream) {
+        snapshotStream->append(world.snapshotJSON(desc));
+      } else {
+        dumpJSON(world,
+                 dir + string("/scenario") + to_string(i + 1) + string(".json"),
+                 desc);
+      }
+      result.actions++;
+    }
+    result.replaySeconds =
+        chrono::duration<double>(SteadyClock::now() - loaded).count();
+  } catch (ee1520_Exception &e) {
+    cerr << "Exception occurred: " << adoptJSON(e.dump2JSON()).toStyledString()
+         << endl;
+    return result;
+  }
+  result.status = 0;
+  return result;
+}
+
+vector<ScenarioResult> replayScenarios(const vector<string> &dirs, bool stream,
+                                       unsigned int jobs,
+                                       const ExpiryPolicy *expiry,
+                                       int checkpointEvery) {
+  vector<ScenarioResult> results(dirs.size());
+  atomic<size_t> next{0}; // Index of the next scenario to pick up
+  auto work = [&] {
+    // Every world has its own clock, so the scenarios do not interfere
+    for (size_t i = next++; i < dirs.size(); i = next++) {
+      results[i] = replayScenario(dirs[i], stream, expiry, checkpointEvery);
+    }
+  };
+  jobs = max(1u, min<unsigned int>(jobs, dirs.size()));
+  vector<thread> workers;
+  for (unsigned int t = 0; t < jobs; t++) {
+    workers.emplace_back(work);
+  }
+  for (thread &worker : workers) {
+    worker.join();
+  }
+  return results;
+}
@@ -0,0 +1,50 @@
+#ifndef SCENARIO_REPLAY_H
+#define SCENARIO_REPLAY_H
+
+#include <string>
+#include <vector>
+
+struct ExpiryPolicy;
+
+struct ScenarioResult {
+  std::string dir;          // The scenario directory
+  int status = 0;           // 0 on success, -1 if the replay failed
+  unsigned int actions = 0; // Number of actions replayed
+  double loadSeconds = 0;   // Time to load scenario0.json and actions.json
+  double replaySeconds = 0; // Time to run the actions and dump snapshots
+};
+
+/**
+ * @brief replay one scenario directory: load scenario0.json, run the actions
+ * of actions.json and write a scenario<num>.json after each of them (or a
+ * scenarioStream.jsonl). Errors are reported on stderr.
+ * @param dir: the scenario directory
+ * @param stream: write scenarioStream.jsonl instead of scenario<num>.json
+ * @param expiry: the expiry policy of the server, nullptr for none
+ * @param checkpointEvery: -1 for no write-ahead log; otherwise the server
+ * mutations are logged to server.wal in dir, and the world is checkpointed
+ * to checkpoint.bin in dir after loading and every checkpointEvery actions
+ * (0 for only after loading)
+ * @return the result, with its timings
+ */
+ScenarioResult replayScenario(const std::string &dir, bool stream,
+                              const ExpiryPolicy *expiry = nullptr,
+                              int checkpointEvery = -1);
+
+/**
+ * @brief replay many scenario directories at once, each with its own world
+ * and clock, on a pool of worker threads. Output of User actions (reading
+ * mails, ...) from different scenarios may interleave on stdout.
+ * @param dirs: the scenario directories
+ * @param stream: write scenarioStream.jsonl instead of scenario<num>.json
+ * @param jobs: number of worker threads
+ * @param expiry: the expiry policy of the servers, nullptr for none
+ * @param checkpointEvery: see replayScenario, each directory gets its own log
+ * @return the results, in the order of dirs
+ */
+std::vector<ScenarioResult>
+replayScenarios(const std::vector<std::string> &dirs, bool stream,
+                unsigned int jobs, const ExpiryPolicy *expiry = nullptr,
+                int checkpointEvery = -1);
+
+#endif // SCENARIO_REPLAY_H
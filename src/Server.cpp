@@ -1,165 +1,423 @@
 #include "Server.h"
+#include "Clock.h"
+#include "Core/BinaryIO.h"
 #include "Core/Labeled_GPS.h"
+#include "Core/TotpEngine.h"
 #include "Core/ee1520_Common.h"
 #include "Core/ee1520_Exception.h"
-#include "Core/utils.h"
 #include "EmailServer.h"
-#include "Env.h"
+#include "Metrics.h"
+#include "WriteAheadLog.h"
+#include <algorithm>
 #include <random>
 #include <string>
 #include <time.h>
 using namespace std;
 
+namespace {
+MetricsRegistry &metrics = MetricsRegistry::global();
+const Counter checkUserCalls = metrics.counter("server_check_user_total");
+const Counter checkUserFailures =
+    metrics.counter("server_check_user_failed_total");
+// Every call, the matching counter only counts the successful ones
+const Histogram cardFoundLatency = metrics.histogram("server_card_found_ns");
+const Counter cardsFound = metrics.counter("server_card_found_total");
+const Histogram cardRetrievedLatency =
+    metrics.histogram("server_card_retrieved_ns");
+const Counter cardsRetrieved = metrics.counter("server_card_retrieved_total");
+const Counter retrievalsRejected =
+    metrics.counter("server_reject_retrieve_total");
+const Counter rewardsRedeemed = metrics.counter("server_redeem_reward_total");
+const Counter rewardsRefused =
+    metrics.counter("server_reward_refused_total");
+const Counter remindersSent = metrics.counter("server_reminder_total");
+const Counter findsExpired = metrics.counter("server_find_expired_total");
+const Counter rejectsForgotten =
+    metrics.counter("server_reject_forgotten_total");
+
+void seedRandom() {
+  static once_flag seeded;
+  call_once(seeded, [] { srand(time(nullptr)); });
+}
+
+void writeFindInfo(BinaryWriter &writer, BinaryTag tag,
+                   const FindInfo &findInfo) {
+  writer.beginRecord(tag);
+  writer.writeTime(findInfo.time);
+  writer.writeGPS(findInfo.gps);
+  writer.writeSigned(findInfo.finderId);
+  writer.writeSigned(findInfo.reward);
+  writer.writeSigned(findInfo.verificationCode);
+  writer.endRecord();
+}
+
+FindInfo readFindInfo(BinaryReader &reader, BinaryTag tag) {
+  BinaryReader payload = reader.expectRecord(tag);
+  FindInfo findInfo;
+  findInfo.time = payload.readTime();
+  findInfo.gps = payload.readGPS();
+  findInfo.finderId = payload.readSigned();
+  findInfo.reward = (int)payload.readSigned();
+  findInfo.verificationCode = (int)payload.readSigned();
+  return findInfo;
+}
+
+/**
+ * @brief decode the payload of a CARD_RECORD
+ * @param payload: reader over the payload
+ * @param cardId: output, the ID of the card
+ */
+CardRecord readCardRecord(BinaryReader &payload, string_view &cardId) {
+  cardId = payload.readString();
+  CardRecord record;
+  record.ownerId = payload.readSigned();
+  bool hasFindInfo = payload.readBool();
+  bool hasRejectInfo = payload.readBool();
+  if (hasFindInfo) {
+    record.findInfo = readFindInfo(payload, BINARY_TAG_FIND_INFO);
+  }
+  if (hasRejectInfo) {
+    record.rejectInfo = readFindInfo(payload, BINARY_TAG_REJECT_INFO);
+  }
+  return record;
+}
+
+/**
+ * @brief read the times of the find and reject info of a CARD_RECORD payload,
+ * skipping everything else they hold
+ * @param payload: reader over the payload
+ * @param foundAt[out]: the time of the find info, empty if none
+ * @param rejectFoundAt[out]: the time of the reject info, empty if none
+ */
+void readCardTimes(BinaryReader payload, optional<long long> &foundAt,
+                   optional<long long> &rejectFoundAt) {
+  payload.readString(); // Card ID
+  payload.readSigned(); // Owner ID
+  bool hasFindInfo = payload.readBool();
+  bool hasRejectInfo = payload.readBool();
+  if (hasFindInfo) {
+    foundAt = payload.expectRecord(BINARY_TAG_FIND_INFO).readTime().getEpoch();
+  }
+  if (hasRejectInfo) {
+    rejectFoundAt =
+        payload.expectRecord(BINARY_TAG_REJECT_INFO).readTime().getEpoch();
+  }
+}
+} // namespace
+
+UserInfo::UserInfo(const UserInfo &other)
+    : username(other.username), passwd(other.passwd),
+      nickname(other.nickname), email(other.email),
+      verificationType(other.verificationType), id(other.id),
+      cardFoundCount(other.cardFoundCount.load()) {}
+
+UserInfo &UserInfo::operator=(const UserInfo &other) {
+  username = other.username;
+  passwd = other.passwd;
+  nickname = other.nickname;
+  email = other.email;
+  verificationType = other.verificationType;
+  id = other.id;
+  cardFoundCount = other.cardFoundCount.load();
+  return *this;
+}
+
 Server::Server(const string &serverAddress, const string &serverEmailPasswd,
                EmailServer *emailServerPtr)
     : address(serverAddress), emailPasswd(serverEmailPasswd),
-      emailServer(emailServerPtr), nextId(0) {
+      clock(&defaultClock()), emailServer(emailServerPtr) {
   emailServer->addAddress(serverAddress, serverEmailPasswd);
 }
 
 Server::Server(EmailServer *emailServerPtr, const Json::Value *arg_json_ptr)
-    : emailServer(emailServerPtr), nextId(0) {
+    : clock(&defaultClock()), emailServer(emailServerPtr) {
   JSON2Object(arg_json_ptr);
 }
 
 Server::~Server() {}
 
+// hash<string_view> gives the same value as hash<string> for equal text
+Server::CardShard &Server::cardShard(string_view cardId) {
+  return cardShards[hash<string_view>{}(cardId) & (CARD_SHARD_COUNT - 1)];
+}
+
+const Server::CardShard &Server::cardShard(string_view cardId) const {
+  return cardShards[hash<string_view>{}(cardId) & (CARD_SHARD_COUNT - 1)];
+}
+
+CardRecord *Server::findRecord(const CardShard &shard,
+                               const string &cardId) const {
+  auto it = shard.records.find(cardId);
+  if (it != shard.records.end()) {
+    return &it->second;
+  }
+  auto coldIt = lower_bound(
+      shard.cold.begin(), shard.cold.end(), cardId,
+      [](const ColdCard &card, const string &id) { return card.id < id; });
+  if (coldIt == shard.cold.end() || coldIt->id != cardId) {
+    return nullptr; // Card ID not found
+  }
+  BinaryReader payload = coldIt->payload;
+  string_view id;
+  CardRecord record = readCardRecord(payload, id);
+  return &shard.records.emplace(cardId, std::move(record)).first->second;
+}
+
+void Server::materializeAll() const {
+  for (const CardShard &shard : cardShards) {
+    unique_lock lock(shard.mutex);
+    for (const ColdCard &card : shard.cold) {
+      if (shard.records.find(string(card.id)) == shard.records.end()) {
+        BinaryReader payload = card.payload;
+        string_view id;
+        CardRecord record = readCardRecord(payload, id);
+        shard.records.emplace(card.id, std::move(record));
+      }
+    }
+    shard.cold.clear();
+    shard.cold.shrink_to_fit();
+  }
+}
+
+const CardRecord &Server::DumpedCard::get(CardRecord &scratch) const {
+  if (record != nullptr) {
+    return *record;
+  }
+  BinaryReader payload = cold->payload;
+  string_view cardId;
+  scratch = readCardRecord(payload, cardId);
+  return scratch;
+}
+
+vector<Server::DumpedCard> Server::sortedCards() const {
+  vector<DumpedCard> cards;
+  for (const CardShard &shard : cardShards) {
+    for (const auto &card : shard.records) {
+      cards.push_back({card.first, &card.second, nullptr});
+    }
+    for (const ColdCard &card : shard.cold) {
+      if (shard.records.count(string(card.id)) == 0) {
+        cards.push_back({card.id, nullptr, &card});
+      }
+    }
+  }
+  sort(cards.begin(), cards.end(),
+       [](const DumpedCard &a, const DumpedCard &b) { return a.id < b.id; });
+  return cards;
+}
+
+long long Server::findUserId(const string &username) const {
+  auto it = userId.find(username);
+  return it == userId.end() ? -1 : it->second;
+}
+
+long long Server::authUser(const string &username, const string &passwd) const {
+  long long id = findUserId(username);
+  if (id == -1 || users[id].passwd != passwd) {
+    return -1; // Username not found or password does not match
+  }
+  return id;
+}
+
 void Server::notifyUser(long long id, const string &subject, const string &body,
                         const string &cardId, int verificationCode) const {
-  if (auto it = userInfo.find(id); it != userInfo.end()) {
-    string userAddr = it->second.email;
+  if (id >= 0 && id < (long long)users.size() && !users[id].email.empty()) {
     Email email;
     email.subject = subject;
     email.body = body;
     email.sender = address;
-    email.recipient = userAddr;
+    email.recipient = users[id].email;
     email.cardId = cardId; // Set the card ID if applicable
     email.verificationCode = verificationCode;
     emailServer->sendEmail(email, emailPasswd);
   }
 }
 
+template <typename WriteFields>
+void Server::logMutation(BinaryTag tag, WriteFields writeFields) const {
+  if (log == nullptr) {
+    return;
+  }
+  BinaryWriter entry;
+  entry.beginRecord(tag);
+  writeFields(entry);
+  entry.endRecord();
+  log->append(entry.finish());
+}
+
 bool Server::addUser(const string &username, const string &passwd,
                      const string &emailAddr, const string &nickname) {
+  unique_lock lock(userMutex);
   if (userId.find(username) != userId.end() || emailAddr.empty()) {
     return false; // Username already exists or invalid email address
   }
-  long long id = nextId++;
+  if (users.size() >= Ledger::MAX_ACCOUNTS) {
+    return false; // No room for the reward account of another user
+  }
+  long long id = users.size();
   userId[username] = id;
-  this->userInfo[id].username = username;
-  this->userInfo[id].passwd = passwd;
-  this->userInfo[id].email = emailAddr;
-  this->userInfo[id].nickname = nickname;
+  UserInfo &user = users.emplace_back();
+  user.username = username;
+  user.passwd = passwd;
+  user.email = emailAddr;
+  user.nickname = nickname;
+  logMutation(BINARY_TAG_LOG_ADD_USER, [&](BinaryWriter &entry) {
+    entry.writeString(username);
+    entry.writeString(passwd);
+    entry.writeString(emailAddr);
+    entry.writeString(nickname);
+  });
   return true; // User added successfully
 }
 
 bool Server::removeUser(const string &username, const string &passwd) {
-  if (!checkUser(username, passwd)) {
+  unique_lock lock(userMutex);
+  long long id = authUser(username, passwd);
+  if (id == -1) {
     return false; // Password does not match
   }
-  auto it = userId.find(username);
-  long long id = userId[username];
-  userId.erase(it);
-  this->userInfo.erase(id);
+  userId.erase(username);
+  users[id] = UserInfo(); // Keep the slot so other ids stay valid
+  logMutation(BINARY_TAG_LOG_REMOVE_USER, [&](BinaryWriter &entry) {
+    entry.writeString(username);
+    entry.writeString(passwd);
+  });
   return true; // User removed successfully
 }
 
 bool Server::rejectRetrieve(const string &username, const string &passwd,
                             const string &id) {
-  if (!checkUser(username, passwd)) {
+  long long uid;
+  {
+    shared_lock userLock(userMutex);
+    uid = authUser(username, passwd);
+  }
+  if (uid == -1) {
     return false; // User does not exist or password does not match
   }
-  auto it = cardOwnerId.find(id);
-  if (it == cardOwnerId.end()) {
+  CardShard &shard = cardShard(id);
+  unique_lock lock(shard.mutex);
+  CardRecord *recordPtr = findRecord(shard, id);
+  if (recordPtr == nullptr) {
     return false; // Card ID not found
   }
-  long long ownerId = it->second;
-  if (ownerId != userId[username]) {
+  CardRecord &record = *recordPtr;
+  if (record.ownerId != uid) {
     return false; // User is not the owner of the card
   }
-  cardRejectInfo[id] = cardFindInfo[id]; // Store the find info for rejection
-  cardFindInfo.erase(id);                // Remove the find info for the card
-  return true;                           // Card retrieval rejected successfully
+  // Store the find info for rejection
+  record.rejectInfo = record.findInfo.value_or(FindInfo());
+  record.findInfo.reset(); // Remove the find info for the card
+  record.rejectedAt = clock->now().getEpoch();
+  logMutation(BINARY_TAG_LOG_REJECT_RETRIEVE, [&](BinaryWriter &entry) {
+    entry.writeString(username);
+    entry.writeString(passwd);
+    entry.writeString(id);
+  });
+  scheduleRejectExpiry(id, record.rejectedAt,
+                       record.rejectInfo->time.getEpoch());
+  retrievalsRejected.add();
+  return true; // Card retrieval rejected successfully
 }
 
 bool Server::setVerificationType(const string &username, const string &passwd,
                                  UserInfo::VerificationType type) {
-  if (!checkUser(username, passwd)) {
+  unique_lock lock(userMutex);
+  long long id = authUser(username, passwd);
+  if (id == -1) {
     return false; // User does not exist or password does not match
   }
-  if (userInfo[userId[username]].cardFoundCount) {
+  if (users[id].cardFoundCount) {
     return false; // Cannot change verification type while cards are found
   }
-  long long id = userId[username];
-  this->userInfo[id].verificationType = type; // Set the verification type
+  users[id].verificationType = type; // Set the verification type
+  logMutation(BINARY_TAG_LOG_VERIFICATION_TYPE, [&](BinaryWriter &entry) {
+    entry.writeString(username);
+    entry.writeString(passwd);
+    entry.writeVarint(type);
+  });
   return true; // Verification type set successfully
 }
 
 bool Server::checkUser(const string &username, const string &passwd) const {
-  auto it = userId.find(username);
-  if (it == userId.end()) {
-    return false; // Username not found
+  checkUserCalls.add();
+  shared_lock lock(userMutex);
+  if (authUser(username, passwd) == -1) {
+    checkUserFailures.add();
+    return false;
   }
-  long long id = it->second;
-  auto userIt = this->userInfo.find(id);
-  return userIt != this->userInfo.end() && userIt->second.passwd == passwd;
+  return true;
 }
 
 string Server::getNickname(const string &username) const {
-  auto it = userId.find(username);
-  if (it == userId.end()) {
+  shared_lock lock(userMutex);
+  long long id = findUserId(username);
+  if (id == -1) {
     return ""; // Username not found
   }
-  long long id = it->second;
-  return userInfo.at(id).nickname;
+  return users[id].nickname;
 }
 
 bool Server::addCard(const string &username, const string &passwd,
                      const string &cardId) {
-  if (!checkUser(username, passwd)) {
+  long long id;
+  {
+    shared_lock userLock(userMutex);
+    id = authUser(username, passwd);
+  }
+  if (id == -1) {
     return false; // User does not exist or password does not match
   }
-  long long id = userId[username];
-  cardOwnerId[cardId] = id; // Map card ID to user ID
-  return true;              // Card added successfully
+  CardShard &shard = cardShard(cardId);
+  unique_lock lock(shard.mutex);
+  findRecord(shard, cardId);          // Decode a cold record before updating
+  shard.records[cardId].ownerId = id; // Map card ID to user ID
+  logMutation(BINARY_TAG_LOG_ADD_CARD, [&](BinaryWriter &entry) {
+    entry.writeString(username);
+    entry.writeString(passwd);
+    entry.writeString(cardId);
+  });
+  return true; // Card added successfully
 }
 
 bool Server::notifyCardFound(const string &cardId, const Labeled_GPS &gps,
                              const string &username, int reward) {
-  static bool seeded = false;
-  if (!seeded) {
-    srand(time(nullptr)); // Seed the random number generator
-    seeded = true;
-  }
+  ScopedLatency latency(cardFoundLatency);
+  seedRandom(); // Seed the random number generator
 
   // Check if the card ID exists in the mapping
-  auto it = cardOwnerId.find(cardId);
-  if (it == cardOwnerId.end()) {
+  CardShard &shard = cardShard(cardId);
+  unique_lock lock(shard.mutex);
+  CardRecord *recordPtr = findRecord(shard, cardId);
+  if (recordPtr == nullptr) {
     return false; // Card ID not found
   }
+  CardRecord &record = *recordPtr;
+  shared_lock userLock(userMutex);
 
   // Create a FindInfo object
   FindInfo findInfo;
 
   if (!username.empty()) {
-    if (auto userIt = userId.find(username); userIt == userId.end()) {
+    if (long long finderId = findUserId(username); finderId == -1) {
       return false; // Error: Username not found
     } else {
-      findInfo.finderId = userIt->second; // Set finder ID from username
-      findInfo.reward = reward;           // Set reward for finding the card
+      findInfo.finderId = finderId; // Set finder ID from username
+      findInfo.reward = reward;     // Set reward for finding the card
     }
   }
   findInfo.gps = gps;            // Set GPS location where the card was found
-  findInfo.time = Env::getNow(); // Set the current time
+  findInfo.time = clock->now(); // Set the current time
 
   // Notify the owner of the card
-  long long ownerId = it->second;
+  long long ownerId = record.ownerId;
+  UserInfo &owner = users[ownerId];
   string body = "Your card with ID " + cardId +
                 " has been found at location: " + gps.label + "( " +
                 to_string(gps.latitude) + ", " + to_string(gps.longitude) +
                 " )."; // Create notification body with GPS info"
   // Notify the owner of the card
-  if (userInfo[ownerId].verificationType == UserInfo::EMAIL) {
+  if (owner.verificationType == UserInfo::EMAIL) {
     // Generate a random verification code
     int verificationCode = rand() % 1000000; // Random 6-digit code
     body += "\nVerification Code: " + to_string(verificationCode) +
@@ -170,34 +428,64 @@ bool Server::notifyCardFound(const string &cardId, const Labeled_GPS &gps,
     notifyUser(ownerId, "Your Card is Found", body, cardId);
   }
 
-  userInfo[ownerId].cardFoundCount++; // Increment card found count
-  cardFindInfo[cardId] = findInfo;
+  owner.cardFoundCount++; // Increment card found count
+  record.findInfo = findInfo;
+  logMutation(BINARY_TAG_LOG_CARD_FOUND, [&](BinaryWriter &entry) {
+    entry.writeString(cardId);
+    entry.writeString(username);
+    entry.writeTime(findInfo.time);
+    entry.writeGPS(findInfo.gps);
+    entry.writeSigned(findInfo.reward);
+    entry.writeSigned(findInfo.verificationCode);
+  });
+  scheduleFindExpiry(cardId, findInfo.time.getEpoch());
+  cardsFound.add();
   return true; // Notification sent successfully
 }
 
 bool Server::notifyCardRetrieved(const string &cardId, int verificationCode) {
+  ScopedLatency latency(cardRetrievedLatency);
+  trimLedgerIfLong();
   // Check if the card ID exists in the mapping
-  auto findIt = cardFindInfo.find(cardId);
-  if (findIt == cardFindInfo.end()) {
+  CardShard &shard = cardShard(cardId);
+  unique_lock lock(shard.mutex);
+  CardRecord *recordPtr = findRecord(shard, cardId);
+  if (recordPtr == nullptr || !recordPtr->findInfo) {
     return false; // Card ID not found
   }
+  CardRecord &record = *recordPtr;
+  shared_lock userLock(userMutex);
 
   // Get the find info for the card
-  FindInfo &findInfo = findIt->second;
+  FindInfo &findInfo = *record.findInfo;
 
-  long long ownerId = cardOwnerId[cardId];
-  if (userInfo[ownerId].verificationType == UserInfo::EMAIL &&
+  long long ownerId = record.ownerId;
+  UserInfo &owner = users[ownerId];
+  if (owner.verificationType == UserInfo::EMAIL &&
       findInfo.verificationCode != verificationCode) {
     return false; // Verification code does not match
-  } else if (userInfo[ownerId].verificationType == UserInfo::APP) {
-    long long correctCode = Utils::generateVerificationCode(
-
-        secret2FA[userInfo[ownerId].id], mktime(Env::getNow().getStdTM()));
-    if (correctCode != verificationCode) {
-      return false; // No finder ID available for app verification
+  } else if (owner.verificationType == UserInfo::APP) {
+    if (!TotpEngine::local().verify(secret2FA[owner.id],
+                                    clock->now().getEpoch(), verificationCode,
+                                    totpWindow)) {
+      return false; // The code of the app does not match
     }
   }
 
+  {
+    // The finder's stripe is held until the retrieval is logged, so a
+    // redemption spending the reward is always logged after it
+    unique_lock<mutex> ledgerLock;
+    if (findInfo.finderId != -1) {
+      ledgerLock = unique_lock(ledgerStripe(findInfo.finderId));
+      if (!rewardLedger.credit(findInfo.finderId, findInfo.reward)) {
+        rewardsRefused.add();
+        return false; // The ledger is full, the card stays found
+      }
+    }
+    logMutation(BINARY_TAG_LOG_CARD_RETRIEVED,
+                [&](BinaryWriter &entry) { entry.writeString(cardId); });
+  }
   // Notify the owner of the card
   notifyUser(ownerId, "Your Card is Retrieved",
              "Your card with ID " + cardId + " has been retrieved.");
@@ -206,76 +494,136 @@ bool Server::notifyCardRetrieved(const string &cardId, int verificationCode) {
     notifyUser(
         findInfo.finderId, "Card Retrieved",
         "The card you found has been retrieved. Thank you for your help!");
-    rewardBalance[findInfo.finderId] += findInfo.reward; // Add reward
   }
 
   // Remove the find info for the card
-  cardFindInfo.erase(findIt);
-  userInfo[ownerId].cardFoundCount--; // Decrement card found count
-  return true;                        // Notification sent successfully
+  record.findInfo.reset();
+  owner.cardFoundCount--; // Decrement card found count
+  cardsRetrieved.add();
+  return true; // Notification sent successfully
 }
 
 const FindInfo *Server::findInfo(const string &cardId) const {
-  auto it = cardFindInfo.find(cardId);
-  if (it == cardFindInfo.end()) {
+  const CardShard &shard = cardShard(cardId);
+  const CardRecord *record = nullptr;
+  {
+    shared_lock lock(shard.mutex);
+    auto it = shard.records.find(cardId);
+    if (it != shard.records.end()) {
+      record = &it->second;
+    } else if (shard.cold.empty()) {
+      return nullptr; // Card ID not found, return nullptr
+    }
+  }
+  if (record == nullptr) {
+    unique_lock lock(shard.mutex); // Decoding a cold record writes the shard
+    record = findRecord(shard, cardId);
+  }
+  if (record == nullptr || !record->findInfo) {
     return nullptr; // Card ID not found, return nullptr
   }
-  return &it->second; // Return the find info for the card
+  return &*record->findInfo; // Return the find info for the card
 }
 int Server::getBalance(const string &username, const string &password) const {
-  if (!checkUser(username, password)) {
+  shared_lock lock(userMutex);
+  long long id = authUser(username, password);
+  if (id == -1) {
     return -1;
   }
-  return rewardBalance.at(userId.at(username)); // Return the user's balance
+  return rewardLedger.balance(id).value_or(0); // Return the user's balance
 }
 
 int Server::redeemReward(const string &username, const string &password,
                          int amount) {
-  if (!checkUser(username, password)) {
+  trimLedgerIfLong();
+  shared_lock lock(userMutex);
+  long long id = authUser(username, password);
+  if (id == -1) {
     return -1; // User does not exist or password does not match
   }
-  long long id = userId[username];
-  if (amount < 0) {
-    amount = rewardBalance[id]; // Redeem all available rewards
+  lock_guard ledgerLock(ledgerStripe(id));
+  // Redeem all available rewards if amount < 0, -1 if not enough balance
+  bool opened = rewardLedger.balance(id).has_value();
+  long long taken = rewardLedger.debit(id, amount);
+  // Even a failed redemption opens the account, which the log must repeat
+  if (taken > 0 || !opened) {
+    logMutation(BINARY_TAG_LOG_REDEEM_REWARD, [&](BinaryWriter &entry) {
+      entry.writeString(username);
+      entry.writeSigned(max(taken, 0LL));
+    });
+  }
+  if (taken > 0) {
+    rewardsRedeemed.add();
+  }
+  return taken;
+}
+
+const Ledger &Server::getRewardLedger() const { return rewardLedger; }
+
+mutex &Server::ledgerStripe(long long userId) {
+  return ledgerStripes[userId & (LEDGER_STRIPE_COUNT - 1)];
+}
+
+void Server::trimLedgerIfLong() {
+  if (rewardLedger.transactionCount() < ledgerTrimSize.load()) {
+    return;
   }
-  if (rewardBalance[id] < amount) {
-    return -1; // Not enough balance to redeem
+  unique_lock lock(userMutex);
+  if (rewardLedger.transactionCount() >= ledgerTrimSize.load()) {
+    // Trimming passes over every account, waiting for the log to double
+    // keeps it O(1) per transaction
+    rewardLedger.trim();
+    ledgerTrimSize.store(
+        max(MIN_LEDGER_TRIM_SIZE, 2 * rewardLedger.transactionCount()));
   }
-  rewardBalance[id] -= amount; // Deduct the redeemed amount
-  return amount;               // Return the remaining balance
 }
 
+RateLimiter &Server::getAttemptLimiter() { return attemptLimiter; }
+
 pair<long long, long long> Server::setup2FA(const string &username) {
   // Generate a random verification code
-  static bool seeded = false;
-  if (!seeded) {
-    srand(time(nullptr)); // Seed the random number generator
-    seeded = true;
-  }
-  if (userId.find(username) == userId.end()) {
+  seedRandom(); // Seed the random number generator
+  unique_lock lock(userMutex);
+  long long uid = findUserId(username);
+  if (uid == -1) {
     return make_pair(-1, -1); // User does not exist
   }
-  if (userInfo[userId[username]].verificationType != UserInfo::APP) {
+  if (users[uid].verificationType != UserInfo::APP) {
     return make_pair(-1, -1); // 2FA is not set up for this user
   }
   long long id = secret2FA.size();       // Use the index as the ID for 2FA
-  userInfo[userId[username]].id = id;    // Set the ID in user info
+  users[uid].id = id;                    // Set the ID in user info
   long long secret = rand() % 100000000; // Random 8-digit code
   secret2FA.push_back(secret);
+  logMutation(BINARY_TAG_LOG_SETUP_2FA, [&](BinaryWriter &entry) {
+    entry.writeString(username);
+    entry.writeSigned(id);
+    entry.writeSigned(secret);
+  });
   return make_pair(id, secret); // Return the ID and secret key
 }
 
-Json::Value *
-Server::dumpCard2JSON(const pair<string, long long> cardPair) const {
+pair<long long, long long> Server::get2FA(const string &username) const {
+  shared_lock lock(userMutex);
+  long long uid = findUserId(username);
+  if (uid == -1 || users[uid].verificationType != UserInfo::APP ||
+      users[uid].id == -1) {
+    return make_pair(-1, -1); // No 2FA set up for this user
+  }
+  return make_pair(users[uid].id, secret2FA[users[uid].id]);
+}
+
+Json::Value *Server::dumpCard2JSON(const string &cardId,
+                                   const CardRecord &record) const {
   Json::Value *json = new Json::Value();
-  (*json)["id"] = cardPair.first; // Card ID
-  (*json)["ownerUsername"] = userInfo.at(cardPair.second).username;
-  if (cardFindInfo.find(cardPair.first) != cardFindInfo.end()) {
+  (*json)["id"] = cardId; // Card ID
+  (*json)["ownerUsername"] = users[record.ownerId].username;
+  if (record.findInfo) {
     (*json)["findInfo"] = Json::Value(Json::objectValue);
-    const FindInfo &findInfo = cardFindInfo.at(cardPair.first);
+    const FindInfo &findInfo = *record.findInfo;
     (*json)["findInfo"]["reward"] = findInfo.reward;
-    (*json)["findInfo"]["gps"] = *findInfo.gps.dump2JSON();
-    (*json)["findInfo"]["time"] = *findInfo.time.dump2JSON();
+    (*json)["findInfo"]["gps"] = adoptJSON(findInfo.gps.dump2JSON());
+    (*json)["findInfo"]["time"] = adoptJSON(findInfo.time.dump2JSON());
     if (findInfo.verificationCode != -1) {
       (*json)["findInfo"]["verificationCode"] = findInfo.verificationCode;
     }
@@ -333,11 +681,17 @@ Json::Value *Server::dump2JSON() const {
   (*json)["address"] = address;
   (*json)["emailPassword"] = emailPasswd;
 
+  vector<shared_lock<shared_mutex>> shardLocks;
+  for (const CardShard &shard : cardShards) {
+    shardLocks.emplace_back(shard.mutex);
+  }
+  shared_lock userLock(userMutex);
+
   // Dump user information
   (*json)["users"] = Json::Value(Json::objectValue);
   for (const auto &user : userId) {
     Json::Value userJson;
-    const auto &userInfo = this->userInfo.at(user.second);
+    const UserInfo &userInfo = users[user.second];
     userJson["password"] = userInfo.passwd;
     userJson["email"] = userInfo.email;
     userJson["nickname"] = userInfo.nickname;
@@ -346,23 +700,25 @@ Json::Value *Server::dump2JSON() const {
     } else if (userInfo.verificationType == UserInfo::APP) {
       userJson["verificationType"] = "APP";
     }
-    if (rewardBalance.find(user.second) != rewardBalance.end()) {
-      userJson["rewardBalance"] =
-          (Json::Value::Int64)rewardBalance.at(user.second);
+    if (optional<long long> balance = rewardLedger.balance(user.second)) {
+      userJson["rewardBalance"] = (Json::Value::Int64)*balance;
     }
     (*json)["users"][user.first] = userJson;
   }
 
-  // Dump card information
+  // Dump card information, sorted by card ID
   (*json)["cards"] = Json::Value(Json::arrayValue);
   (*json)["rejectCards"] = Json::Value(Json::arrayValue);
-  for (const auto &card : cardOwnerId) {
-    // card.first is the card ID, card.second is the owner ID
-    if (cardFindInfo.find(card.first) != cardFindInfo.end()) {
-      (*json)["cards"].append(*dumpCard2JSON(card));
+  CardRecord scratch;
+  for (const DumpedCard &card : sortedCards()) {
+    const CardRecord &record = card.get(scratch);
+    if (record.findInfo) {
+      (*json)["cards"].append(
+          adoptJSON(dumpCard2JSON(string(card.id), record)));
     }
-    if (cardRejectInfo.find(card.first) != cardRejectInfo.end()) {
-      (*json)["rejectCards"].append(*dumpCard2JSON(card));
+    if (record.rejectInfo) {
+      (*json)["rejectCards"].append(
+          adoptJSON(dumpCard2JSON(string(card.id), record)));
     }
   }
 
@@ -389,20 +745,18 @@ void Server::JSON2Object(const Json::Value *arg_json_ptr) {
                       "emailPassword")) {
     tmpEmailPasswd = (*arg_json_ptr)["emailPassword"].asString();
   }
-  // A temporary map to store data during JSON parsing
-  map<string, long long> tmpUserId;
-  map<long long, UserInfo> tmpUserInfo;
-  map<string, long long> tmpCardOwnerId;
-  map<string, FindInfo> tmpCardFindInfo;
-  map<long long, long long> tmpRewardBalance;
-  long long tmpNextId = 0;
+  // A temporary registry to store data during JSON parsing
+  unordered_map<string, long long> tmpUserId;
+  vector<UserInfo> tmpUserInfo;
+  vector<pair<long long, long long>> tmpRewardBalance;
+  unordered_map<string, CardRecord> tmpCards;
   // Extract user information
   if (!exceptionCheck(Object, (*arg_json_ptr)["users"], "users")) {
     const Json::Value &users = (*arg_json_ptr)["users"];
     for (const auto &user : users.getMemberNames()) {
-      long long id = tmpNextId++; // Assign a new ID for the user
-      tmpUserId[user] = id;       // Map username to user ID
-      tmpUserInfo[id].username = user;
+      long long id = tmpUserInfo.size(); // Assign a new ID for the user
+      tmpUserId[user] = id;              // Map username to user ID
+      tmpUserInfo.emplace_back().username = user;
       // password
       if (!exceptionCheck(String, users[user]["password"],
                           "users." + user + ".password")) {
@@ -422,8 +776,8 @@ void Server::JSON2Object(const Json::Value *arg_json_ptr) {
       if (users[user].isMember("rewardBalance")) {
         if (!exceptionCheck(Integer, users[user]["rewardBalance"],
                             "users." + user + ".rewardBalance")) {
-          tmpRewardBalance[id] =
-              users[user]["rewardBalance"].asInt64(); // Set reward balance
+          tmpRewardBalance.emplace_back(
+              id, users[user]["rewardBalance"].asInt64()); // Set reward balance
         }
       }
       // verification type
@@ -462,7 +816,7 @@ void Server::JSON2Object(const Json::Value *arg_json_ptr) {
 
           if (tmpUserId.find(ownerUsername) != tmpUserId.end()) {
             long long ownerId = tmpUserId[ownerUsername];
-            tmpCardOwnerId[cardId] = ownerId;
+            tmpCards[cardId].ownerId = ownerId;
           } else {
             // wrong ownerUsername, throw an exception
             Exception_Info *ei_ptr = new Exception_Info{};
@@ -479,8 +833,9 @@ void Server::JSON2Object(const Json::Value *arg_json_ptr) {
           if (!exceptionCheck(Object, card["findInfo"], "cards[].findInfo")) {
             FindInfo findInfo;
             const Json::Value &findJson = card["findInfo"];
-            // find name
-            if (!exceptionCheck(String, findJson["finderName"],
+            // find name, left out by dump2JSON
+            if (findJson.isMember("finderName") &&
+                !exceptionCheck(String, findJson["finderName"],
                                 "cards[].findInfo.finderName")) {
               std::string finderName = findJson["finderName"].asString();
               if (tmpUserId.find(finderName) != tmpUserId.end()) {
@@ -498,11 +853,42 @@ void Server::JSON2Object(const Json::Value *arg_json_ptr) {
               }
             }
             JSON2FindInfo(&findJson, findInfo);
+            CardRecord &record = tmpCards[cardId];
+            record.findInfo = findInfo;
+            if (record.ownerId != -1) {
+              tmpUserInfo[record.ownerId].cardFoundCount++;
+            }
           }
         }
       }
     }
   }
+  // Extract rejected cards, dump2JSON only keeps their owners
+  if (arg_json_ptr->isMember("rejectCards") &&
+      !exceptionCheck(Array, (*arg_json_ptr)["rejectCards"], "rejectCards")) {
+    for (const auto &card : (*arg_json_ptr)["rejectCards"]) {
+      if (exceptionCheck(String, card["id"], "rejectCards[].id") ||
+          exceptionCheck(String, card["ownerUsername"],
+                         "rejectCards[].ownerUsername")) {
+        continue;
+      }
+      std::string ownerUsername = card["ownerUsername"].asString();
+      auto owner = tmpUserId.find(ownerUsername);
+      if (owner == tmpUserId.end()) {
+        Exception_Info *ei_ptr = new Exception_Info{};
+        ei_ptr->where_code = EE1520_ERROR_JSON2OBJECT_SERVER;
+        ei_ptr->which_string = "rejectCards[].ownerUsername: " + ownerUsername;
+        ei_ptr->how_code = EE1520_ERROR_NORMAL;
+        ei_ptr->what_code = EE1520_ERROR_USER_NOT_FOUND;
+
+        lv_exception_ptr->info_vector.push_back(ei_ptr);
+        continue;
+      }
+      CardRecord &record = tmpCards[card["id"].asString()];
+      record.ownerId = owner->second;
+      record.rejectInfo = FindInfo();
+    }
+  }
 #undef exceptionCheck
   if ((lv_exception_ptr->info_vector.size() != 0)) {
     throw(*lv_exception_ptr); // Throw exception if there are errors
@@ -511,13 +897,531 @@ void Server::JSON2Object(const Json::Value *arg_json_ptr) {
     emailServer->removeAddress(address, emailPasswd);
   }
   // Assign the parsed data to the server's member variables
+  vector<unique_lock<shared_mutex>> shardLocks;
+  for (CardShard &shard : cardShards) {
+    shardLocks.emplace_back(shard.mutex);
+    shard.records.clear();
+    shard.cold.clear();
+  }
+  for (auto &card : tmpCards) {
+    cardShard(card.first).records.insert(std::move(card));
+  }
+  snapshot.reset();
+  unique_lock userLock(userMutex);
+  swap(userId, tmpUserId);
+  swap(this->users, tmpUserInfo);
+  rewardLedger.clear();
+  for (const auto &balance : tmpRewardBalance) {
+    rewardLedger.open(balance.first, balance.second);
+  }
+  address = tmpAddress;
+  emailPasswd = tmpEmailPasswd;
+  emailServer->addAddress(address, emailPasswd);
+}
+
+void Server::dump2Binary(BinaryWriter &writer) const {
+  vector<shared_lock<shared_mutex>> shardLocks;
+  for (const CardShard &shard : cardShards) {
+    shardLocks.emplace_back(shard.mutex);
+  }
+  shared_lock userLock(userMutex);
+
+  writer.beginRecord(BINARY_TAG_SERVER);
+  writer.writeString(address);
+  writer.writeString(emailPasswd);
+  // Users in id order, so the ids in card records stay valid. Removed users
+  // keep their slot with an empty username.
+  writer.writeVarint(users.size());
+  for (size_t id = 0; id < users.size(); id++) {
+    const UserInfo &userInfo = users[id];
+    writer.beginRecord(BINARY_TAG_SERVER_USER);
+    writer.writeString(userInfo.username);
+    writer.writeString(userInfo.passwd);
+    writer.writeString(userInfo.email);
+    writer.writeString(userInfo.nickname);
+    writer.writeVarint(userInfo.verificationType);
+    optional<long long> balance = rewardLedger.balance(id);
+    writer.writeBool(balance.has_value());
+    writer.writeSigned(balance.value_or(0));
+    writer.writeSigned(userInfo.id);
+    writer.endRecord();
+  }
+
+  // Card records sorted by card ID, so equal states give equal files. Cold
+  // records are decoded and written again, their strings are indexes into
+  // the string table of the snapshot
+  vector<DumpedCard> cards = sortedCards();
+  writer.writeVarint(cards.size());
+  CardRecord scratch;
+  for (const DumpedCard &card : cards) {
+    const CardRecord &record = card.get(scratch);
+    writer.beginRecord(BINARY_TAG_CARD_RECORD);
+    writer.writeString(string(card.id));
+    writer.writeSigned(record.ownerId);
+    writer.writeBool(record.findInfo.has_value());
+    writer.writeBool(record.rejectInfo.has_value());
+    if (record.findInfo) {
+      writeFindInfo(writer, BINARY_TAG_FIND_INFO, *record.findInfo);
+    }
+    if (record.rejectInfo) {
+      writeFindInfo(writer, BINARY_TAG_REJECT_INFO, *record.rejectInfo);
+    }
+    writer.endRecord();
+  }
+  writer.writeVarint(checkpointId);
+  // App 2FA secrets by id, the ones no user points to any more included so
+  // that ids handed out later do not change
+  writer.writeVarint(secret2FA.size());
+  for (long long secret : secret2FA) {
+    writer.writeSigned(secret);
+  }
+  writer.endRecord();
+}
+
+void Server::Binary2Object(BinaryReader &reader,
+                           shared_ptr<const BinarySnapshot> snapshot) {
+  BinaryReader payload = reader.expectRecord(BINARY_TAG_SERVER);
+  string tmpAddress(payload.readString());
+  string tmpEmailPasswd(payload.readString());
+  // A temporary registry, swapped in once the whole record is read
+  unordered_map<string, long long> tmpUserId;
+  vector<UserInfo> tmpUserInfo;
+  vector<pair<long long, long long>> tmpRewardBalance;
+  unordered_map<string, CardRecord> tmpCards;
+  array<vector<ColdCard>, CARD_SHARD_COUNT> tmpCold;
+
+  uint64_t userCount = payload.readVarint();
+  if (userCount > Ledger::MAX_ACCOUNTS) {
+    throwBinaryFormatError("too many users");
+  }
+  tmpUserInfo.reserve(userCount);
+  for (uint64_t id = 0; id < userCount; id++) {
+    BinaryReader userPayload = payload.expectRecord(BINARY_TAG_SERVER_USER);
+    UserInfo &userInfo = tmpUserInfo.emplace_back();
+    userInfo.username = userPayload.readString();
+    userInfo.passwd = userPayload.readString();
+    userInfo.email = userPayload.readString();
+    userInfo.nickname = userPayload.readString();
+    userInfo.verificationType = userPayload.readVarint() == UserInfo::APP
+                                    ? UserInfo::APP
+                                    : UserInfo::EMAIL;
+    bool hasBalance = userPayload.readBool();
+    long long balance = userPayload.readSigned();
+    // Missing in snapshots written before 2FA secrets were kept
+    userInfo.id = userPayload.atEnd() ? -1 : userPayload.readSigned();
+    if (!userInfo.username.empty()) {
+      tmpUserId[userInfo.username] = id;
+    }
+    if (hasBalance) {
+      tmpRewardBalance.emplace_back(id, balance);
+    }
+  }
+
+  uint64_t cardCount = payload.readVarint();
+  if (!snapshot) {
+    tmpCards.reserve(cardCount);
+  }
+  for (uint64_t i = 0; i < cardCount; i++) {
+    BinaryReader cardPayload = payload.expectRecord(BINARY_TAG_CARD_RECORD);
+    string_view cardId;
+    long long ownerId;
+    bool isFound;
+    if (snapshot) {
+      // Only read the head of the record, the rest is decoded on access
+      BinaryReader head = cardPayload;
+      cardId = head.readString();
+      ownerId = head.readSigned();
+      isFound = head.readBool();
+      size_t shard = hash<string_view>{}(cardId) & (CARD_SHARD_COUNT - 1);
+      tmpCold[shard].push_back({cardId, cardPayload});
+    } else {
+      CardRecord record = readCardRecord(cardPayload, cardId);
+      ownerId = record.ownerId;
+      isFound = record.findInfo.has_value();
+      tmpCards[string(cardId)] = std::move(record);
+    }
+    if (ownerId < -1 || ownerId >= (long long)userCount) {
+      throwBinaryFormatError("card owner out of range: " + string(cardId));
+    }
+    if (isFound && ownerId != -1) {
+      tmpUserInfo[ownerId].cardFoundCount++;
+    }
+  }
+  // Missing in snapshots written before checkpoints were logged
+  uint64_t tmpCheckpointId = payload.atEnd() ? 0 : payload.readVarint();
+  vector<long long> tmpSecret2FA;
+  if (!payload.atEnd()) {
+    // Not reserved ahead, a corrupt count fails at the end of the payload
+    uint64_t secretCount = payload.readVarint();
+    for (uint64_t i = 0; i < secretCount; i++) {
+      tmpSecret2FA.push_back(payload.readSigned());
+    }
+  }
+  for (UserInfo &userInfo : tmpUserInfo) {
+    if (userInfo.id < -1 || userInfo.id >= (long long)tmpSecret2FA.size()) {
+      throwBinaryFormatError("2FA id out of range: " + userInfo.username);
+    }
+  }
+  // Written sorted by id, so this only sorts if the file was not
+  auto byId = [](const ColdCard &a, const ColdCard &b) { return a.id < b.id; };
+  for (vector<ColdCard> &cold : tmpCold) {
+    if (!is_sorted(cold.begin(), cold.end(), byId)) {
+      sort(cold.begin(), cold.end(), byId);
+    }
+  }
+
+  if (!address.empty() && !emailPasswd.empty()) {
+    emailServer->removeAddress(address, emailPasswd);
+  }
+  // Assign the parsed data to the server's member variables
+  vector<unique_lock<shared_mutex>> shardLocks;
+  for (size_t i = 0; i < CARD_SHARD_COUNT; i++) {
+    shardLocks.emplace_back(cardShards[i].mutex);
+    cardShards[i].records.clear();
+    swap(cardShards[i].cold, tmpCold[i]);
+  }
+  for (auto &card : tmpCards) {
+    cardShard(card.first).records.insert(std::move(card));
+  }
+  swap(this->snapshot, snapshot);
+  checkpointId = tmpCheckpointId;
+  unique_lock userLock(userMutex);
   swap(userId, tmpUserId);
-  swap(userInfo, tmpUserInfo);
-  swap(cardOwnerId, tmpCardOwnerId);
-  swap(cardFindInfo, tmpCardFindInfo);
-  swap(rewardBalance, tmpRewardBalance);
-  nextId = tmpNextId;
+  swap(this->users, tmpUserInfo);
+  swap(secret2FA, tmpSecret2FA);
+  rewardLedger.clear();
+  for (const auto &balance : tmpRewardBalance) {
+    rewardLedger.open(balance.first, balance.second);
+  }
   address = tmpAddress;
   emailPasswd = tmpEmailPasswd;
   emailServer->addAddress(address, emailPasswd);
 }
+
+void Server::setClock(const Clock *serverClock) { clock = serverClock; }
+
+const Clock &Server::getClock() const { return *clock; }
+
+void Server::setTotpWindow(int steps) { totpWindow = max(steps, 0); }
+
+void Server::setExpiryPolicy(const ExpiryPolicy &policy) {
+  expiry = policy;
+  // The timers of an earlier policy would fire along with the new ones
+  timers.clear();
+  if (expirySince < 0) {
+    expirySince = clock->now().getEpoch();
+  }
+  for (CardShard &shard : cardShards) {
+    shared_lock lock(shard.mutex);
+    for (const auto &[cardId, record] : shard.records) {
+      if (record.findInfo) {
+        scheduleFindExpiry(cardId, record.findInfo->time.getEpoch());
+      }
+      if (record.rejectInfo) {
+        long long rejectedAt =
+            record.rejectedAt >= 0 ? record.rejectedAt : expirySince;
+        scheduleRejectExpiry(cardId, rejectedAt,
+                             record.rejectInfo->time.getEpoch());
+      }
+    }
+    // Cold records stay in the snapshot, only the times are read from them
+    for (const ColdCard &card : shard.cold) {
+      string cardId(card.id);
+      if (shard.records.count(cardId) > 0) {
+        continue; // Decoded already, scheduled above
+      }
+      optional<long long> foundAt, rejectFoundAt;
+      readCardTimes(card.payload, foundAt, rejectFoundAt);
+      if (foundAt) {
+        scheduleFindExpiry(cardId, *foundAt);
+      }
+      if (rejectFoundAt) {
+        scheduleRejectExpiry(cardId, expirySince, *rejectFoundAt);
+      }
+    }
+  }
+}
+
+const ExpiryPolicy &Server::getExpiryPolicy() const { return expiry; }
+
+size_t Server::runTimers() { return timers.advance(clock->now().getEpoch()); }
+
+void Server::scheduleFindExpiry(const string &cardId, long long foundAt) {
+  if (expiry.remindAfter > 0) {
+    timers.schedule(foundAt + expiry.remindAfter,
+                    [this, cardId, foundAt] { remindOwner(cardId, foundAt); });
+  }
+  if (expiry.rejectAfter > 0) {
+    timers.schedule(foundAt + expiry.rejectAfter,
+                    [this, cardId, foundAt] { expireFind(cardId, foundAt); });
+  }
+}
+
+void Server::scheduleRejectExpiry(const string &cardId, long long rejectedAt,
+                                  long long foundAt) {
+  if (expiry.forgetAfter > 0) {
+    timers.schedule(rejectedAt + expiry.forgetAfter,
+                    [this, cardId, foundAt] { forgetReject(cardId, foundAt); });
+  }
+}
+
+void Server::remindOwner(const string &cardId, long long foundAt) {
+  CardShard &shard = cardShard(cardId);
+  unique_lock lock(shard.mutex);
+  CardRecord *record = findRecord(shard, cardId);
+  if (record == nullptr || !record->findInfo ||
+      record->findInfo->time.getEpoch() != foundAt) {
+    return; // Retrieved or rejected since
+  }
+  shared_lock userLock(userMutex);
+  notifyUser(record->ownerId, "Your Card is Waiting",
+             "Your card with ID " + cardId + " found at " +
+                 record->findInfo->gps.label +
+                 " has not been retrieved yet.",
+             cardId);
+  remindersSent.add();
+}
+
+void Server::expireFind(const string &cardId, long long foundAt) {
+  CardShard &shard = cardShard(cardId);
+  unique_lock lock(shard.mutex);
+  CardRecord *record = findRecord(shard, cardId);
+  if (record == nullptr || !record->findInfo ||
+      record->findInfo->time.getEpoch() != foundAt) {
+    return; // Retrieved or rejected since
+  }
+  shared_lock userLock(userMutex);
+  // As if the owner rejected it, the verification code goes with it
+  record->rejectInfo = record->findInfo;
+  record->findInfo.reset();
+  record->rejectedAt = clock->now().getEpoch();
+  if (record->ownerId >= 0 && record->ownerId < (long long)users.size()) {
+    users[record->ownerId].cardFoundCount--;
+  }
+  notifyUser(record->ownerId, "Your Card is Rejected",
+             "Your card with ID " + cardId +
+                 " was not retrieved in time, its retrieval is rejected.");
+  logMutation(BINARY_TAG_LOG_EXPIRE_FIND,
+              [&](BinaryWriter &entry) { entry.writeString(cardId); });
+  scheduleRejectExpiry(cardId, record->rejectedAt, foundAt);
+  findsExpired.add();
+}
+
+void Server::forgetReject(const string &cardId, long long foundAt) {
+  CardShard &shard = cardShard(cardId);
+  unique_lock lock(shard.mutex);
+  CardRecord *record = findRecord(shard, cardId);
+  if (record == nullptr || !record->rejectInfo ||
+      record->rejectInfo->time.getEpoch() != foundAt) {
+    return; // Rejected again since
+  }
+  record->rejectInfo.reset();
+  logMutation(BINARY_TAG_LOG_FORGET_REJECT,
+              [&](BinaryWriter &entry) { entry.writeString(cardId); });
+  rejectsForgotten.add();
+}
+
+void Server::attachLog(WriteAheadLog *writeAheadLog) { log = writeAheadLog; }
+
+void Server::applyLogEntry(uint64_t tag, BinaryReader &payload) {
+  switch (tag) {
+  case BINARY_TAG_LOG_ADD_USER: {
+    string username(payload.readString());
+    string passwd(payload.readString());
+    string emailAddr(payload.readString());
+    string nickname(payload.readString());
+    addUser(username, passwd, emailAddr, nickname);
+    break;
+  }
+  case BINARY_TAG_LOG_REMOVE_USER: {
+    string username(payload.readString());
+    string passwd(payload.readString());
+    removeUser(username, passwd);
+    break;
+  }
+  case BINARY_TAG_LOG_VERIFICATION_TYPE: {
+    string username(payload.readString());
+    string passwd(payload.readString());
+    UserInfo::VerificationType type = payload.readVarint() == UserInfo::APP
+                                          ? UserInfo::APP
+                                          : UserInfo::EMAIL;
+    setVerificationType(username, passwd, type);
+    break;
+  }
+  case BINARY_TAG_LOG_ADD_CARD: {
+    string username(payload.readString());
+    string passwd(payload.readString());
+    string cardId(payload.readString());
+    addCard(username, passwd, cardId);
+    break;
+  }
+  case BINARY_TAG_LOG_REJECT_RETRIEVE: {
+    string username(payload.readString());
+    string passwd(payload.readString());
+    string cardId(payload.readString());
+    rejectRetrieve(username, passwd, cardId);
+    break;
+  }
+  case BINARY_TAG_LOG_CARD_FOUND: {
+    string cardId(payload.readString());
+    string finderName(payload.readString());
+    FindInfo findInfo;
+    findInfo.time = payload.readTime();
+    findInfo.gps = payload.readGPS();
+    findInfo.reward = (int)payload.readSigned();
+    findInfo.verificationCode = (int)payload.readSigned();
+    CardShard &shard = cardShard(cardId);
+    unique_lock lock(shard.mutex);
+    CardRecord *record = findRecord(shard, cardId);
+    if (record == nullptr) {
+      break;
+    }
+    shared_lock userLock(userMutex);
+    if (!finderName.empty()) {
+      findInfo.finderId = findUserId(finderName);
+    }
+    if (record->ownerId >= 0 && record->ownerId < (long long)users.size()) {
+      users[record->ownerId].cardFoundCount++;
+    }
+    record->findInfo = findInfo;
+    break;
+  }
+  case BINARY_TAG_LOG_CARD_RETRIEVED: {
+    string cardId(payload.readString());
+    CardShard &shard = cardShard(cardId);
+    unique_lock lock(shard.mutex);
+    CardRecord *record = findRecord(shard, cardId);
+    if (record == nullptr || !record->findInfo) {
+      break;
+    }
+    shared_lock userLock(userMutex);
+    if (record->findInfo->finderId != -1) {
+      rewardLedger.credit(record->findInfo->finderId, record->findInfo->reward);
+    }
+    record->findInfo.reset();
+    if (record->ownerId >= 0 && record->ownerId < (long long)users.size()) {
+      users[record->ownerId].cardFoundCount--;
+    }
+    break;
+  }
+  case BINARY_TAG_LOG_REDEEM_REWARD: {
+    string username(payload.readString());
+    long long taken = payload.readSigned();
+    shared_lock userLock(userMutex);
+    if (long long id = findUserId(username); id != -1) {
+      rewardLedger.debit(id, taken);
+    }
+    break;
+  }
+  case BINARY_TAG_LOG_SETUP_2FA: {
+    string username(payload.readString());
+    long long id = payload.readSigned();
+    long long secret = payload.readSigned();
+    unique_lock userLock(userMutex);
+    long long uid = findUserId(username);
+    if (uid == -1 || id < 0) {
+      break;
+    }
+    users[uid].id = id;
+    if (secret2FA.size() <= (size_t)id) {
+      secret2FA.resize(id + 1);
+    }
+    secret2FA[id] = secret;
+    break;
+  }
+  case BINARY_TAG_LOG_EXPIRE_FIND: {
+    string cardId(payload.readString());
+    CardShard &shard = cardShard(cardId);
+    unique_lock lock(shard.mutex);
+    CardRecord *record = findRecord(shard, cardId);
+    if (record == nullptr || !record->findInfo) {
+      break;
+    }
+    shared_lock userLock(userMutex);
+    record->rejectInfo = record->findInfo;
+    record->findInfo.reset();
+    if (record->ownerId >= 0 && record->ownerId < (long long)users.size()) {
+      users[record->ownerId].cardFoundCount--;
+    }
+    break;
+  }
+  case BINARY_TAG_LOG_FORGET_REJECT: {
+    string cardId(payload.readString());
+    CardShard &shard = cardShard(cardId);
+    unique_lock lock(shard.mutex);
+    if (CardRecord *record = findRecord(shard, cardId)) {
+      record->rejectInfo.reset();
+    }
+    break;
+  }
+  case BINARY_TAG_LOG_CHECKPOINT:
+    checkpointId = payload.readVarint();
+    break;
+  default:
+    break; // Written by a newer version, skip it
+  }
+}
+
+int Server::replayLog(const string &fileName, uint64_t *count) {
+  auto readEntry = [](const string &bytes, BinarySnapshot &entrySnapshot,
+                      BinaryReader &payload) {
+    if (entrySnapshot.parse(bytes) != EE1520_ERROR_NORMAL) {
+      throwBinaryFormatError("write-ahead log entry");
+    }
+    BinaryReader reader = entrySnapshot.records();
+    return reader.readRecord(payload);
+  };
+  // The snapshot holds the entries up to its marker, when the log was not
+  // truncated after it was written
+  uint64_t skipped = 0;
+  if (checkpointId != 0) {
+    uint64_t index = 0;
+    int result = WriteAheadLog::replay(fileName, [&](const string &bytes) {
+      BinarySnapshot entrySnapshot;
+      BinaryReader payload;
+      index++;
+      if (readEntry(bytes, entrySnapshot, payload) ==
+              BINARY_TAG_LOG_CHECKPOINT &&
+          payload.readVarint() == checkpointId) {
+        skipped = index;
+      }
+    });
+    if (result != EE1520_ERROR_NORMAL) {
+      return result;
+    }
+  }
+
+  WriteAheadLog *attached = log;
+  log = nullptr; // Replayed mutations are logged already
+  uint64_t index = 0;
+  int result;
+  try {
+    result = WriteAheadLog::replay(fileName, [&](const string &bytes) {
+      if (++index <= skipped) {
+        return;
+      }
+      BinarySnapshot entrySnapshot;
+      BinaryReader payload;
+      uint64_t tag = readEntry(bytes, entrySnapshot, payload);
+      trimLedgerIfLong();
+      applyLogEntry(tag, payload);
+    });
+  } catch (...) {
+    log = attached;
+    throw;
+  }
+  log = attached;
+  if (count != nullptr) {
+    *count = index > skipped ? index - skipped : 0;
+  }
+  return result;
+}
+
+void Server::markCheckpoint() {
+  rewardLedger.trim(); // The snapshot keeps the balances
+  ledgerTrimSize.store(
+      max(MIN_LEDGER_TRIM_SIZE, 2 * rewardLedger.transactionCount()));
+  checkpointId++;
+  logMutation(BINARY_TAG_LOG_CHECKPOINT,
+              [&](BinaryWriter &entry) { entry.writeVarint(checkpointId); });
+}
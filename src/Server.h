@@ -1,12 +1,26 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "Core/BinaryIO.h"
 #include "Core/JvTime.h"
 #include "Core/Labeled_GPS.h"
-#include <map>
+#include "Ledger.h"
+#include "RateLimiter.h"
+#include "TimerWheel.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
+class Clock;
 class EmailServer;
+class WriteAheadLog;
 
 struct FindInfo {
   JvTime time;               // Time when the card was found
@@ -27,35 +41,167 @@ struct UserInfo {
   std::string email;                         // Email address of the user
   VerificationType verificationType = EMAIL; // Type of verification used
   long long id = -1;                         // User ID, -1 if not set
-  int cardFoundCount = 0; // Count of user's cards found, for locking the
-                          // verification type change
+  std::atomic<int> cardFoundCount{0}; // Count of user's cards found, for
+                                      // locking the verification type change
+
+  UserInfo() = default;
+  UserInfo(const UserInfo &other);
+  UserInfo &operator=(const UserInfo &other);
+};
+
+/*
+ * When entries of a server expire, in seconds, 0 for never
+ */
+struct ExpiryPolicy {
+  long long remindAfter = 0; // Remind the owner of a found card once, after
+  long long rejectAfter = 0; // Reject the retrieval of a found card, after
+  long long forgetAfter = 0; // Drop the reject info of a card, after
+};
+
+struct CardRecord {
+  long long ownerId = -1;             // ID of the owner of the card
+  std::optional<FindInfo> findInfo;   // Set while the card is found
+  std::optional<FindInfo> rejectInfo; // Set if the owner rejected retrieval
+  long long rejectedAt = -1; // When it was rejected, -1 if before loading
 };
 
+/*
+ * Server is safe to be called from many threads (e.g. one per Box).
+ * Lock order: card shard -> userMutex -> ledger stripe, and at most one card
+ * shard is held at a time except by dump2JSON and JSON2Object, which lock all
+ * of them in index order.
+ *
+ * When loaded lazily from a mapped binary snapshot, card records stay in the
+ * snapshot until first accessed, so startup only pays for the users.
+ *
+ * With a write-ahead log attached, every successful mutation is appended to
+ * it while the locks that order it are held. Deterministic mutations are
+ * logged as their arguments and replayed by calling them again; finding and
+ * retrieving a card are logged as their outcome (time, verification code)
+ * and replayed without sending emails, redemptions as the amount taken.
+ */
 class Server : public Core {
 private:
+  static constexpr size_t CARD_SHARD_COUNT = 64; // Must be a power of 2
+  static constexpr size_t LEDGER_STRIPE_COUNT = 64; // Must be a power of 2
+  // Fewest ledger transactions kept before the ledger is trimmed
+  static constexpr size_t MIN_LEDGER_TRIM_SIZE = 1 << 16;
+  // A card record still in the snapshot
+  struct ColdCard {
+    std::string_view id;
+    BinaryReader payload; // Payload of its CARD_RECORD
+  };
+  // A card of a dump, decoded only while it is written if it is still in the
+  // snapshot
+  struct DumpedCard {
+    std::string_view id;
+    const CardRecord *record; // nullptr if the card is cold
+    const ColdCard *cold;
+    /**
+     * @brief get the record of the card
+     * @param scratch: where a cold record is decoded, it is not kept
+     */
+    const CardRecord &get(CardRecord &scratch) const;
+  };
+  struct CardShard {
+    mutable std::shared_mutex mutex;
+    // card id -> owner, find info and reject info of the card. Cold records
+    // are decoded into it on first access, by const readers as well.
+    mutable std::unordered_map<std::string, CardRecord> records;
+    // Records not decoded yet, sorted by id. Entries already decoded into
+    // records are left here and shadowed.
+    mutable std::vector<ColdCard> cold;
+  };
+
+  // Guards userId, users (except cardFoundCount) and secret2FA
+  mutable std::shared_mutex userMutex;
   // username -> user id mapping
-  std::map<std::string, long long> userId;
-  // user id -> user info mapping
-  std::map<long long, UserInfo> userInfo;
-  // user id -> reward balance mapping
-  std::map<long long, long long> rewardBalance;
-  // card id -> owner id mapping
-  std::map<std::string, long long> cardOwnerId;
-  // card id -> find info mapping
-  std::map<std::string, FindInfo> cardFindInfo;
-  // card id -> reject card info mapping
-  std::map<std::string, FindInfo> cardRejectInfo;
+  std::unordered_map<std::string, long long> userId;
+  // user id -> user info, removed users are left as empty records
+  std::vector<UserInfo> users;
+  // card records, sharded by the hash of card id
+  std::array<CardShard, CARD_SHARD_COUNT> cardShards;
   std::vector<long long> secret2FA; // Verification codes for cards
+  // user id -> reward balance, lock-free, used with userMutex held shared
+  // and trimmed with it held exclusively
+  Ledger rewardLedger;
+  // Trim the ledger once its transactions reach this many
+  std::atomic<size_t> ledgerTrimSize{MIN_LEDGER_TRIM_SIZE};
+  // Held by user id from a ledger change to its log entry, so a user's
+  // changes are logged in the order they were made
+  std::array<std::mutex, LEDGER_STRIPE_COUNT> ledgerStripes;
+  // Failed logins and retrievals, checked by boxes before calling the server
+  RateLimiter attemptLimiter;
   // Server's email address
   std::string address;
   // Server's email password
   std::string emailPasswd;
-  // Next available user ID
-  long long nextId;
+  // The snapshot the cold card records live in
+  std::shared_ptr<const BinarySnapshot> snapshot;
+  // Log of mutations, nullptr if not logging
+  WriteAheadLog *log = nullptr;
+  // Id of the last checkpoint marker logged or loaded, 0 if none
+  uint64_t checkpointId = 0;
+  // Clock giving the time cards are found at and 2FA codes are checked at
+  const Clock *clock;
+  // 2FA steps accepted before and after the current one
+  int totpWindow = 0;
+  // Expiries of found and rejected cards, by the server clock
+  TimerWheel timers;
+  ExpiryPolicy expiry;
+  // When an expiry policy was first set, -1 if never. Rejections older
+  // than that count from it, their time is not kept.
+  long long expirySince = -1;
 
   EmailServer *emailServer;
   /**
-   * @brief Send a notification to the user
+   * @brief Get the shard holding a card
+   * @param cardId: the ID of the card
+   */
+  CardShard &cardShard(std::string_view cardId);
+  const CardShard &cardShard(std::string_view cardId) const;
+  /**
+   * @brief Find a card record, decoding it from the snapshot on first access,
+   * the caller must hold the shard exclusively
+   * @param shard: the shard of the card
+   * @param cardId: the ID of the card
+   * @return the record, nullptr if the card does not exist
+   * @throw ee1520_Exception if the cold record is malformed
+   */
+  CardRecord *findRecord(const CardShard &shard,
+                         const std::string &cardId) const;
+  /**
+   * @brief List every card sorted by id, leaving cold records in the
+   * snapshot, the caller must hold every shard
+   */
+  std::vector<DumpedCard> sortedCards() const;
+  /**
+   * @brief Get the ledger stripe of a user
+   */
+  std::mutex &ledgerStripe(long long userId);
+  /**
+   * @brief Trim the transaction log of the reward ledger once it doubled
+   * since the last trim, call without any lock held
+   */
+  void trimLedgerIfLong();
+  /**
+   * @brief Find the id of a user, the caller must hold userMutex
+   * @param username: the username of the user
+   * @return the user id, -1 if the username does not exist
+   */
+  long long findUserId(const std::string &username) const;
+  /**
+   * @brief Find the id of a user and check the password, the caller must hold
+   * userMutex
+   * @param username: the username of the user
+   * @param passwd: the password of the user
+   * @return the user id, -1 if the username does not exist or the password
+   * does not match
+   */
+  long long authUser(const std::string &username,
+                     const std::string &passwd) const;
+  /**
+   * @brief Send a notification to the user, the caller must hold userMutex
    * @param id: the id of the user
    * @param subject: the subject of the email
    * @param body: the body to be sent to the user
@@ -66,6 +212,45 @@ private:
   void notifyUser(long long id, const std::string &subject,
                   const std::string &body, const std::string &cardId = "",
                   int verificationCode = -1) const;
+  /**
+   * @brief Append a mutation to the log if one is attached
+   * @param tag: the tag of the log entry
+   * @param writeFields: called with the writer to write the entry's payload
+   */
+  template <typename WriteFields>
+  void logMutation(BinaryTag tag, WriteFields writeFields) const;
+  /**
+   * @brief Schedule the reminder and the rejection of a found card, as the
+   * expiry policy says
+   * @param foundAt: the time the card was found, it tells this find apart
+   */
+  void scheduleFindExpiry(const std::string &cardId, long long foundAt);
+  /**
+   * @brief Schedule dropping the reject info of a card, as the expiry policy
+   * says
+   * @param rejectedAt: the time the retrieval was rejected
+   * @param foundAt: the time in the reject info, it tells this one apart
+   */
+  void scheduleRejectExpiry(const std::string &cardId, long long rejectedAt,
+                            long long foundAt);
+  /**
+   * @brief Remind the owner of a card still found since foundAt
+   */
+  void remindOwner(const std::string &cardId, long long foundAt);
+  /**
+   * @brief Reject the retrieval of a card still found since foundAt
+   */
+  void expireFind(const std::string &cardId, long long foundAt);
+  /**
+   * @brief Drop the reject info of a card, if it is still the one of foundAt
+   */
+  void forgetReject(const std::string &cardId, long long foundAt);
+  /**
+   * @brief Apply one log entry, does nothing if it no longer applies
+   * @param tag: the tag of the entry
+   * @param payload: reader over its payload
+   */
+  void applyLogEntry(uint64_t tag, BinaryReader &payload);
 
 protected:
 public:
@@ -81,7 +266,8 @@ public:
    * @param emailAddr: the email address of the user
    * @param nickname: the nickname of the user
    * @retval true: the user is added successfully
-   *         false: the username already exists or the email address is invalid
+   *         false: the username already exists, the email address is invalid
+   *         or the ledger has no room for another account
    */
   bool addUser(const std::string &username, const std::string &passwd,
                const std::string &emailAddr, const std::string &nickname);
@@ -156,14 +342,16 @@ public:
    * @brief notify server a card is retrieved
    * @param id: the ID of card
    * @param verificationCode: the verification code for the card retrieval
-   * @return true if the process is successful, false if error occurs
+   * @return true if the process is successful, false if error occurs or the
+   * ledger refused the finder's reward; the card stays found then
    */
   bool notifyCardRetrieved(const std::string &id, int verificationCode);
 
   /**
    * @brief Get the find info of a card
    * @param id: the ID of the card
-   * @return FindInfo object containing the find information
+   * @return FindInfo object containing the find information, only valid until
+   * the card is found or retrieved again
    */
   const FindInfo *findInfo(const std::string &id) const;
   /**
@@ -182,6 +370,15 @@ public:
    */
   int redeemReward(const std::string &username, const std::string &password,
                    int amount);
+  /**
+   * @brief Get the reward ledger, for auditing
+   */
+  const Ledger &getRewardLedger() const;
+  /**
+   * @brief Get the throttle of failed box attempts, shared by every box of
+   * the server
+   */
+  RateLimiter &getAttemptLimiter();
   /**
    * @brief Setup 2FA
    * @param username: the username of the user
@@ -189,12 +386,112 @@ public:
    * secret key, otherwise pair(-1, -1) if error occurs
    */
   std::pair<long long, long long> setup2FA(const std::string &username);
+  /**
+   * @brief Get the app 2FA a user already has, e.g. loaded from a snapshot
+   * @param username: the username of the user
+   * @return pair<id, secret> of the user's 2FA, otherwise pair(-1, -1) if
+   * the user does not use the app or has no secret yet
+   */
+  std::pair<long long, long long> get2FA(const std::string &username) const;
 
-  Json::Value *dumpCard2JSON(const pair<std::string, long long> cardPair) const;
+  /**
+   * @brief Dump a card record, the caller must hold userMutex and the card's
+   * shard
+   */
+  Json::Value *dumpCard2JSON(const std::string &cardId,
+                             const CardRecord &record) const;
   void JSON2FindInfo(const Json::Value *arg_json_ptr, FindInfo &findInfo);
 
   virtual Json::Value *dump2JSON(void) const override;
   virtual void JSON2Object(const Json::Value *arg_json_ptr) override;
+  /**
+   * @brief write users, reward balances and every card record (including
+   * reject info, which dump2JSON only lists) as a binary snapshot record
+   */
+  void dump2Binary(BinaryWriter &writer) const;
+  /**
+   * @brief replace the state of the server with a binary snapshot record
+   * @param reader: reader positioned at the record
+   * @param snapshot: the snapshot reader reads from, optional. When given, the
+   * card records are only indexed and decoded on first access, the snapshot
+   * is kept alive for that.
+   * @throw ee1520_Exception if the record is malformed, the server is left
+   * untouched then
+   */
+  void Binary2Object(BinaryReader &reader,
+                     std::shared_ptr<const BinarySnapshot> snapshot = nullptr);
+  /**
+   * @brief decode every card record still in the snapshot, after which the
+   * server no longer reads it, e.g. before the snapshot file is overwritten
+   */
+  void materializeAll() const;
+
+  /**
+   * @brief set the clock of the server, call before the server is shared
+   * between threads
+   * @param serverClock: the clock, not owned
+   */
+  void setClock(const Clock *serverClock);
+  /**
+   * @brief get the clock of the server, the default clock if none was set
+   */
+  const Clock &getClock() const;
+  /**
+   * @brief accept app 2FA codes from steps around the current one, to allow
+   * for clock drift between the app and the server; call before the server
+   * is shared between threads
+   * @param steps: steps of 30 seconds accepted on each side, 0 by default
+   */
+  void setTotpWindow(int steps);
+  /**
+   * @brief expire found and rejected cards: remind owners of found cards,
+   * reject the retrieval of the ones left too long and drop old reject info.
+   * Cards already found or rejected are scheduled too, records still in a
+   * mapped snapshot stay there, only their find times are read. Setting
+   * another policy replaces the timers of the previous one. Call it after
+   * loading and replaying the log and before the server is shared between
+   * threads
+   * @param policy: the delays, none by default
+   */
+  void setExpiryPolicy(const ExpiryPolicy &policy);
+  /**
+   * @brief get the expiry policy of the server, none if it was never set
+   */
+  const ExpiryPolicy &getExpiryPolicy() const;
+  /**
+   * @brief carry out the expiries due by the server clock, call after moving
+   * the clock
+   * @return the number of timers fired
+   */
+  size_t runTimers();
+
+  /**
+   * @brief log every following mutation, call before the server is shared
+   * between threads
+   * @param writeAheadLog: the log, nullptr to stop logging
+   */
+  void attachLog(WriteAheadLog *writeAheadLog);
+  /**
+   * @brief recover the mutations logged since the state was loaded, call
+   * after loading the snapshot the log was started on and before attachLog.
+   * Entries up to the checkpoint marker the snapshot was written at, if the
+   * log still has them, are skipped.
+   * @param fileName: the log file
+   * @param count[out]: the number of entries replayed, optional
+   * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_FILE_READ if the file is
+   * not a log
+   * @throw ee1520_Exception if an entry is malformed
+   */
+  int replayLog(const std::string &fileName, uint64_t *count = nullptr);
+  /**
+   * @brief log a checkpoint marker, call right before writing the state as a
+   * binary snapshot, which keeps the id of the marker. Should the log not be
+   * truncated after the snapshot is written, replayLog on that snapshot
+   * skips the entries up to the marker, which the snapshot holds already.
+   * The transaction log of the reward ledger is trimmed as well.
+   * No other thread may use the server until the snapshot is written.
+   */
+  void markCheckpoint();
 };
 
 #endif // SERVER_H
@@ -0,0 +1,77 @@
+#include "SessionTable.h"
+#include <algorithm>
+#include <cassert>
+using namespace std;
+
+SessionTable::SessionTable(long long validSec)
+    : validSec(validSec), random(random_device{}()) {
+  assert(validSec >= 0 && validSec < (long long)WHEEL_SIZE);
+}
+
+void SessionTable::expire(long long now) {
+  if (sweptUntil < 0) {
+    sweptUntil = now - 1;
+  }
+  // A session expiring at second t is swept once the time passes t
+  long long first = max(sweptUntil + 1, now - (long long)WHEEL_SIZE);
+  for (long long second = first; second < now; second++) {
+    vector<Token> &slot = wheel[second & (WHEEL_SIZE - 1)];
+    if (slot.empty()) {
+      continue;
+    }
+    vector<Token> tokens;
+    tokens.swap(slot);
+    for (Token token : tokens) {
+      auto it = sessions.find(token);
+      if (it == sessions.end()) {
+        continue; // Closed
+      }
+      if (it->second.expiresAt < now) {
+        sessions.erase(it);
+      } else {
+        // Used since, wait for its new expiry
+        wheel[it->second.expiresAt & (WHEEL_SIZE - 1)].push_back(token);
+      }
+    }
+  }
+  sweptUntil = max(sweptUntil, now - 1);
+}
+
+SessionTable::Token SessionTable::open(const string &username,
+                                       const string &passwd, long long now) {
+  expire(now);
+  Token token;
+  do {
+    token = random(); // Random rather than sequential, as it stands for a login
+  } while (token == NO_SESSION || sessions.count(token) > 0);
+  sessions[token] = {username, passwd, now + validSec};
+  vector<Token> &slot = wheel[(now + validSec) & (WHEEL_SIZE - 1)];
+  slot.push_back(token);
+  if (slot.size() > 2 * sessions.size() + WHEEL_SIZE) {
+    // Mostly closed sessions, as when the clock stands still; drop them
+    slot.erase(remove_if(slot.begin(), slot.end(),
+                         [this](Token t) { return sessions.count(t) == 0; }),
+               slot.end());
+  }
+  return token;
+}
+
+const SessionTable::Session *SessionTable::find(Token token, long long now) {
+  expire(now);
+  auto it = sessions.find(token);
+  if (it == sessions.end()) {
+    return nullptr;
+  }
+  if (it->second.expiresAt < now) {
+    sessions.erase(it); // Left behind when the clock went back
+    return nullptr;
+  }
+  it->second.expiresAt = now + validSec;
+  return &it->second;
+}
+
+void SessionTable::close(Token token) {
+  sessions.erase(token); // Its wheel entry is dropped when swept
+}
+
+size_t SessionTable::size() const { return sessions.size(); }
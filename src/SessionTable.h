@@ -0,0 +1,79 @@
+#ifndef SESSION_TABLE_H
+#define SESSION_TABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Login sessions of a box, keyed by a random token, each valid until it has
+ * not been used for validSec seconds.
+ *
+ * Expiry runs on a timer wheel of one-second slots: a session sits in the
+ * slot of the second it expires at, and the slots the clock moved past are
+ * swept on the next call. A session used since it was put in a slot is moved
+ * to its new slot when swept instead of on every use, so looking a session
+ * up stays one hash lookup. Times are in seconds, from the caller.
+ * Not synchronized, guard it externally if a box is shared between threads.
+ */
+class SessionTable {
+public:
+  using Token = uint64_t;
+  static constexpr Token NO_SESSION = 0;
+
+  struct Session {
+    std::string username;
+    std::string passwd;
+    long long expiresAt; // Last second the session is valid
+  };
+
+private:
+  static constexpr size_t WHEEL_SIZE = 64; // Must be a power of 2
+
+  long long validSec;
+  std::unordered_map<Token, Session> sessions;
+  // slot -> tokens of sessions expiring at a second mapped to it
+  std::array<std::vector<Token>, WHEEL_SIZE> wheel;
+  long long sweptUntil = -1; // Seconds up to it are swept, -1 if never
+  std::mt19937_64 random;
+
+  /**
+   * @brief remove the sessions expired before a time
+   */
+  void expire(long long now);
+
+public:
+  /**
+   * @param validSec: seconds a session stays valid without being used, less
+   *                  than the wheel size
+   */
+  explicit SessionTable(long long validSec = 60);
+
+  /**
+   * @brief open a session
+   * @param now: the current time, in seconds
+   * @return the token of the new session, never NO_SESSION
+   */
+  Token open(const std::string &username, const std::string &passwd,
+             long long now);
+  /**
+   * @brief get a valid session and extend it
+   * @param now: the current time, in seconds
+   * @return the session, nullptr if the token is unknown or expired
+   */
+  const Session *find(Token token, long long now);
+  /**
+   * @brief close a session, does nothing if it is unknown
+   */
+  void close(Token token);
+  /**
+   * @brief get the number of sessions, including the expired ones not swept
+   */
+  size_t size() const;
+};
+
+#endif // SESSION_TABLE_H
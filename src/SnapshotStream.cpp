@@ -0,0 +1,95 @@
+#include "SnapshotStream.h"
+using namespace std;
+
+SnapshotStream::SnapshotStream(const string &fileName)
+    : ofs(fileName, ios::out | ios::trunc) {
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = ""; // One record per line
+  writer.reset(builder.newStreamWriter());
+}
+
+SnapshotStream::~SnapshotStream() { ofs.close(); }
+
+bool SnapshotStream::isOpen() const { return ofs.is_open(); }
+
+void SnapshotStream::writeRecord(const Json::Value &record) {
+  writer->write(record, &ofs);
+  ofs << '\n';
+  count++;
+}
+
+void SnapshotStream::append(Json::Value snapshot) {
+  Json::Value record;
+  if (count == 0) {
+    record["type"] = "base";
+    record["snapshot"] = snapshot;
+  } else {
+    record["type"] = "delta";
+    record["index"] = count;
+    record["diff"] = Json::Value(Json::arrayValue);
+    vector<JSON_Diff *> *diff_ptr = JSON_Difference(last, snapshot, {});
+    for (JSON_Diff *jd_ptr : *diff_ptr) {
+      // Old values are not needed to move forward
+      if (!(jd_ptr->type == "Value" && jd_ptr->order == 1)) {
+        Json::Value *jv_ptr = jd_ptr->dump2JSON();
+        record["diff"].append(*jv_ptr);
+        delete jv_ptr;
+      }
+      delete jd_ptr;
+    }
+    delete diff_ptr;
+  }
+  writeRecord(record);
+  last = std::move(snapshot);
+}
+
+void SnapshotStream::applyDiff(Json::Value &snapshot, const Json::Value &diff) {
+  for (const Json::Value &entry : diff) {
+    const Json::Value &keyPath = entry["key path"]["data"];
+    if (keyPath.size() == 0) {
+      snapshot = entry["diff"];
+      continue;
+    }
+    Json::Value *jv_ptr = &snapshot;
+    for (unsigned int i = 0; i + 1 < keyPath.size(); i++) {
+      if (jv_ptr->isArray()) {
+        jv_ptr = &(*jv_ptr)[stoi(keyPath[i].asString())];
+      } else {
+        jv_ptr = &(*jv_ptr)[keyPath[i].asString()];
+      }
+    }
+    const string &key = keyPath[keyPath.size() - 1].asString();
+    if (entry["type"].asString() == "Key" && entry["order"].asUInt() == 1) {
+      jv_ptr->removeMember(key); // Key only exists in the old snapshot
+    } else if (jv_ptr->isArray()) {
+      (*jv_ptr)[stoi(key)] = entry["diff"];
+    } else {
+      (*jv_ptr)[key] = entry["diff"];
+    }
+  }
+}
+
+int SnapshotStream::load(const string &fileName, unsigned int index,
+                         Json::Value *jv_ptr) {
+  if (jv_ptr == NULL)
+    return EE1520_ERROR_NULL_JSON_PTR;
+  ifstream ifs(fileName);
+  if (!ifs.is_open())
+    return EE1520_ERROR_FILE_NOT_EXIST;
+
+  string line;
+  for (unsigned int i = 0; i <= index; i++) {
+    if (!getline(ifs, line))
+      return EE1520_ERROR_FILE_READ;
+    Json::Value record;
+    int rc = myParseJSON(line, &record);
+    if (rc != EE1520_ERROR_NORMAL)
+      return rc;
+    if (i == 0) {
+      *jv_ptr = record["snapshot"];
+    } else {
+      applyDiff(*jv_ptr, record["diff"]);
+    }
+  }
+  return EE1520_ERROR_NORMAL;
+}
@@ -0,0 +1,59 @@
+#ifndef SNAPSHOT_STREAM_H
+#define SNAPSHOT_STREAM_H
+
+#include "Core/ee1520_Common.h"
+#include <fstream>
+#include <memory>
+#include <string>
+
+/**
+ * Append-only stream of world snapshots, one JSON record per line.
+ * The first record holds the full base snapshot, every following record only
+ * holds the JSON_Difference against the previous snapshot.
+ * Every append takes a full snapshot and diffs all of it, the stream only
+ * saves what is written, not the cost of dumping the world.
+ */
+class SnapshotStream {
+private:
+  std::ofstream ofs;
+  std::unique_ptr<Json::StreamWriter> writer;
+  Json::Value last;       // Snapshot the next delta is computed against
+  unsigned int count = 0; // Number of records written
+
+  void writeRecord(const Json::Value &record);
+
+public:
+  SnapshotStream(const std::string &fileName);
+  ~SnapshotStream();
+
+  /**
+   * @brief check if the stream file is opened successfully
+   */
+  bool isOpen() const;
+
+  /**
+   * @brief append a snapshot to the stream
+   * @param snapshot: the full snapshot, written as base on the first call and
+   *                  as a delta against the previous snapshot afterwards
+   */
+  void append(Json::Value snapshot);
+
+  /**
+   * @brief apply a delta record's diff to a snapshot
+   * @param snapshot[in,out]: the snapshot before the action
+   * @param diff: the "diff" array of a delta record
+   */
+  static void applyDiff(Json::Value &snapshot, const Json::Value &diff);
+
+  /**
+   * @brief rebuild the snapshot after a given record from a stream file
+   * @param fileName: the stream file
+   * @param index: index of the record, 0 for the base snapshot
+   * @param jv_ptr[out]: the rebuilt snapshot
+   * @return EE1520_ERROR_NORMAL on success, otherwise an EE1520 error code
+   */
+  static int load(const std::string &fileName, unsigned int index,
+                  Json::Value *jv_ptr);
+};
+
+#endif // SNAPSHOT_STREAM_H
@@ -0,0 +1,149 @@
+#include "TimerWheel.h"
+#include <algorithm>
+using namespace std;
+
+void TimerWheel::place(TimerId id, long long when) {
+  if (current < 0) {
+    overflow.push_back(id); // Placed on the first advance, when time is known
+    return;
+  }
+  if (when <= current) {
+    due.push_back(id);
+    return;
+  }
+  for (size_t level = 0; level < LEVELS; level++) {
+    // The lowest level whose slots still tell when and current apart
+    if (((when ^ current) >> (SLOT_BITS * (level + 1))) == 0) {
+      wheels[level][(when >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(id);
+      levelSizes[level]++;
+      return;
+    }
+  }
+  overflow.push_back(id);
+}
+
+void TimerWheel::cascade(size_t level) {
+  vector<TimerId> ids;
+  ids.swap(wheels[level][(current >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+  levelSizes[level] -= ids.size();
+  for (TimerId id : ids) {
+    if (auto it = timers.find(id); it != timers.end()) {
+      place(id, it->second.when);
+    }
+  }
+}
+
+void TimerWheel::collect(vector<TimerId> &ids,
+                         vector<function<void()>> &fired) {
+  for (TimerId id : ids) {
+    auto it = timers.find(id);
+    if (it == timers.end()) {
+      continue; // Cancelled
+    }
+    fired.push_back(std::move(it->second.callback));
+    timers.erase(it);
+  }
+}
+
+void TimerWheel::sortByTime(vector<TimerId> &ids) const {
+  vector<pair<long long, TimerId>> byTime;
+  byTime.reserve(ids.size());
+  for (TimerId id : ids) {
+    if (auto it = timers.find(id); it != timers.end()) {
+      byTime.emplace_back(it->second.when, id);
+    }
+  }
+  sort(byTime.begin(), byTime.end());
+  ids.clear();
+  for (const auto &entry : byTime) {
+    ids.push_back(entry.second);
+  }
+}
+
+TimerWheel::TimerId TimerWheel::schedule(long long when,
+                                         function<void()> callback) {
+  lock_guard lock(mutex);
+  TimerId id = nextId++;
+  timers[id] = {when, std::move(callback)};
+  place(id, when);
+  return id;
+}
+
+bool TimerWheel::cancel(TimerId id) {
+  lock_guard lock(mutex);
+  return timers.erase(id) > 0; // Its id is dropped when its slot is reached
+}
+
+size_t TimerWheel::advance(long long now) {
+  vector<function<void()>> fired;
+  {
+    lock_guard lock(mutex);
+    if (current < 0) {
+      current = now;
+      vector<TimerId> waiting;
+      waiting.swap(overflow);
+      for (TimerId id : waiting) {
+        if (auto it = timers.find(id); it != timers.end()) {
+          place(id, it->second.when);
+        }
+      }
+    }
+    vector<TimerId> ids;
+    ids.swap(due);
+    // Scheduled in the past or before the first advance, at any time
+    sortByTime(ids);
+    collect(ids, fired);
+    while (current < now) {
+      // Skip to the last second before the lowest level with timers turns
+      size_t lowest = 0;
+      while (lowest < LEVELS && levelSizes[lowest] == 0) {
+        lowest++;
+      }
+      if (lowest == LEVELS && overflow.empty()) {
+        current = now;
+        break;
+      }
+      current = min(now, current | ((1LL << (SLOT_BITS * lowest)) - 1));
+      if (current == now) {
+        break;
+      }
+      current++;
+      // Move timers down from the wheels that turned, the highest first
+      if ((current & ((1LL << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+        ids.clear();
+        ids.swap(overflow);
+        for (TimerId id : ids) {
+          if (auto it = timers.find(id); it != timers.end()) {
+            place(id, it->second.when);
+          }
+        }
+      }
+      for (size_t level = LEVELS - 1; level > 0; level--) {
+        if ((current & ((1LL << (SLOT_BITS * level)) - 1)) == 0) {
+          cascade(level);
+        }
+      }
+      ids.clear();
+      ids.swap(wheels[0][current & (SLOTS - 1)]);
+      levelSizes[0] -= ids.size();
+      collect(ids, fired);
+      ids.clear();
+      ids.swap(due); // Moved down right onto the current second
+      collect(ids, fired);
+    }
+  }
+  for (function<void()> &callback : fired) {
+    callback();
+  }
+  return fired.size();
+}
+
+void TimerWheel::clear() {
+  lock_guard lock(mutex);
+  timers.clear(); // As with cancel, the ids are dropped from their slots later
+}
+
+size_t TimerWheel::size() {
+  lock_guard lock(mutex);
+  return timers.size();
+}
@@ -0,0 +1,102 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Scheduler of callbacks at times in seconds, driven by whoever owns the
+ * clock through advance().
+ *
+ * A hierarchical timer wheel: LEVELS wheels of SLOTS slots, level L slots
+ * spanning SLOTS^L seconds, so it reaches SLOTS^LEVELS seconds (about 194
+ * days) ahead; later timers wait in an overflow list. A timer sits in the
+ * lowest level whose span still tells it apart from the current time, and
+ * moves down a level each time the wheel above turns to its slot, so
+ * scheduling, cancelling and firing are O(1) amortized per timer. Seconds
+ * with nothing due are skipped level by level, so a clock jumping ahead by
+ * months costs no more than the timers it fires.
+ *
+ * Safe to be called from many threads. Callbacks run without the wheel
+ * locked and may schedule or cancel timers; one scheduled at or before the
+ * time being advanced to fires on the next advance().
+ */
+class TimerWheel {
+public:
+  using TimerId = uint64_t;
+  static constexpr size_t LEVELS = 4;
+  static constexpr size_t SLOT_BITS = 6;
+  static constexpr size_t SLOTS = 1 << SLOT_BITS;
+
+private:
+  struct Timer {
+    long long when;
+    std::function<void()> callback;
+  };
+
+  std::mutex mutex;
+  // id -> timer, a cancelled timer is only removed from here, its id is
+  // dropped from its slot when the slot is reached
+  std::unordered_map<TimerId, Timer> timers;
+  std::array<std::array<std::vector<TimerId>, SLOTS>, LEVELS> wheels;
+  std::array<size_t, LEVELS> levelSizes{}; // Ids in the slots of each level
+  std::vector<TimerId> overflow;           // Timers beyond the last level
+  std::vector<TimerId> due; // Timers scheduled at or before current
+  long long current = -1;   // Seconds up to it have fired, -1 if never run
+  TimerId nextId = 1;
+
+  /**
+   * @brief put a timer in the slot it waits in, the caller must hold mutex
+   */
+  void place(TimerId id, long long when);
+  /**
+   * @brief move the timers of a slot down to the levels below, the caller
+   * must hold mutex
+   */
+  void cascade(size_t level);
+  /**
+   * @brief take the callbacks of timers still scheduled, the caller must
+   * hold mutex
+   */
+  void collect(std::vector<TimerId> &ids,
+               std::vector<std::function<void()>> &fired);
+  /**
+   * @brief order timers by when they are due, dropping cancelled ones, the
+   * caller must hold mutex
+   */
+  void sortByTime(std::vector<TimerId> &ids) const;
+
+public:
+  /**
+   * @brief schedule a callback
+   * @param when: the time to call it at, in seconds
+   * @return the id of the timer, to cancel it
+   */
+  TimerId schedule(long long when, std::function<void()> callback);
+  /**
+   * @brief cancel a timer
+   * @return false if it fired already or is unknown
+   */
+  bool cancel(TimerId id);
+  /**
+   * @brief cancel every timer
+   */
+  void clear();
+  /**
+   * @brief move the time forward and call the callbacks due, in time order
+   * @param now: the current time, in seconds; going back does nothing
+   * @return the number of callbacks called
+   */
+  size_t advance(long long now);
+  /**
+   * @brief get the number of timers scheduled
+   */
+  size_t size();
+};
+
+#endif // TIMER_WHEEL_H
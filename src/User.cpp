@@ -2,6 +2,8 @@
 #include "App2FA.h"
 #include "Box.h"
 #include "Card.h"
+#include "Clock.h"
+#include "Core/BinaryIO.h"
 #include "EmailServer.h"
 #include "Server.h"
 #include <cassert>
@@ -31,6 +33,11 @@ User::User(Server *server, EmailServer *emailServer,
   JSON2Object(arg_json_ptr);
   this->emailServer->addAddress(email, emailPasswd);
 }
+User::User(Server *server, EmailServer *emailServer, BinaryReader &reader)
+    : emailServer(emailServer), server(server) {
+  Binary2Object(reader);
+  this->emailServer->addAddress(email, emailPasswd);
+}
 User::User(Server *server, EmailServer *emailServer)
     : server(server), emailServer(emailServer) {}
 
@@ -119,6 +126,7 @@ Card *User::retrieveCard(Box *box, const std::string &cardId,
   }
   int verificationCode = -1;
   if (verificationType == UserInfo::EMAIL) {
+    expireCodes();
     // Check if the card ID has a verification code
     if (verificationCodes.find(cardId) != verificationCodes.end()) {
       verificationCode = verificationCodes[cardId];
@@ -144,9 +152,9 @@ Card *User::retrieveCard(Box *box, const std::string &cardId,
     return nullptr;
   Card *card =
       box->retrieveCard(cardId, verificationCode, cards[paymentCardId]);
-  assert(cards.find(card->getId()) == cards.end() &&
-         "Card should not be in user's collection after retrieval");
   if (card) {
+    assert(cards.find(card->getId()) == cards.end() &&
+           "Card should not be in user's collection after retrieval");
     addCard(card); // Add the card back to the user's collection
     if (verificationType == UserInfo::EMAIL) {
       // Delete the verification code after retrieval
@@ -158,7 +166,11 @@ Card *User::retrieveCard(Box *box, const std::string &cardId,
 
 bool User::rejectRetrieve(const std::string &cardId) {
   if (server && !cardId.empty()) {
-    return server->rejectRetrieve(username, passwd, cardId);
+    if (!server->rejectRetrieve(username, passwd, cardId)) {
+      return false;
+    }
+    verificationCodes.erase(cardId); // The server takes it no more
+    return true;
   }
   return false; // Failed to reject retrieval or server not set
 }
@@ -192,19 +204,86 @@ void User::readMail(int index) {
   if (emailServer) {
     const Email *email =
         emailServer->getEmailById(this->email, emailPasswd, index);
+    if (!email) {
+      cerr << "Email #" << index << " not found for user: " << username
+           << endl;
+      return;
+    }
     cout << "Reading email #" << index << ":" << "\n";
     cout << "Subject: " << email->subject << "\n";
     cout << "Body: " << email->body << "\n";
     cout << "From: " << email->sender << endl;
-    cout << "Time: " << *email->time.getTimeString() << endl;
+    cout << "Time: " << email->time.toString() << endl;
     if (!email->cardId.empty() && email->verificationCode != -1) {
+      expireCodes();
       verificationCodes[email->cardId] = email->verificationCode;
+      scheduleCodeExpiry(email->cardId, email->verificationCode,
+                         email->time.getEpoch());
     }
   } else {
     std::cerr << "Email server not set for user: " << username << std::endl;
   }
 }
 
+void User::scheduleCodeExpiry(const string &cardId, int verificationCode,
+                              long long sentAt) {
+  if (codeExpiry == nullptr) {
+    return; // The server's codes do not expire
+  }
+  // The code was sent when the card was found, the server rejects its
+  // retrieval rejectAfter later
+  codeExpiry->schedule(
+      sentAt + server->getExpiryPolicy().rejectAfter,
+      [this, cardId, verificationCode] {
+        auto it = verificationCodes.find(cardId);
+        if (it != verificationCodes.end() && it->second == verificationCode) {
+          verificationCodes.erase(it);
+        }
+      });
+}
+
+void User::expireCodes() {
+  if (server == nullptr) {
+    return;
+  }
+  long long now = server->getClock().now().getEpoch();
+  long long rejectAfter = server->getExpiryPolicy().rejectAfter;
+  if (codeExpiry == nullptr || codeExpiryAfter != rejectAfter) {
+    if (rejectAfter <= 0) {
+      codeExpiry.reset();
+      return;
+    }
+    codeExpiry = make_unique<TimerWheel>();
+    codeExpiryAfter = rejectAfter;
+    map<string, long long> sentAt = codeSendTimes();
+    for (const auto &code : verificationCodes) {
+      auto it = sentAt.find(code.first);
+      scheduleCodeExpiry(code.first, code.second,
+                         it != sentAt.end() ? it->second : now);
+    }
+  }
+  codeExpiry->advance(now);
+}
+
+map<string, long long> User::codeSendTimes() const {
+  map<string, long long> sentAt;
+  if (emailServer == nullptr || verificationCodes.empty()) {
+    return sentAt;
+  }
+  for (long long id : emailServer->getEmails(email, emailPasswd)) {
+    const Email *mail = emailServer->getEmailById(email, emailPasswd, id);
+    if (mail == nullptr || mail->cardId.empty()) {
+      continue;
+    }
+    auto code = verificationCodes.find(mail->cardId);
+    if (code != verificationCodes.end() &&
+        code->second == mail->verificationCode) {
+      sentAt[mail->cardId] = mail->time.getEpoch(); // Latest mail last
+    }
+  }
+  return sentAt;
+}
+
 set<long long> User::getEmailIds() const {
   if (emailServer) {
     return emailServer->getEmails(username, emailPasswd);
@@ -282,7 +361,7 @@ Json::Value *User::dump2JSON() const {
   }
 
   for (auto card : cards) {
-    (*json)["cards"].append(*card.second->dump2JSON());
+    (*json)["cards"].append(adoptJSON(card.second->dump2JSON()));
   }
 
   return json; // Return the JSON representation of the user
@@ -349,3 +428,53 @@ void User::JSON2Object(const Json::Value *arg_json_ptr) {
     throw(*lv_exception_ptr); // Throw exception if there are errors
   }
 }
+
+void User::dump2Binary(BinaryWriter &writer) const {
+  writer.beginRecord(BINARY_TAG_USER);
+  writer.writeString(username);
+  writer.writeString(passwd);
+  writer.writeString(email);
+  writer.writeString(emailPasswd);
+  writer.writeString(nickname);
+  writer.writeVarint(verificationType);
+  writer.writeVarint(cards.size());
+  for (const auto &card : cards) {
+    card.second->dump2Binary(writer);
+  }
+  writer.writeVarint(verificationCodes.size());
+  for (const auto &code : verificationCodes) {
+    writer.writeString(code.first);
+    writer.writeSigned(code.second);
+  }
+  writer.endRecord();
+}
+
+void User::Binary2Object(BinaryReader &reader) {
+  BinaryReader payload = reader.expectRecord(BINARY_TAG_USER);
+  this->username = payload.readString();
+  this->passwd = payload.readString();
+  this->email = payload.readString();
+  this->emailPasswd = payload.readString();
+  this->nickname = payload.readString();
+  uint64_t type = payload.readVarint();
+  uint64_t cardCount = payload.readVarint();
+  for (uint64_t i = 0; i < cardCount; i++) {
+    this->addCard(new Card(payload));
+  }
+  uint64_t codeCount = payload.readVarint();
+  for (uint64_t i = 0; i < codeCount; i++) {
+    string cardId(payload.readString());
+    this->verificationCodes[cardId] = (int)payload.readSigned();
+  }
+
+  server->addUser(username, passwd, email, nickname);
+  // Keep the secret loaded by the server, the user's authenticator has it
+  pair<long long, long long> twoFA = server->get2FA(username);
+  if (type == UserInfo::APP && twoFA.first != -1) {
+    verificationType = UserInfo::APP;
+    app2FA = new App2FA(twoFA.first, twoFA.second, &server->getClock());
+    return;
+  }
+  this->setVerificationType(type == UserInfo::APP ? UserInfo::APP
+                                                  : UserInfo::EMAIL);
+}
@@ -3,10 +3,14 @@
 
 #include "Core/Core.h"
 #include "Server.h"
+#include "TimerWheel.h"
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 
+class BinaryReader;
+class BinaryWriter;
 class Card;
 class Box;
 class EmailServer;
@@ -22,11 +26,35 @@ private:
   std::map<std::string, Card *> cards; // id -> card owned by the user
   std::map<std::string, int>
       verificationCodes;    // id -> verification code for the card
+  // Drops verificationCodes once the server rejects them, by the server clock;
+  // created when the first code is read, if the server's codes expire, and
+  // built again if the server's rejectAfter changes
+  std::unique_ptr<TimerWheel> codeExpiry;
+  long long codeExpiryAfter = 0; // The rejectAfter codeExpiry was built for
   EmailServer *emailServer; // Pointer to the email server for communication
   Server *server;           // Pointer to the server for user management
   UserInfo::VerificationType verificationType =
       UserInfo::EMAIL;      // Type of verification used
   App2FA *app2FA = nullptr; // Pointer to the App 2FA instance for verification
+  /**
+   * @brief drop a verification code once the server rejects the retrieval
+   * of its card, unless another code came for the card since
+   * @param sentAt: when the code was sent, in seconds
+   */
+  void scheduleCodeExpiry(const std::string &cardId, int verificationCode,
+                          long long sentAt);
+  /**
+   * @brief drop the verification codes expired by the server clock; codes
+   * held before the first call, e.g. loaded, count from the mail they came
+   * in, or from then if it is gone
+   */
+  void expireCodes();
+  /**
+   * @brief find when the verification codes held were mailed
+   * @return card id -> time the mail with its code was sent, in seconds
+   */
+  std::map<std::string, long long> codeSendTimes() const;
+
 protected:
 public:
   User();
@@ -35,6 +63,7 @@ public:
        const std::string &emailAddr, const std::string &emailPasswd);
   User(Server *server, EmailServer *emailServer,
        const Json::Value *arg_json_ptr);
+  User(Server *server, EmailServer *emailServer, BinaryReader &reader);
   User(Server *server, EmailServer *emailServer);
   virtual ~User();
 
@@ -156,6 +185,17 @@ public:
 
   virtual Json::Value *dump2JSON(void) const override;
   virtual void JSON2Object(const Json::Value *arg_json_ptr) override;
+  /**
+   * @brief write the user, its cards and verification codes as a binary
+   * snapshot record
+   */
+  void dump2Binary(BinaryWriter &writer) const;
+  /**
+   * @brief read the user from a binary snapshot record and register it to
+   * the server, like JSON2Object
+   * @throw ee1520_Exception if the record is malformed
+   */
+  void Binary2Object(BinaryReader &reader);
 };
 
 #endif // USER_H
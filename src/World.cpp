@@ -0,0 +1,231 @@
+#include "World.h"
+#include "Card.h"
+#include "Core/BinaryIO.h"
+#include "WriteAheadLog.h"
+using namespace std;
+
+World::World(const Json::Value *arg_json_ptr)
+    : server(&emailServer, &(*arg_json_ptr)["server"]),
+      box1(&server, Labeled_GPS()), hacker(&server, &emailServer) {
+  emailServer.setClock(&clock);
+  server.setClock(&clock);
+  const Json::Value &json = *arg_json_ptr;
+  string hackerName;
+  if (json["hacker"].isObject()) {
+    hackerName = json["hacker"]["username"].asString();
+  }
+  for (unsigned int i = 0; i < json["users"].size(); i++) {
+    string userId = json["users"][i]["username"].asString();
+    if (!hackerName.empty() && userId == hackerName) {
+      continue; // Snapshots list the hacker among the users as well
+    }
+    users[userId] = new User(&server, &emailServer, &json["users"][i]);
+  }
+  box1.JSON2Object(&json["box1"]);
+  for (unsigned int i = 0; i < json["boxes"].size(); i++) {
+    Box *box = new Box(&server, Labeled_GPS());
+    box->JSON2Object(&json["boxes"][i]);
+    boxes.push_back(box);
+  }
+  registerBoxes();
+  if (json.isMember("fakeBox")) {
+    fakeBox.JSON2Object(&json["fakeBox"]);
+  }
+  for (unsigned int i = 0; i < json["cardsLost"].size(); i++) {
+    Card *card = new Card(&json["cardsLost"][i]);
+    Card *&slot = cards[card->getId()];
+    delete slot;
+    slot = card;
+  }
+  if (json["now"].isString()) {
+    clock.set(json["now"].asString());
+  } else {
+    clock.set(string("2025-06-01T12:00:00+0800"));
+  }
+
+  if (json.isMember("hacker")) {
+    hacker.JSON2Object(&json["hacker"]);
+    isHacker = true;
+    users["hacker"] = &hacker;
+    if (json["hacker"]["leakVerificationCode"].isInt()) {
+      leakVerificationCode = json["hacker"]["leakVerificationCode"].asInt();
+    }
+  }
+  // Last, so it replaces the addresses the server and users added above
+  if (json.isMember("emailServer")) {
+    emailServer.JSON2Object(&json["emailServer"]);
+  }
+}
+
+World::World(BinaryReader &reader, shared_ptr<const BinarySnapshot> snapshot)
+    : server("", "", &emailServer), box1(&server, Labeled_GPS()),
+      hacker(&server, &emailServer) {
+  emailServer.setClock(&clock);
+  server.setClock(&clock);
+  BinaryReader payload = reader.expectRecord(BINARY_TAG_WORLD);
+  clock.set(payload.readTime());
+  isHacker = payload.readBool();
+  leakVerificationCode = (int)payload.readSigned();
+  emailServer.Binary2Object(payload, snapshot);
+  server.Binary2Object(payload, snapshot);
+  uint64_t userCount = payload.readVarint();
+  for (uint64_t i = 0; i < userCount; i++) {
+    string userId(payload.readString());
+    User *user = new User(&server, &emailServer, payload);
+    User *&slot = users[userId];
+    delete slot;
+    slot = user;
+  }
+  uint64_t cardCount = payload.readVarint();
+  for (uint64_t i = 0; i < cardCount; i++) {
+    Card *card = new Card(payload);
+    Card *&slot = cards[card->getId()];
+    delete slot;
+    slot = card;
+  }
+  box1.Binary2Object(payload);
+  fakeBox.Binary2Object(payload);
+  if (isHacker) {
+    hacker.Binary2Object(payload);
+    users["hacker"] = &hacker;
+  }
+  // Snapshots written before the other boxes end here
+  if (!payload.atEnd()) {
+    uint64_t boxCount = payload.readVarint();
+    for (uint64_t i = 0; i < boxCount; i++) {
+      Box *box = new Box(&server, Labeled_GPS());
+      box->Binary2Object(payload);
+      boxes.push_back(box);
+    }
+  }
+  registerBoxes();
+}
+
+World::~World() {
+  server.attachLog(nullptr);
+  for (auto &user : users) {
+    if (user.second != &hacker) {
+      delete user.second;
+    }
+  }
+  for (auto &card : cards) {
+    delete card.second;
+  }
+  for (Box *box : boxes) {
+    delete box;
+  }
+}
+
+void World::registerBoxes() {
+  boxRegistry.addBox(&box1);
+  for (Box *box : boxes) {
+    boxRegistry.addBox(box);
+  }
+}
+
+Box *World::nearestBox(const GPS_DD &point) {
+  auto found = boxRegistry.nearest(point, 1);
+  return found.empty() ? &box1 : found[0].first;
+}
+
+Json::Value World::snapshotJSON(const string &desc) const {
+  Json::Value json;
+  for (const auto &userPair : users) {
+    json["users"].append(adoptJSON(userPair.second->dump2JSON()));
+  }
+  json["box1"] = adoptJSON(box1.dump2JSON());
+  for (const Box *box : boxes) {
+    json["boxes"].append(adoptJSON(box->dump2JSON()));
+  }
+  json["server"] = adoptJSON(server.dump2JSON());
+  json["emailServer"] = adoptJSON(emailServer.dump2JSON());
+  for (const auto &cardPair : cards) {
+    json["cardsLost"].append(adoptJSON(cardPair.second->dump2JSON()));
+  }
+  json["now"] = clock.now().toString();
+  if (isHacker) {
+    json["hacker"] = adoptJSON(hacker.dump2JSON());
+    json["hacker"]["leakVerificationCode"] = leakVerificationCode;
+  }
+  json["fakeBox"] = adoptJSON(fakeBox.dump2JSON());
+  json["!description"] = desc;
+  return json;
+}
+
+void World::dump2Binary(BinaryWriter &writer) const {
+  writer.beginRecord(BINARY_TAG_WORLD);
+  writer.writeTime(clock.now());
+  writer.writeBool(isHacker);
+  writer.writeSigned(leakVerificationCode);
+  emailServer.dump2Binary(writer);
+  server.dump2Binary(writer);
+  // The hacker is written on its own at the end
+  size_t userCount = 0;
+  for (const auto &userPair : users) {
+    userCount += userPair.second != nullptr && userPair.second != &hacker;
+  }
+  writer.writeVarint(userCount);
+  for (const auto &userPair : users) {
+    if (userPair.second != nullptr && userPair.second != &hacker) {
+      writer.writeString(userPair.first);
+      userPair.second->dump2Binary(writer);
+    }
+  }
+  size_t cardCount = 0;
+  for (const auto &cardPair : cards) {
+    cardCount += cardPair.second != nullptr;
+  }
+  writer.writeVarint(cardCount);
+  for (const auto &cardPair : cards) {
+    if (cardPair.second != nullptr) {
+      cardPair.second->dump2Binary(writer);
+    }
+  }
+  box1.dump2Binary(writer);
+  fakeBox.dump2Binary(writer);
+  if (isHacker) {
+    hacker.dump2Binary(writer);
+  }
+  writer.writeVarint(boxes.size());
+  for (const Box *box : boxes) {
+    box->dump2Binary(writer);
+  }
+  writer.endRecord();
+}
+
+void World::materializeAll() {
+  emailServer.materializeAll();
+  server.materializeAll();
+}
+
+int World::startLog(const string &logFile, const string &snapshotFile) {
+  auto opened = make_unique<WriteAheadLog>(logFile);
+  // Older entries belong to another state, drop them
+  if (!opened->isOpen() || opened->truncate() != EE1520_ERROR_NORMAL) {
+    return EE1520_ERROR_FILE_WRITE;
+  }
+  server.attachLog(opened.get());
+  log = std::move(opened);
+  checkpointFile = snapshotFile;
+  return checkpoint(); // The log starts on this snapshot
+}
+
+int World::checkpoint() {
+  if (!log) {
+    return EE1520_ERROR_NORMAL;
+  }
+  materializeAll(); // The file may be the snapshot the world was loaded from
+  // The marker must be on disk before the snapshot naming it, so a crash
+  // before the log is truncated does not replay what the snapshot holds
+  server.markCheckpoint();
+  if (log->sync() != EE1520_ERROR_NORMAL) {
+    return EE1520_ERROR_FILE_WRITE;
+  }
+  BinaryWriter writer;
+  dump2Binary(writer);
+  int result = writer.save(checkpointFile);
+  if (result != EE1520_ERROR_NORMAL) {
+    return result;
+  }
+  return log->truncate();
+}
@@ -0,0 +1,114 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "Box.h"
+#include "BoxRegistry.h"
+#include "Clock.h"
+#include "EmailServer.h"
+#include "FakeBox.h"
+#include "Server.h"
+#include "User.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Card;
+class WriteAheadLog;
+
+/*
+ * Everything a scenario runs on: the servers, the users, the boxes, the
+ * cards lying around and the hacker. A world can be loaded from a
+ * scenario0.json, from a snapshot written by snapshotJSON, or from a binary
+ * snapshot written by dump2Binary. Loading also sets the clock of the world,
+ * which every part of it reads the time from.
+ *
+ * With a log started, every server mutation is written ahead to it, and
+ * checkpoint writes the world as a binary snapshot and starts the log over.
+ * The state is recovered by loading the last checkpoint and replaying the
+ * log on it with Server::replayLog.
+ */
+class World {
+private:
+  std::unique_ptr<WriteAheadLog> log; // nullptr if not logging
+  std::string checkpointFile;         // Where checkpoint writes the snapshot
+
+  void registerBoxes(); // Adds box1 and boxes to boxRegistry, once loaded
+
+public:
+  SimClock clock;
+  EmailServer emailServer;
+  Server server;
+  // username -> user, also holds the hacker as "hacker" when isHacker
+  std::map<std::string, User *> users;
+  // card id -> card lost by its owner and not picked up yet
+  std::map<std::string, Card *> cards;
+  Box box1;
+  std::vector<Box *> boxes; // The other boxes, from "boxes" of the scenario
+  BoxRegistry boxRegistry;  // box1 and boxes, by location
+  FakeBox fakeBox;
+  User hacker;
+  bool isHacker = false;        // Whether the scenario has a hacker
+  int leakVerificationCode = 0; // Last code leaked to the hacker
+
+  /**
+   * @brief load a world from a scenario or a JSON snapshot
+   * @param arg_json_ptr: the JSON, keys only present in snapshots
+   *                      ("emailServer", "cardsLost", "fakeBox", "now") and
+   *                      "boxes" are optional
+   * @throw ee1520_Exception if the JSON is malformed
+   */
+  World(const Json::Value *arg_json_ptr);
+  /**
+   * @brief load a world from the records of a binary snapshot
+   * @param reader: reader over the records
+   * @param snapshot: the snapshot reader reads from, optional. When given,
+   * card records and emails stay in it and are decoded on first access.
+   * @throw ee1520_Exception if the snapshot is malformed
+   */
+  World(BinaryReader &reader,
+        std::shared_ptr<const BinarySnapshot> snapshot = nullptr);
+  ~World();
+  World(const World &) = delete;
+  World &operator=(const World &) = delete;
+
+  /**
+   * @brief find the box closest to a location
+   * @param point: the location
+   * @return the nearest of box1 and boxes
+   */
+  Box *nearestBox(const GPS_DD &point);
+
+  /**
+   * @brief dump the world as a JSON snapshot
+   * @param desc: the description of the snapshot
+   */
+  Json::Value snapshotJSON(const std::string &desc = "") const;
+  /**
+   * @brief write the world as a binary snapshot record
+   */
+  void dump2Binary(BinaryWriter &writer) const;
+  /**
+   * @brief decode everything still in the snapshot the world was loaded
+   * from, call before overwriting the snapshot file
+   */
+  void materializeAll();
+  /**
+   * @brief log the server mutations from now on, starting with a checkpoint.
+   * Whatever the log held is dropped, recover it first if needed.
+   * @param logFile: the write-ahead log
+   * @param snapshotFile: where checkpoints are written
+   * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_FILE_WRITE
+   */
+  int startLog(const std::string &logFile, const std::string &snapshotFile);
+  /**
+   * @brief write the world as a binary snapshot, atomically, then truncate
+   * the log it holds the entries of. Does nothing without a log. No other
+   * thread may use the world meanwhile.
+   * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_FILE_WRITE, the previous
+   * checkpoint and the log are left usable then
+   */
+  int checkpoint();
+};
+
+#endif // WORLD_H
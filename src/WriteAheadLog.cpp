@@ -0,0 +1,236 @@
+#include "WriteAheadLog.h"
+#include "Core/ee1520_Common.h"
+#include <array>
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+constexpr size_t MAGIC_SIZE = sizeof(WRITE_AHEAD_LOG_MAGIC) - 1;
+constexpr size_t FRAME_HEADER_SIZE = 8;
+
+uint32_t crc32(const char *data, size_t size) {
+  static const array<uint32_t, 256> table = [] {
+    array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    return table;
+  }();
+  uint32_t c = 0xFFFFFFFFu;
+  for (size_t i = 0; i < size; i++) {
+    c = table[(c ^ (uint8_t)data[i]) & 0xFF] ^ (c >> 8);
+  }
+  return c ^ 0xFFFFFFFFu;
+}
+
+void putU32(string &out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back((char)(value >> (8 * i)));
+  }
+}
+
+uint32_t getU32(const char *data) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value |= (uint32_t)(uint8_t)data[i] << (8 * i);
+  }
+  return value;
+}
+
+/**
+ * @brief walk the frames of a log file
+ * @param bytes: the whole file, magic included
+ * @param apply: called with each intact entry, may be empty
+ * @param count[out]: the number of intact entries
+ * @return the offset right after the last intact frame
+ */
+size_t scanFrames(const string &bytes,
+                  const function<void(const string &)> &apply,
+                  uint64_t &count) {
+  size_t offset = MAGIC_SIZE;
+  count = 0;
+  while (bytes.size() - offset >= FRAME_HEADER_SIZE) {
+    uint32_t length = getU32(bytes.data() + offset);
+    uint32_t checksum = getU32(bytes.data() + offset + 4);
+    if (bytes.size() - offset - FRAME_HEADER_SIZE < length) {
+      break; // Torn write
+    }
+    const char *entry = bytes.data() + offset + FRAME_HEADER_SIZE;
+    if (crc32(entry, length) != checksum) {
+      break; // Torn or corrupted write
+    }
+    if (apply) {
+      apply(string(entry, length));
+    }
+    offset += FRAME_HEADER_SIZE + length;
+    count++;
+  }
+  return offset;
+}
+
+bool writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue; // Interrupted before writing anything, try again
+      }
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const string &fileName,
+                             chrono::microseconds commitDelay)
+    : commitDelay(commitDelay) {
+  fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    return;
+  }
+  ifstream ifs(fileName, ios::binary);
+  stringstream buffer;
+  buffer << ifs.rdbuf();
+  string bytes = buffer.str();
+  bool valid;
+  if (bytes.empty()) {
+    valid = writeAll(fd, WRITE_AHEAD_LOG_MAGIC, MAGIC_SIZE) &&
+            ::fdatasync(fd) == 0;
+  } else if (bytes.compare(0, MAGIC_SIZE, WRITE_AHEAD_LOG_MAGIC) == 0) {
+    uint64_t count;
+    size_t end = scanFrames(bytes, nullptr, count);
+    valid = end == bytes.size() || ::ftruncate(fd, end) == 0;
+  } else {
+    valid = false; // Not a log, leave it alone
+  }
+  if (!valid) {
+    ::close(fd);
+    fd = -1;
+    return;
+  }
+  flusher = thread(&WriteAheadLog::flushLoop, this);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  if (fd < 0) {
+    return;
+  }
+  {
+    lock_guard lock(mutex);
+    stopping = true;
+  }
+  queued.notify_one();
+  flusher.join();
+  ::close(fd);
+}
+
+bool WriteAheadLog::isOpen() const { return fd >= 0; }
+
+void WriteAheadLog::flushLoop() {
+  unique_lock lock(mutex);
+  while (true) {
+    queued.wait(lock, [this] { return stopping || !pending.empty(); });
+    if (pending.empty()) {
+      return; // Stopping with nothing left
+    }
+    if (!stopping) {
+      // Let more writers join this commit
+      queued.wait_for(lock, commitDelay, [this] { return stopping; });
+    }
+    string batch;
+    swap(batch, pending);
+    uint64_t target = appended;
+    lock.unlock();
+    bool ok = writeAll(fd, batch.data(), batch.size()) && ::fdatasync(fd) == 0;
+    lock.lock();
+    if (!ok && error == EE1520_ERROR_NORMAL) {
+      error = EE1520_ERROR_FILE_WRITE;
+    }
+    durable = target;
+    flushed.notify_all();
+  }
+}
+
+uint64_t WriteAheadLog::append(const string &entry) {
+  string frame;
+  frame.reserve(FRAME_HEADER_SIZE + entry.size());
+  putU32(frame, (uint32_t)entry.size());
+  putU32(frame, crc32(entry.data(), entry.size()));
+  frame += entry;
+  uint64_t sequence;
+  {
+    lock_guard lock(mutex);
+    pending += frame;
+    sequence = ++appended;
+  }
+  queued.notify_one();
+  return sequence;
+}
+
+int WriteAheadLog::sync(uint64_t sequence) {
+  if (fd < 0) {
+    return EE1520_ERROR_FILE_WRITE;
+  }
+  unique_lock lock(mutex);
+  flushed.wait(lock, [this, sequence] { return durable >= sequence; });
+  return error;
+}
+
+int WriteAheadLog::sync() {
+  uint64_t sequence;
+  {
+    lock_guard lock(mutex);
+    sequence = appended;
+  }
+  return sync(sequence);
+}
+
+int WriteAheadLog::truncate() {
+  int result = sync();
+  if (result != EE1520_ERROR_NORMAL) {
+    return result;
+  }
+  lock_guard lock(mutex);
+  if (::ftruncate(fd, MAGIC_SIZE) != 0 || ::fdatasync(fd) != 0) {
+    return EE1520_ERROR_FILE_WRITE;
+  }
+  return EE1520_ERROR_NORMAL;
+}
+
+int WriteAheadLog::replay(const string &fileName,
+                          const function<void(const string &)> &apply,
+                          uint64_t *count) {
+  uint64_t entryCount = 0;
+  if (count != nullptr) {
+    *count = 0;
+  }
+  ifstream ifs(fileName, ios::binary);
+  if (!ifs.is_open()) {
+    return EE1520_ERROR_NORMAL; // Nothing logged yet
+  }
+  stringstream buffer;
+  buffer << ifs.rdbuf();
+  string bytes = buffer.str();
+  if (bytes.empty()) {
+    return EE1520_ERROR_NORMAL;
+  }
+  if (bytes.compare(0, MAGIC_SIZE, WRITE_AHEAD_LOG_MAGIC) != 0) {
+    return EE1520_ERROR_FILE_READ;
+  }
+  scanFrames(bytes, apply, entryCount);
+  if (count != nullptr) {
+    *count = entryCount;
+  }
+  return EE1520_ERROR_NORMAL;
+}
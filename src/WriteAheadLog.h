@@ -0,0 +1,101 @@
+#ifndef WRITE_AHEAD_LOG_H
+#define WRITE_AHEAD_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define WRITE_AHEAD_LOG_MAGIC "FMCW"
+
+/**
+ * Append-only log of opaque entries with group commit.
+ *
+ *   file  := magic "FMCW" frame*
+ *   frame := length:u32 crc32:u32 entry   -- little-endian
+ *
+ * append only queues an entry and returns at once. A flusher thread waits
+ * commitDelay after the first queued entry, writes everything queued by then
+ * and makes it durable with a single fdatasync, so concurrent writers share
+ * one disk flush. Entries appended before a crash may be lost up to
+ * commitDelay; callers that need more call sync.
+ *
+ * A crash can leave a torn frame at the end, the checksum stops replay there
+ * and opening the log again cuts it off.
+ */
+class WriteAheadLog {
+private:
+  int fd = -1;
+  std::chrono::microseconds commitDelay;
+  std::mutex mutex;
+  std::condition_variable queued;  // Signals the flusher
+  std::condition_variable flushed; // Signals sync waiters
+  std::string pending;             // Frames not written yet
+  uint64_t appended = 0;           // Sequence number of the last entry
+  uint64_t durable = 0;            // Last sequence number on disk
+  int error = 0;                   // First write error, sticky, 0 if none
+  bool stopping = false;
+  std::thread flusher;
+
+  void flushLoop();
+
+public:
+  /**
+   * @brief open a log for appending, creating it if needed
+   * @param fileName: the log file, a torn frame at its end is cut off
+   * @param commitDelay: how long the flusher gathers entries per fdatasync
+   */
+  WriteAheadLog(const std::string &fileName,
+                std::chrono::microseconds commitDelay =
+                    std::chrono::milliseconds(2));
+  /**
+   * @brief flush every queued entry and close the log
+   */
+  ~WriteAheadLog();
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  /**
+   * @brief check if the log file is opened successfully
+   */
+  bool isOpen() const;
+  /**
+   * @brief queue an entry
+   * @param entry: the bytes of the entry
+   * @return the sequence number of the entry, starting at 1
+   */
+  uint64_t append(const std::string &entry);
+  /**
+   * @brief wait until an entry is durable
+   * @param sequence: the sequence number returned by append
+   * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_FILE_WRITE if writing failed
+   */
+  int sync(uint64_t sequence);
+  /**
+   * @brief wait until every entry appended so far is durable
+   */
+  int sync();
+  /**
+   * @brief drop every entry, e.g. once a snapshot holding them is written.
+   * No other thread may append meanwhile.
+   * @return EE1520_ERROR_NORMAL, or EE1520_ERROR_FILE_WRITE
+   */
+  int truncate();
+
+  /**
+   * @brief read every intact entry of a log file in order
+   * @param fileName: the log file
+   * @param apply: called with each entry
+   * @param count[out]: the number of entries read, optional
+   * @return EE1520_ERROR_NORMAL (also for a missing or empty file),
+   *         EE1520_ERROR_FILE_READ if the file is not a log
+   */
+  static int replay(const std::string &fileName,
+                    const std::function<void(const std::string &)> &apply,
+                    uint64_t *count = nullptr);
+};
+
+#endif // WRITE_AHEAD_LOG_H
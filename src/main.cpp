@@ -1,187 +1,102 @@
-#include "Box.h"
-#include "Card.h"
-#include "EmailServer.h"
-#include "Env.h"
-#include "FakeBox.h"
+#include "Metrics.h"
+#include "ScenarioReplay.h"
 #include "Server.h"
-#include "User.h"
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 using namespace std;
 
-bool is_hacker = false;
-
-struct AppContext {
-  std::map<std::string, User *> &users;
-  std::map<std::string, Card *> &cards;
-  EmailServer &emailServer;
-  Server &server;
-  Box &box1;
-  FakeBox &fakeBox;
-  User &hacker;
-  int &leakVerificationCode;
-};
-
-void dumpJSON(const AppContext &appContext, const std::string &outputFile,
-              const std::string &desc = "") {
-  Json::Value json;
-  for (const auto &userPair : appContext.users) {
-    json["users"].append(*userPair.second->dump2JSON());
+/**
+ * @brief write the dump of the metrics registry
+ * @param fileName: the output file, nothing is written if empty
+ * @return false if the file cannot be written
+ */
+bool writeMetrics(const string &fileName) {
+  if (fileName.empty()) {
+    return true;
   }
-  json["box1"] = *appContext.box1.dump2JSON();
-  json["server"] = *appContext.server.dump2JSON();
-  json["emailServer"] = *appContext.emailServer.dump2JSON();
-  for (const auto &cardPair : appContext.cards) {
-    json["cardsLost"].append(*cardPair.second->dump2JSON());
-  }
-  json["now"] = Env::getNowStr();
-  if (is_hacker) {
-    json["hacker"] = *appContext.hacker.dump2JSON();
-    json["hacker"]["leakVerificationCode"] = appContext.leakVerificationCode;
-  }
-  json["fakeBox"] = *appContext.fakeBox.dump2JSON();
-  json["!description"] = desc;
-
-  ofstream ofs(outputFile);
-  if (ofs.is_open()) {
-    ofs << json.toStyledString();
-    ofs.close();
-  } else {
-    cerr << "Failed to open output file." << endl;
+  ofstream ofs(fileName);
+  ofs << MetricsRegistry::global().dump();
+  if (!ofs) {
+    cerr << "Failed to write metrics to " << fileName << endl;
+    return false;
   }
+  return true;
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    cerr << "Usage: " << argv[0] << " <json_file_dir>" << endl;
-    return -1;
+  // --stream: write one base snapshot plus a delta per action into
+  //           scenarioStream.jsonl instead of a scenario<num>.json per action
+  // --jobs <n>: with many directories, replay up to n of them at once
+  // --metrics <file>: write the metrics of the run to file when done
+  // --expiry <remind>,<reject>,<forget>: days after which the server reminds
+  //           owners of found cards, rejects their retrieval and drops the
+  //           reject info, 0 for never
+  // --wal <n>: log server mutations to server.wal in each directory and
+  //           checkpoint to checkpoint.bin there every n actions (0: only
+  //           after loading); recover with snapshotConvert checkpoint.bin
+  //           <output> server.wal
+  bool stream = false;
+  int checkpointEvery = -1;
+  ExpiryPolicy expiry;
+  const ExpiryPolicy *expiryPtr = nullptr;
+  string metricsFile;
+  unsigned int jobs = max(1u, thread::hardware_concurrency());
+  vector<string> dirs;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--stream") {
+      stream = true;
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      jobs = max(1, atoi(argv[++i]));
+    } else if (arg == "--metrics" && i + 1 < argc) {
+      metricsFile = argv[++i];
+    } else if (arg == "--expiry" && i + 1 < argc) {
+      double days[3];
+      if (sscanf(argv[++i], "%lf,%lf,%lf", &days[0], &days[1], &days[2]) !=
+          3) {
+        cerr << "Invalid --expiry: " << argv[i] << endl;
+        return -1;
+      }
+      expiry.remindAfter = (long long)(days[0] * 86400);
+      expiry.rejectAfter = (long long)(days[1] * 86400);
+      expiry.forgetAfter = (long long)(days[2] * 86400);
+      expiryPtr = &expiry;
+    } else if (arg == "--wal" && i + 1 < argc) {
+      checkpointEvery = max(0, atoi(argv[++i]));
+    } else {
+      dirs.push_back(arg);
+    }
   }
-
-  // Load scenario from JSON file
-  string scenarioFile = argv[1] + string("/scenario0.json");
-  Json::Value scenarioJson;
-  if (myFile2JSON(scenarioFile.c_str(), &scenarioJson) != EE1520_ERROR_NORMAL) {
-    cerr << "Failed to read scenario file: " << scenarioFile << endl;
+  if (dirs.empty()) {
+    cerr << "Usage: " << argv[0]
+         << " <json_file_dir>... [--stream] [--jobs <n>] [--metrics <file>]"
+            " [--expiry <remind>,<reject>,<forget>] [--wal <n>]"
+         << endl;
     return -1;
   }
-  try {
-    // Initialize environment
-    map<string, User *> users;
-    map<string, Card *> cards;
-    EmailServer emailServer;
-    Server server{&emailServer, &scenarioJson["server"]};
-    for (int i = 0; i < scenarioJson["users"].size(); i++) {
-      string userId = scenarioJson["users"][i]["username"].asString();
-      users[userId] =
-          new User(&server, &emailServer, &scenarioJson["users"][i]);
-    }
-    Box box1{&server, &scenarioJson["box1"]};
-    FakeBox fakeBox{};
-    Env::setNow(string("2025-06-01T12:00:00+0800"));
-
-    User hacker{&server, &emailServer};
 
-    int leakVerificationCode;
-    if (scenarioJson.isMember("hacker")) {
-      hacker.JSON2Object(&scenarioJson["hacker"]);
-      is_hacker = true;
-      users["hacker"] = &hacker;
-    }
-
-    AppContext appContext{users, cards,   emailServer, server,
-                          box1,  fakeBox, hacker,      leakVerificationCode};
-
-    // Process actions from JSON file
-    string actionFile = argv[1] + string("/actions.json");
-    Json::Value actionsJson;
-    if (myFile2JSON(actionFile.c_str(), &actionsJson) != EE1520_ERROR_NORMAL) {
-      cerr << "Failed to read action file: " << actionFile << endl;
-      return -1;
-    }
-
-    for (int i = 0; i < actionsJson.size(); i++) {
-      string action = actionsJson[i]["action"].asString();
-      string who = actionsJson[i]["who"].asString();
-      User &user = *users[who];
-      // Related to card
-      if (action == "addCard") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        user.addCardToServer(cardId);
-      } else if (action == "removeCard") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        cards[cardId] = user.removeCard(cardId);
-      } else if (action == "getCard") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        user.addCard(cards[cardId]);
-        cards.erase(cardId);
-      } else if (action == "dropCard") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        user.dropCard(&box1, cardId);
-      } else if (action == "retrieveCard") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        string paymentCardId = actionsJson[i]["paymentCardId"].asString();
-        user.retrieveCard(&box1, cardId, paymentCardId);
-      }
-      // Related to email
-      else if (action == "readMail") {
-        int mailId = actionsJson[i]["mailId"].asInt();
-        user.readMail(mailId);
-      }
-      // Related to server
-      else if (action == "setVerificationType") {
-        string verificationType = actionsJson[i]["verificationType"].asString();
-        if (verificationType == "EMAIL") {
-          user.setVerificationType(UserInfo::EMAIL);
-        } else if (verificationType == "APP") {
-          user.setVerificationType(UserInfo::APP);
-        } else {
-          cerr << "Unknown verification type: " << verificationType << endl;
-          return -1;
-        }
-      } else if (action == "redeemReward") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        int amount = actionsJson[i]["amount"].asInt();
-        user.redeemReward(&box1, cardId, amount);
-      } else if (action == "rejectRetrieve") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        user.rejectRetrieve(cardId);
-      }
-      // Related to hacking
-      else if (action == "leakVerificationCode") {
-        leakVerificationCode = user.leakVerificationCode();
-      } else if (action == "stealCard") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        string username = actionsJson[i]["username"].asString();
-        string passwd = actionsJson[i]["password"].asString();
-        string paymentCardId =
-            actionsJson[i].get("paymentCardId", "").asString();
-        Card *card = hacker.stealCard(&box1, cardId, username, passwd,
-                                      leakVerificationCode, paymentCardId);
-        if (card) {
-          cout << "Hacker stole card: " << card->getId() << endl;
-        } else {
-          cerr << "Hacker failed to steal card: " << cardId << endl;
-        }
-      } else if (action == "dropToFake") {
-        string cardId = actionsJson[i]["cardId"].asString();
-        user.dropCard(&fakeBox, cardId);
-      } else {
-        cerr << "Unknown action: " << action << endl;
-        return -1;
-      }
-      if (actionsJson[i]["timespan"].isString()) {
-        Env::moveNow(actionsJson[i]["timespan"].asString());
-      } else {
-        Env::moveNow(1, 0, 0);
-      }
-      dumpJSON(appContext,
-               argv[1] + string("/scenario") + to_string(i + 1) +
-                   string(".json"),
-               "Scenario after action " + to_string(i + 1) + ": " + action);
+  int status = 0;
+  if (dirs.size() == 1) {
+    status =
+        replayScenario(dirs[0], stream, expiryPtr, checkpointEvery).status;
+    return writeMetrics(metricsFile) ? status : -1;
+  }
+  // Many directories: replay them in parallel and report their timings
+  vector<ScenarioResult> results =
+      replayScenarios(dirs, stream, jobs, expiryPtr, checkpointEvery);
+  for (const ScenarioResult &result : results) {
+    cout << "{\"scenario\": \"" << result.dir << "\", \"status\": "
+         << result.status << ", \"actions\": " << result.actions
+         << ", \"loadSeconds\": " << result.loadSeconds
+         << ", \"replaySeconds\": " << result.replaySeconds << "}" << endl;
+    if (result.status != 0) {
+      status = -1;
     }
-  } catch (ee1520_Exception &e) {
-    cerr << "Exception occurred: " << e.dump2JSON()->toStyledString() << endl;
-    return -1;
   }
-  return 0;
+  return writeMetrics(metricsFile) ? status : -1;
 }
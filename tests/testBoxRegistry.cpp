@@ -0,0 +1,177 @@
+// Nearest-box queries of BoxRegistry against a brute-force scan over random
+// boxes, and the routing of a world's box actions to the nearest box.
+#include "BoxRegistry.h"
+#include "Box.h"
+#include "Core/BinaryIO.h"
+#include "World.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+namespace {
+int checks = 0;
+int failures = 0;
+
+// GPS_DD::distance goes through acos, it is only that close to the k-d tree
+constexpr double TOLERANCE_MILES = 1e-3;
+
+void check(bool condition, const string &what) {
+  checks++;
+  if (!condition) {
+    failures++;
+    cerr << "FAILED: " << what << endl;
+  }
+}
+
+// Uniform over the sphere
+GPS_DD randomPoint(mt19937_64 &rng) {
+  uniform_real_distribution<> unit(-1, 1);
+  uniform_real_distribution<> longitude(-180, 180);
+  return GPS_DD(asin(unit(rng)) * 180 / 3.14159265358979323846,
+                longitude(rng));
+}
+
+void testQueries(size_t boxCount, size_t queryCount) {
+  mt19937_64 rng(boxCount);
+  vector<Box *> boxes;
+  BoxRegistry registry;
+  for (size_t i = 0; i < boxCount; i++) {
+    GPS_DD point = randomPoint(rng);
+    boxes.push_back(new Box(nullptr, Labeled_GPS(point.latitude,
+                                                 point.longitude,
+                                                 "box" + to_string(i))));
+    registry.addBox(boxes.back());
+  }
+  check(registry.size() == boxCount, "size");
+
+  const size_t ks[] = {1, 5, 32};
+  const double radii[] = {10, 300, 3000};
+  for (size_t q = 0; q < queryCount; q++) {
+    GPS_DD point = randomPoint(rng);
+    vector<pair<double, Box *>> scan;
+    for (Box *box : boxes) {
+      scan.emplace_back(point.distance(box->getGPSLocation()), box);
+    }
+    sort(scan.begin(), scan.end());
+    string which = "query " + to_string(q) + ": ";
+
+    for (size_t k : ks) {
+      auto found = registry.nearest(point, k);
+      bool same = found.size() == min(k, boxCount);
+      for (size_t i = 0; same && i < found.size(); i++) {
+        // Ties aside, the i-th nearest is at the i-th smallest distance
+        same = fabs(found[i].second - scan[i].first) <= TOLERANCE_MILES &&
+               fabs(point.distance(found[i].first->getGPSLocation()) -
+                    found[i].second) <= TOLERANCE_MILES;
+      }
+      check(same, which + "nearest " + to_string(k));
+    }
+
+    for (double miles : radii) {
+      auto found = registry.withinRadius(point, miles);
+      vector<Box *> foundBoxes;
+      bool same = true;
+      for (const auto &entry : found) {
+        foundBoxes.push_back(entry.first);
+        same = same && entry.second <= miles + TOLERANCE_MILES;
+      }
+      sort(foundBoxes.begin(), foundBoxes.end());
+      for (const auto &entry : scan) {
+        if (entry.first > miles - TOLERANCE_MILES) {
+          break; // Boxes on the edge may go either way
+        }
+        same = same && binary_search(foundBoxes.begin(), foundBoxes.end(),
+                                     entry.second);
+      }
+      check(same, which + "within " + to_string((int)miles) + " miles");
+    }
+  }
+
+  // Removed boxes are never found again
+  Box *nearestBox = registry.nearest(GPS_DD(25.0478, 121.5319), 1)[0].first;
+  check(registry.removeBox(nearestBox) && !registry.removeBox(nearestBox),
+        "remove once");
+  check(registry.nearest(GPS_DD(25.0478, 121.5319), 1)[0].first !=
+            nearestBox,
+        "removed box not found");
+  for (Box *box : boxes) {
+    delete box;
+  }
+}
+
+Json::Value boxJSON(double latitude, double longitude, const string &label) {
+  Json::Value json;
+  json["GPS"]["latitude"] = latitude;
+  json["GPS"]["longitude"] = longitude;
+  json["GPS"]["label"] = label;
+  json["cards"] = Json::Value(Json::arrayValue);
+  return json;
+}
+
+string nearestLabel(World &world, double latitude, double longitude) {
+  return world.nearestBox(GPS_DD(latitude, longitude))
+      ->getGPSLocation()
+      .label;
+}
+
+void checkRouting(World &world, const string &which) {
+  check(world.boxes.size() == 2, which + "boxes loaded");
+  check(nearestLabel(world, 25.05, 121.53) == "Taipei 101",
+        which + "box1 nearest");
+  check(nearestLabel(world, 25.3, 121.3) == "Box 1", which + "box 1 nearest");
+  check(nearestLabel(world, 22.6, 120.3) == "Box 2", which + "box 2 nearest");
+}
+
+void testWorld() {
+  Json::Value scenario;
+  scenario["server"]["address"] = "server@findmycard.com";
+  scenario["server"]["emailPassword"] = "serverEmailPassword";
+  scenario["server"]["users"] = Json::Value(Json::objectValue);
+  scenario["server"]["cards"] = Json::Value(Json::arrayValue);
+  scenario["box1"] = boxJSON(25.0478, 121.5319, "Taipei 101");
+  scenario["boxes"].append(boxJSON(25.2, 121.4, "Box 1"));
+  scenario["boxes"].append(boxJSON(22.6273, 120.3014, "Box 2"));
+  World world(&scenario);
+  checkRouting(world, "JSON: ");
+
+  Json::Value snapshot = world.snapshotJSON();
+  check(snapshot["boxes"].size() == 2, "boxes in the JSON snapshot");
+  World fromJSON(&snapshot);
+  checkRouting(fromJSON, "JSON snapshot: ");
+
+  string fileName = "/tmp/testBoxRegistry" + to_string(getpid()) + ".bin";
+  BinaryWriter writer;
+  world.dump2Binary(writer);
+  BinarySnapshot binary;
+  check(writer.save(fileName) == EE1520_ERROR_NORMAL &&
+            binary.load(fileName) == EE1520_ERROR_NORMAL,
+        "binary snapshot readable");
+  remove(fileName.c_str());
+  BinaryReader reader = binary.records();
+  World fromBinary(reader);
+  checkRouting(fromBinary, "binary snapshot: ");
+
+  // Without other boxes everything goes to box1, as before
+  Json::Value single = scenario;
+  single.removeMember("boxes");
+  World box1Only(&single);
+  check(box1Only.nearestBox(GPS_DD(-33.9, 151.2)) == &box1Only.box1,
+        "box1 only");
+}
+} // namespace
+
+int main() {
+  testQueries(20000, 200);
+  testQueries(3, 20);
+  testWorld();
+
+  cout << "{\"test\": \"BoxRegistry\", \"checks\": " << checks
+       << ", \"failures\": " << failures << "}" << endl;
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+// Round trips of JvTime through its string, JSON and binary forms: the time
+// read back must have the same epoch, with or without a zone in the string.
+#include "Core/BinaryIO.h"
+#include "Core/JvTime.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+int checks = 0;
+int failures = 0;
+
+void check(bool condition, const string &what) {
+  checks++;
+  if (!condition) {
+    failures++;
+    cerr << "FAILED: " << what << endl;
+  }
+}
+
+void testRoundTrip(const char *timeString) {
+  JvTime time(timeString);
+  string which = string(timeString) + ": ";
+
+  JvTime fromString(time.toString().c_str());
+  check(fromString.getEpoch() == time.getEpoch(), which + "string");
+
+  JvTime fromJSON;
+  Json::Value json = adoptJSON(time.dump2JSON());
+  fromJSON.JSON2Object(&json);
+  check(fromJSON.getEpoch() == time.getEpoch() && fromJSON == time,
+        which + "JSON");
+
+  string fileName = "/tmp/testJvTime" + to_string(getpid()) + ".bin";
+  BinaryWriter writer;
+  writer.writeTime(time);
+  BinarySnapshot snapshot;
+  check(writer.save(fileName) == EE1520_ERROR_NORMAL &&
+            snapshot.load(fileName) == EE1520_ERROR_NORMAL,
+        which + "binary readable");
+  remove(fileName.c_str());
+  BinaryReader reader = snapshot.records();
+  JvTime fromBinary = reader.readTime();
+  check(fromBinary.getEpoch() == time.getEpoch() &&
+            fromBinary.toString() == time.toString(),
+        which + "binary");
+}
+} // namespace
+
+int main() {
+  testRoundTrip("2025-06-01T12:00:00+0800");
+  testRoundTrip("2025-06-01T12:00:00+0000");
+  testRoundTrip("2025-06-01T12:00:00+");
+  testRoundTrip("1969-12-31T23:59:59+0530");
+  testRoundTrip("2024-02-29T00:00:00+1200");
+
+  // The fields are read as UTC, the zone does not move the time
+  check(JvTime("2025-06-01T12:00:00+0800").getEpoch() == 1748779200,
+        "epoch of the fields");
+  check(JvTime("2025-06-01T12:00:00+0800") == JvTime("2025-06-01T12:00:00+"),
+        "zone not applied");
+
+  cout << "{\"test\": \"JvTime\", \"checks\": " << checks
+       << ", \"failures\": " << failures << "}" << endl;
+  return failures == 0 ? 0 : 1;
+}
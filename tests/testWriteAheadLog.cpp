@@ -0,0 +1,218 @@
+// Recovery test of the write-ahead log.
+// For every scenario directory given, the actions are replayed with the
+// server mutations logged and a checkpoint halfway, then the world is
+// recovered from the last checkpoint and the log, and its server state is
+// compared with the one that wrote them, 2FA ids and secrets included. Users
+// switch to the app after the checkpoint, so 2FA set up in the log comes on
+// top of the loaded one. Also checked: a torn frame at the end of the log,
+// and a checkpoint cut short before the log was truncated.
+#include "ActionDispatcher.h"
+#include "Core/BinaryIO.h"
+#include "World.h"
+#include "WriteAheadLog.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+const size_t SWITCHED_USERS = 2; // Users switched to the app after a checkpoint
+int checks = 0;
+int failures = 0;
+
+void check(bool condition, const string &what) {
+  checks++;
+  if (!condition) {
+    failures++;
+    cerr << "FAILED: " << what << endl;
+  }
+}
+
+string readFile(const string &fileName) {
+  ifstream ifs(fileName, ios::binary);
+  stringstream buffer;
+  buffer << ifs.rdbuf();
+  return buffer.str();
+}
+
+void writeFile(const string &fileName, const string &bytes) {
+  ofstream ofs(fileName, ios::binary | ios::trunc);
+  ofs << bytes;
+}
+
+/**
+ * @brief run actions [begin, end) of a batch, moving the clock like a replay
+ */
+void runActions(World &world, ActionDispatcher &dispatcher,
+                const ActionBatch &batch, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    dispatcher.run(batch.actions[i]);
+    world.clock.advance(batch.actions[i].timespan);
+    world.server.runTimers();
+  }
+}
+
+/**
+ * @brief the server state compared: its JSON, which leaves out 2FA, and the
+ * 2FA id and secret of every user
+ */
+Json::Value serverState(const Server &server) {
+  Json::Value state = adoptJSON(server.dump2JSON());
+  for (const string &username : state["users"].getMemberNames()) {
+    pair<long long, long long> twoFA = server.get2FA(username);
+    state["2FA"][username].append((Json::Int64)twoFA.first);
+    state["2FA"][username].append((Json::Int64)twoFA.second);
+  }
+  return state;
+}
+
+/**
+ * @brief switch the first users verifying by email to the app, which sets up
+ * their 2FA
+ */
+void switchToApp(World &world, size_t count) {
+  // Users whose cards are found cannot switch, keep their complaints quiet
+  streambuf *stderrBuffer = cerr.rdbuf();
+  ostringstream errorOutput;
+  cerr.rdbuf(errorOutput.rdbuf());
+  for (const auto &user : world.users) {
+    if (count == 0) {
+      break;
+    }
+    if (user.first != "hacker" &&
+        world.server.get2FA(user.first).first == -1) {
+      user.second->setVerificationType(UserInfo::APP);
+      count--;
+    }
+  }
+  cerr.rdbuf(stderrBuffer);
+}
+
+/**
+ * @brief load the last checkpoint and replay the log on it
+ * @param count[out]: the number of entries replayed
+ * @return the recovered server state
+ */
+Json::Value recoverServer(const string &checkpointFile, const string &logFile,
+                          uint64_t &count) {
+  auto snapshot = make_shared<BinarySnapshot>();
+  if (snapshot->map(checkpointFile) != EE1520_ERROR_NORMAL) {
+    return Json::Value();
+  }
+  BinaryReader reader = snapshot->records();
+  World world{reader, snapshot};
+  if (world.server.replayLog(logFile, &count) != EE1520_ERROR_NORMAL) {
+    return Json::Value();
+  }
+  return serverState(world.server);
+}
+
+void testScenario(const string &dir, const string &tmpDir) {
+  Json::Value scenarioJson, actionsJson;
+  if (myFile2JSON((dir + "/scenario0.json").c_str(), &scenarioJson) !=
+          EE1520_ERROR_NORMAL ||
+      myFile2JSON((dir + "/actions.json").c_str(), &actionsJson) !=
+          EE1520_ERROR_NORMAL) {
+    check(false, dir + ": scenario readable");
+    return;
+  }
+  ActionBatch batch = ActionBatch::compile(actionsJson);
+  size_t half = batch.actions.size() / 2;
+  string logFile = tmpDir + "/server.wal";
+  string checkpointFile = tmpDir + "/checkpoint.bin";
+
+  // Logged run, checkpointed after loading and halfway
+  Json::Value expected;
+  {
+    World world{&scenarioJson};
+    ActionDispatcher dispatcher(world, batch);
+    check(world.startLog(logFile, checkpointFile) == EE1520_ERROR_NORMAL,
+          dir + ": log started");
+    runActions(world, dispatcher, batch, 0, half);
+    check(world.checkpoint() == EE1520_ERROR_NORMAL, dir + ": checkpoint");
+    switchToApp(world, SWITCHED_USERS);
+    runActions(world, dispatcher, batch, half, batch.actions.size());
+    expected = serverState(world.server);
+  } // Flushes the log
+  uint64_t count = 0;
+  check(recoverServer(checkpointFile, logFile, count) == expected,
+        dir + ": recovered state");
+  uint64_t fullCount = count;
+
+  // A frame torn while being appended: only its header and part of it
+  string log = readFile(logFile);
+  string torn = log;
+  torn += string("\x40\x00\x00\x00\x12\x34\x56\x78", 8) + "partial";
+  writeFile(logFile, torn);
+  check(recoverServer(checkpointFile, logFile, count) == expected &&
+            count == fullCount,
+        dir + ": torn frame ignored");
+  { WriteAheadLog reopened(logFile); }
+  check(readFile(logFile) == log, dir + ": torn frame cut off on open");
+  if (fullCount > 0) {
+    // The last real entry torn: everything before it is still recovered
+    writeFile(logFile, log.substr(0, log.size() - 1));
+    recoverServer(checkpointFile, logFile, count);
+    check(count == fullCount - 1, dir + ": torn last entry dropped");
+  }
+
+  // A checkpoint written but the log not truncated after it. The secrets of
+  // 2FA are random, so this run is compared with its own state
+  {
+    WriteAheadLog wal(logFile);
+    World world{&scenarioJson};
+    ActionDispatcher dispatcher(world, batch);
+    BinaryWriter writer;
+    check(wal.truncate() == EE1520_ERROR_NORMAL, dir + ": log truncated");
+    world.server.attachLog(&wal);
+    world.server.markCheckpoint();
+    world.dump2Binary(writer);
+    check(writer.save(checkpointFile) == EE1520_ERROR_NORMAL,
+          dir + ": first checkpoint");
+    runActions(world, dispatcher, batch, 0, half);
+    world.server.markCheckpoint();
+    check(wal.sync() == EE1520_ERROR_NORMAL, dir + ": marker durable");
+    BinaryWriter halfway;
+    world.dump2Binary(halfway);
+    check(halfway.save(checkpointFile) == EE1520_ERROR_NORMAL,
+          dir + ": interrupted checkpoint");
+    switchToApp(world, SWITCHED_USERS);
+    runActions(world, dispatcher, batch, half, batch.actions.size());
+    expected = serverState(world.server);
+    world.server.attachLog(nullptr);
+  }
+  check(recoverServer(checkpointFile, logFile, count) == expected,
+        dir + ": entries in the checkpoint not replayed twice");
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " <scenario_dir>..." << endl;
+    return -1;
+  }
+  char tmpTemplate[] = "/tmp/testWriteAheadLogXXXXXX";
+  if (mkdtemp(tmpTemplate) == nullptr) {
+    cerr << "Failed to create a temporary directory" << endl;
+    return -1;
+  }
+  string tmpDir = tmpTemplate;
+  // The actions of users print what they do, keep the report readable
+  streambuf *stdoutBuffer = cout.rdbuf();
+  ostringstream actionOutput;
+  cout.rdbuf(actionOutput.rdbuf());
+  for (int i = 1; i < argc; i++) {
+    testScenario(argv[i], tmpDir);
+  }
+  cout.rdbuf(stdoutBuffer);
+  remove((tmpDir + "/server.wal").c_str());
+  remove((tmpDir + "/checkpoint.bin").c_str());
+  rmdir(tmpDir.c_str());
+  cout << "{\"test\": \"WriteAheadLog\", \"checks\": " << checks
+       << ", \"failures\": " << failures << "}" << endl;
+  return failures == 0 ? 0 : 1;
+}
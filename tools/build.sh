@@ -11,6 +11,9 @@ mkdir -p build
 cd build
 mkdir -p obj
 mkdir -p obj/Core
+mkdir -p obj/bench
+mkdir -p obj/tools
+mkdir -p obj/tests
 cd ..
 
 # 編譯
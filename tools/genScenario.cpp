@@ -0,0 +1,495 @@
+// Synthesizes a scenario directory (scenario0.json and actions.json) of any
+// size, for load testing Server, Box and EmailServer.
+// A shadow model of the world follows every card (held, lost, found, in the
+// box, ...), every mailbox and the verification codes read, so only actions
+// the replay can run are generated: e.g. a card is retrieved only by its
+// owner, with the code of its latest "found" mail and a payment card that
+// can pay the reward. The same options and seed give the same files.
+#include "Core/GPS.h"
+#include "Core/ee1520_Common.h"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+using namespace std;
+
+namespace {
+struct Options {
+  unsigned long long seed = 1;
+  long long users = 100;
+  long long cards = 3; // Cards per user, the first one pays rewards
+  long long actions = 1000;
+  double app = 0.5;    // Fraction of users verifying with APP
+  bool hacker = true;  // Add a hacker stealing cards from the box
+  long long boxes = 0; // Boxes besides box1, box actions then give the
+                       // location of the box they are meant for
+  string timespan;     // Clock step after each action, 1h if empty
+  // Relative weights of the kinds of traffic
+  map<string, double> weights = {
+      {"lose", 4},   {"find", 4},  {"drop", 4},   {"retrieve", 3},
+      {"reject", 1}, {"redeem", 1}, {"steal", 1}, {"read", 1},
+      {"switch", 1}, {"fake", 1}};
+};
+
+enum CardState {
+  HELD,     // Held by its owner
+  LOST,     // Lying in the world
+  FOUND,    // Held by a finder
+  IN_BOX,   // Dropped in the box, the owner is notified
+  REJECTED, // Left in the box for good
+  STOLEN,   // Retrieved by the hacker
+  PHISHED,  // Dropped in the fake box
+  STATE_COUNT,
+};
+
+struct SimCard {
+  string id;
+  long long owner;
+  long long balance;
+  CardState state = HELD;
+  long long holder;        // User holding the card in HELD and FOUND
+  long long finder = -1;   // User who dropped the card in the box
+  long long foundMail = 0; // Owner's mail about the drop, while IN_BOX
+  long long box = 0;       // Box it was dropped in, 0 for box1
+  bool codeRead = false;   // The owner read foundMail
+  size_t slot = 0;         // Position in its state pool
+};
+
+struct SimUser {
+  string name;
+  string password;
+  bool app = false;
+  long long wallet;              // Card paying the rewards, never lost
+  long long walletBalance;       // Lower bound, redemptions only add to it
+  long long mails = 0;           // Mails received
+  vector<long long> plainMails;  // Mails without a verification code
+  long long inBox = 0;           // Owned cards IN_BOX
+  bool typeLocked = false;       // A rejected card keeps the type from
+                                 // changing on the server
+};
+
+class Generator {
+private:
+  const Options &options;
+  mt19937_64 rng;
+  vector<SimUser> users; // The hacker is the last one if enabled
+  vector<SimCard> cards;
+  vector<long long> pools[STATE_COUNT]; // Cards by state, wallets left out
+  Json::Value actions{Json::arrayValue};
+
+  long long pick(long long count) {
+    return uniform_int_distribution<long long>(0, count - 1)(rng);
+  }
+  bool chance(double p) { return uniform_real_distribution<>(0, 1)(rng) < p; }
+  long long regularUsers() const {
+    return options.hacker ? users.size() - 1 : users.size();
+  }
+
+  void setState(long long c, CardState state) {
+    SimCard &card = cards[c];
+    vector<long long> &from = pools[card.state];
+    cards[from.back()].slot = card.slot;
+    from[card.slot] = from.back();
+    from.pop_back();
+    card.state = state;
+    card.slot = pools[state].size();
+    pools[state].push_back(c);
+  }
+
+  long long receiveMail(SimUser &user) { return user.mails++; }
+  long long randomCard(CardState state) {
+    return pools[state][pick(pools[state].size())];
+  }
+  static long long retrieveFee(const SimCard &card) {
+    return min(30LL, card.balance / 10);
+  }
+  long long randomBox() {
+    return options.boxes > 0 ? pick(options.boxes + 1) : 0;
+  }
+  // Box 0 is box1, the others lie on a grid around it
+  static GPS_DD boxLocation(long long box) {
+    if (box == 0) {
+      return GPS_DD(25.0478, 121.5319);
+    }
+    return GPS_DD(24.9 + 0.02 * ((box - 1) % 50),
+                  121.4 + 0.02 * ((box - 1) / 50));
+  }
+  // Sends a box action to the box nearest to the actor, i.e. to box
+  void locate(Json::Value &action, long long box) const {
+    if (options.boxes > 0) {
+      GPS_DD location = boxLocation(box);
+      action["latitude"] = location.latitude;
+      action["longitude"] = location.longitude;
+    }
+  }
+
+  Json::Value &emit(const string &name, const SimUser &who) {
+    Json::Value &action = actions.append(Json::Value(Json::objectValue));
+    action["action"] = name;
+    action["who"] = who.name;
+    if (!options.timespan.empty()) {
+      action["timespan"] = options.timespan;
+    }
+    return action;
+  }
+
+  void retrieved(SimCard &card) {
+    SimUser &owner = users[card.owner];
+    owner.inBox--;
+    owner.plainMails.push_back(receiveMail(owner));
+    SimUser &finder = users[card.finder];
+    finder.plainMails.push_back(receiveMail(finder));
+  }
+
+  bool lose();
+  bool find();
+  bool drop(bool fake);
+  bool dropToBox() { return drop(false); }
+  bool dropToFake() { return drop(true); }
+  bool retrieve();
+  bool reject();
+  bool redeem();
+  bool steal();
+  bool read();
+  bool switchType();
+
+public:
+  Generator(const Options &options);
+  Json::Value scenario() const;
+  Json::Value generate();
+};
+
+Generator::Generator(const Options &options)
+    : options(options), rng(options.seed) {
+  long long count = options.users + (options.hacker ? 1 : 0);
+  users.resize(count);
+  for (long long u = 0; u < count; u++) {
+    SimUser &user = users[u];
+    bool isHacker = u == options.users;
+    user.name = isHacker ? "hacker" : "user" + to_string(u);
+    user.password = "pw" + to_string(rng() % 1000000);
+    user.app = !isHacker && chance(options.app);
+    for (long long k = 0; k < (isHacker ? 1 : options.cards); k++) {
+      SimCard card;
+      card.id = to_string(100000000000LL + (long long)cards.size());
+      card.owner = card.holder = u;
+      if (k == 0) {
+        // Enough for thousands of rewards
+        card.balance = 100000;
+        user.wallet = cards.size();
+        user.walletBalance = card.balance;
+      } else {
+        card.balance = 10 + pick(1000);
+        if (!isHacker) {
+          card.slot = pools[HELD].size();
+          pools[HELD].push_back(cards.size());
+        }
+      }
+      cards.push_back(card);
+    }
+  }
+}
+
+Json::Value Generator::scenario() const {
+  Json::Value json;
+  json["users"] = Json::Value(Json::arrayValue);
+  json["server"]["address"] = "server@findmycard.com";
+  json["server"]["emailPassword"] = "serverEmailPassword";
+  json["server"]["cards"] = Json::Value(Json::arrayValue);
+  for (size_t u = 0; u < users.size(); u++) {
+    const SimUser &user = users[u];
+    Json::Value userJson;
+    userJson["username"] = user.name;
+    userJson["password"] = user.password;
+    userJson["email"] = user.name + "@mail.com";
+    userJson["emailPassword"] = "e" + user.password;
+    userJson["verificationType"] = user.app ? "APP" : "EMAIL";
+    userJson["cards"] = Json::Value(Json::arrayValue);
+    // Registered up front, as addCard actions would be
+    Json::Value &serverUser = json["server"]["users"][user.name];
+    serverUser["password"] = user.password;
+    serverUser["email"] = userJson["email"];
+    serverUser["nickname"] = "";
+    serverUser["verificationType"] = userJson["verificationType"];
+    // The cards of a user are stored together, its wallet first
+    for (size_t c = user.wallet;
+         c < cards.size() && cards[c].owner == (long long)u; c++) {
+      const SimCard &card = cards[c];
+      Json::Value cardJson;
+      cardJson["id"] = card.id;
+      cardJson["balance"] = (Json::Value::Int64)card.balance;
+      userJson["cards"].append(cardJson);
+      Json::Value ownerJson;
+      ownerJson["id"] = card.id;
+      ownerJson["ownerUsername"] = user.name;
+      json["server"]["cards"].append(ownerJson);
+    }
+    if (options.hacker && u + 1 == users.size()) {
+      json["hacker"] = userJson;
+    } else {
+      json["users"].append(userJson);
+    }
+  }
+  json["box1"]["GPS"]["latitude"] = 25.0478;
+  json["box1"]["GPS"]["longitude"] = 121.5319;
+  json["box1"]["GPS"]["label"] = "Taipei 101";
+  json["box1"]["cards"] = Json::Value(Json::arrayValue);
+  for (long long b = 1; b <= options.boxes; b++) {
+    GPS_DD location = boxLocation(b);
+    Json::Value box;
+    box["GPS"]["latitude"] = location.latitude;
+    box["GPS"]["longitude"] = location.longitude;
+    box["GPS"]["label"] = "Box " + to_string(b);
+    box["cards"] = Json::Value(Json::arrayValue);
+    json["boxes"].append(box);
+  }
+  return json;
+}
+
+bool Generator::lose() {
+  if (pools[HELD].empty()) {
+    return false;
+  }
+  long long c = randomCard(HELD);
+  emit("removeCard", users[cards[c].owner])["cardId"] = cards[c].id;
+  setState(c, LOST);
+  return true;
+}
+
+bool Generator::find() {
+  if (pools[LOST].empty() || regularUsers() < 2) {
+    return false;
+  }
+  long long c = randomCard(LOST);
+  long long finder = pick(regularUsers() - 1);
+  if (finder >= cards[c].owner) {
+    finder++; // Anyone but the owner
+  }
+  emit("getCard", users[finder])["cardId"] = cards[c].id;
+  cards[c].holder = finder;
+  setState(c, FOUND);
+  return true;
+}
+
+bool Generator::drop(bool fake) {
+  if (pools[FOUND].empty()) {
+    return false;
+  }
+  long long c = randomCard(FOUND);
+  SimCard &card = cards[c];
+  Json::Value &action =
+      emit(fake ? "dropToFake" : "dropCard", users[card.holder]);
+  action["cardId"] = card.id;
+  if (fake) {
+    setState(c, PHISHED);
+    return true;
+  }
+  card.box = randomBox();
+  locate(action, card.box);
+  SimUser &owner = users[card.owner];
+  card.finder = card.holder;
+  card.foundMail = receiveMail(owner);
+  card.codeRead = false;
+  if (owner.app) {
+    owner.plainMails.push_back(card.foundMail);
+  }
+  owner.inBox++;
+  setState(c, IN_BOX);
+  return true;
+}
+
+bool Generator::retrieve() {
+  if (pools[IN_BOX].empty()) {
+    return false;
+  }
+  long long c = randomCard(IN_BOX);
+  SimCard &card = cards[c];
+  SimUser &owner = users[card.owner];
+  if (!owner.app && !card.codeRead) {
+    // Owners verifying by EMAIL read the code first
+    emit("readMail", owner)["mailId"] = (Json::Value::Int64)card.foundMail;
+    card.codeRead = true;
+    return true;
+  }
+  if (owner.walletBalance < retrieveFee(card)) {
+    return false;
+  }
+  Json::Value &action = emit("retrieveCard", owner);
+  action["cardId"] = card.id;
+  action["paymentCardId"] = cards[owner.wallet].id;
+  locate(action, card.box);
+  owner.walletBalance -= retrieveFee(card);
+  retrieved(card);
+  card.holder = card.owner;
+  setState(c, HELD);
+  return true;
+}
+
+bool Generator::reject() {
+  if (pools[IN_BOX].empty()) {
+    return false;
+  }
+  long long c = randomCard(IN_BOX);
+  SimUser &owner = users[cards[c].owner];
+  emit("rejectRetrieve", owner)["cardId"] = cards[c].id;
+  owner.inBox--;
+  owner.typeLocked = true;
+  setState(c, REJECTED);
+  return true;
+}
+
+bool Generator::redeem() {
+  SimUser &user = users[pick(regularUsers())];
+  Json::Value &action = emit("redeemReward", user);
+  action["cardId"] = cards[user.wallet].id;
+  action["amount"] = chance(0.5) ? -1 : (int)(1 + pick(30));
+  locate(action, randomBox());
+  return true;
+}
+
+bool Generator::steal() {
+  if (!options.hacker || pools[IN_BOX].empty()) {
+    return false;
+  }
+  long long c = randomCard(IN_BOX);
+  SimCard &card = cards[c];
+  SimUser &owner = users[card.owner];
+  SimUser &hacker = users.back();
+  // The code must be used before the clock moves on, APP codes expire
+  emit("leakVerificationCode", owner)["timespan"] = "00:00:00";
+  Json::Value &action = emit("stealCard", hacker);
+  action["cardId"] = card.id;
+  action["username"] = owner.name;
+  action["password"] = owner.password;
+  action["paymentCardId"] = cards[hacker.wallet].id;
+  locate(action, card.box);
+  // Only a current APP code can be leaked, EMAIL codes are per card
+  if (owner.app && hacker.walletBalance >= retrieveFee(card)) {
+    hacker.walletBalance -= retrieveFee(card);
+    retrieved(card);
+    setState(c, STOLEN);
+  }
+  return true;
+}
+
+bool Generator::read() {
+  SimUser &user = users[pick(regularUsers())];
+  if (user.plainMails.empty()) {
+    return false;
+  }
+  // Never a "found" mail with a code, an old code would replace the current
+  emit("readMail", user)["mailId"] =
+      (Json::Value::Int64)user.plainMails[pick(user.plainMails.size())];
+  return true;
+}
+
+bool Generator::switchType() {
+  SimUser &user = users[pick(regularUsers())];
+  // The server refuses while cards are found, the user would not notice
+  if (user.inBox > 0 || user.typeLocked) {
+    return false;
+  }
+  user.app = !user.app;
+  emit("setVerificationType", user)["verificationType"] =
+      user.app ? "APP" : "EMAIL";
+  return true;
+}
+
+Json::Value Generator::generate() {
+  const pair<const char *, bool (Generator::*)()> kinds[] = {
+      {"lose", &Generator::lose},         {"find", &Generator::find},
+      {"drop", &Generator::dropToBox},    {"fake", &Generator::dropToFake},
+      {"retrieve", &Generator::retrieve}, {"reject", &Generator::reject},
+      {"redeem", &Generator::redeem},     {"steal", &Generator::steal},
+      {"read", &Generator::read},         {"switch", &Generator::switchType}};
+  vector<double> weights;
+  for (const auto &kind : kinds) {
+    weights.push_back(options.weights.at(kind.first));
+  }
+  discrete_distribution<size_t> choose(weights.begin(), weights.end());
+  long long misses = 0;
+  while ((long long)actions.size() < options.actions) {
+    if ((this->*kinds[choose(rng)].second)()) {
+      misses = 0;
+    } else if (++misses == 100000) {
+      break; // Nothing left to do, e.g. every card was rejected
+    }
+  }
+  return actions;
+}
+
+/**
+ * @brief parse a key=value option
+ * @return false if the key is unknown or the value is missing
+ */
+bool parseOption(Options &options, const string &arg) {
+  size_t eq = arg.find('=');
+  if (eq == string::npos || eq + 1 == arg.size()) {
+    return false;
+  }
+  string key = arg.substr(0, eq);
+  const char *value = arg.c_str() + eq + 1;
+  if (key == "seed") {
+    options.seed = strtoull(value, nullptr, 10);
+  } else if (key == "users") {
+    options.users = atoll(value);
+  } else if (key == "cards") {
+    options.cards = atoll(value);
+  } else if (key == "actions") {
+    options.actions = atoll(value);
+  } else if (key == "app") {
+    options.app = atof(value);
+  } else if (key == "hacker") {
+    options.hacker = atoi(value) != 0;
+  } else if (key == "boxes") {
+    options.boxes = atoll(value);
+  } else if (key == "timespan") {
+    options.timespan = value;
+  } else if (options.weights.count(key)) {
+    options.weights[key] = atof(value);
+  } else {
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  bool valid = argc >= 2;
+  for (int i = 2; valid && i < argc; i++) {
+    valid = parseOption(options, argv[i]);
+  }
+  double totalWeight = 0;
+  for (const auto &weight : options.weights) {
+    totalWeight += max(weight.second, 0.0);
+  }
+  if (!valid || options.users < 1 || options.cards < 1 || options.boxes < 0 ||
+      totalWeight <= 0) {
+    cerr << "Usage: " << argv[0] << " <directory> [key=value ...]" << endl;
+    cerr << "  seed users cards actions app hacker boxes timespan" << endl;
+    cerr << "  weights: lose find drop fake retrieve reject redeem steal "
+            "read switch"
+         << endl;
+    return -1;
+  }
+  string dir = argv[1];
+  mkdir(dir.c_str(), 0755); // Fails harmlessly if it exists
+
+  Generator generator(options);
+  Json::Value scenario = generator.scenario(); // Before the model moves on
+  Json::Value actions = generator.generate();
+  string scenarioFile = dir + "/scenario0.json";
+  string actionsFile = dir + "/actions.json";
+  if (myJSON2File(scenarioFile.data(), &scenario) != EE1520_ERROR_NORMAL ||
+      myJSON2File(actionsFile.data(), &actions) != EE1520_ERROR_NORMAL) {
+    cerr << "Failed to write the scenario to " << dir << endl;
+    return -1;
+  }
+  cerr << "Generated " << options.users << " users and " << actions.size()
+       << " actions in " << dir << endl;
+  return 0;
+}
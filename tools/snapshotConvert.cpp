@@ -0,0 +1,114 @@
+// Converts a world snapshot between JSON and the binary snapshot format.
+// The direction is taken from the input: a binary snapshot is written out as
+// styled JSON, anything else is read as JSON (a scenario0.json or a
+// scenario<num>.json) and written out as a binary snapshot. A binary snapshot
+// is written out as binary if the output ends in ".bin".
+// Given a write-ahead log started on the input, the logged server mutations
+// are replayed before writing, which makes the output the recovered state;
+// only a binary output keeps the 2FA secrets of the server.
+#include "Core/BinaryIO.h"
+#include "World.h"
+#include "WriteAheadLog.h"
+#include <fstream>
+#include <iostream>
+#include <memory>
+using namespace std;
+
+/**
+ * @brief replay a write-ahead log on a loaded world
+ * @return false if the log cannot be read
+ */
+bool replayLog(World &world, const string &logFile) {
+  if (logFile.empty()) {
+    return true;
+  }
+  uint64_t count = 0;
+  if (world.server.replayLog(logFile, &count) != EE1520_ERROR_NORMAL) {
+    cerr << "Malformed write-ahead log: " << logFile << endl;
+    return false;
+  }
+  cerr << "Replayed " << count << " logged mutations" << endl;
+  return true;
+}
+
+/**
+ * @brief whether an output file name asks for a binary snapshot
+ */
+bool isBinaryOutput(const string &output) {
+  const string suffix = ".bin";
+  return output.size() >= suffix.size() &&
+         output.compare(output.size() - suffix.size(), suffix.size(),
+                        suffix) == 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3 && argc != 4) {
+    cerr << "Usage: " << argv[0] << " <input> <output> [log]" << endl;
+    return -1;
+  }
+  string input = argv[1];
+  string output = argv[2];
+  string logFile = argc == 4 ? argv[3] : "";
+
+  ifstream ifs(input, ios::binary);
+  if (!ifs.is_open()) {
+    cerr << "Failed to open input file: " << input << endl;
+    return -1;
+  }
+  char magic[sizeof(BINARY_SNAPSHOT_MAGIC) - 1] = {};
+  ifs.read(magic, sizeof(magic));
+  ifs.close();
+
+  try {
+    if (BinarySnapshot::isBinary(string_view(magic, sizeof(magic)))) {
+      auto snapshot = make_shared<BinarySnapshot>();
+      if (snapshot->map(input) != EE1520_ERROR_NORMAL) {
+        cerr << "Malformed binary snapshot: " << input << endl;
+        return -1;
+      }
+      BinaryReader reader = snapshot->records();
+      World world{reader, snapshot};
+      if (!replayLog(world, logFile)) {
+        return -1;
+      }
+      if (isBinaryOutput(output)) {
+        BinaryWriter writer;
+        world.dump2Binary(writer);
+        if (writer.save(output) != EE1520_ERROR_NORMAL) {
+          cerr << "Failed to write output file: " << output << endl;
+          return -1;
+        }
+        return 0;
+      }
+      // The output may be the input or a link to it, read everything first
+      world.materializeAll();
+      string json =
+          world.snapshotJSON("Converted from " + input).toStyledString();
+      if (saveFileAtomically(output, json) != EE1520_ERROR_NORMAL) {
+        cerr << "Failed to write output file: " << output << endl;
+        return -1;
+      }
+    } else {
+      Json::Value json;
+      if (myFile2JSON(input.c_str(), &json) != EE1520_ERROR_NORMAL) {
+        cerr << "Failed to read JSON file: " << input << endl;
+        return -1;
+      }
+      World world{&json};
+      if (!replayLog(world, logFile)) {
+        return -1;
+      }
+      BinaryWriter writer;
+      world.dump2Binary(writer);
+      if (writer.save(output) != EE1520_ERROR_NORMAL) {
+        cerr << "Failed to write output file: " << output << endl;
+        return -1;
+      }
+    }
+  } catch (ee1520_Exception &e) {
+    cerr << "Exception occurred: " << adoptJSON(e.dump2JSON()).toStyledString()
+         << endl;
+    return -1;
+  }
+  return 0;
+}